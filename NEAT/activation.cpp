@@ -0,0 +1,287 @@
+#include "activation.h"
+#include "system.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace NEAT {
+	namespace {
+		// adding 1.5 * 2^52 rounds a double to an integer held in the low bits of its mantissa
+		const double shifter = 6755399441055744.0;
+		const uint64_t shifter_bits = 0x4338000000000000;
+
+		// exp(x) = 2^k * e^r, r = x - k * ln(2) with ln(2) split so that k * ln2_hi is exact
+		const double exp_max = 709.0;
+		const double exp_min = -708.0;
+		const double log2e = 1.44269504088896340736;
+		const double ln2_hi = 6.93147180369123816490e-01;
+		const double ln2_lo = 1.90821492927058770002e-10;
+		const double exp_coef[] = { 2.505210838544172e-08, 2.7557319223985888e-07, 2.7557319223985893e-06,
+			2.4801587301587302e-05, 0.00019841269841269841, 0.0013888888888888889, 0.0083333333333333332,
+			0.041666666666666664, 0.16666666666666666, 0.5, 1.0, 1.0 }; // 1/11! ... 1/0!
+
+		// sin(x) = +-sin(r) or +-cos(r), r = x - q * pi / 2 with pi / 2 split so that q * pio2_1 is exact for q < 2^20
+		const double two_over_pi = 6.36619772367581382433e-01;
+		const double pio2_1 = 1.57079632673412561417e+00;
+		const double pio2_1t = 6.07710050650619224932e-11;
+		const double sin_coef[] = { -7.6471637318198164e-13, 1.6059043836821613e-10, -2.505210838544172e-08,
+			2.7557319223985893e-06, -0.00019841269841269841, 0.0083333333333333332, -0.16666666666666666 }; // -1/15! ... -1/3!
+		const double cos_coef[] = { 4.7794773323873853e-14, -1.1470745597729725e-11, 2.08767569878681e-09,
+			-2.7557319223985888e-07, 2.4801587301587302e-05, -0.0013888888888888889, 0.041666666666666664, -0.5 }; // 1/16! ... -1/2!
+
+		const double sigmoid_gain = -4.9;
+
+		double as_double(uint64_t bits) { double d; std::memcpy(&d, &bits, sizeof(d)); return d; }
+		uint64_t as_bits(double d) { uint64_t bits; std::memcpy(&bits, &d, sizeof(bits)); return bits; }
+
+		// scalar versions, written to compute exactly what the _x4 versions below do
+		double exp_poly(double x)
+		{
+			x = x < exp_max ? x : exp_max;
+			x = x > exp_min ? x : exp_min;
+			const double t = x * log2e + shifter;
+			const double k = t - shifter;
+			const double r = (x - k * ln2_hi) - k * ln2_lo;
+
+			double p = exp_coef[0];
+			for (uint32_t i = 1; i < 12; ++i) p = p * r + exp_coef[i];
+
+			return p * as_double((as_bits(t) - shifter_bits + 1023) << 52);
+		}
+
+		// both from one reduction: cos(x) = sin(x + pi / 2) is one quadrant on
+		void sin_cos_poly(double x, double& sin, double& cos)
+		{
+			const double t = x * two_over_pi + shifter;
+			const double q = t - shifter;
+			const uint64_t quadrant = as_bits(t) - shifter_bits;
+			const double r = (x - q * pio2_1) - q * pio2_1t;
+			const double r2 = r * r;
+
+			double s = sin_coef[0];
+			for (uint32_t i = 1; i < 7; ++i) s = s * r2 + sin_coef[i];
+			s = r + r * r2 * s;
+
+			double c = cos_coef[0];
+			for (uint32_t i = 1; i < 8; ++i) c = c * r2 + cos_coef[i];
+			c = 1.0 + r2 * c;
+
+			sin = as_double(as_bits((quadrant & 1) ? c : s) ^ ((quadrant & 2) << 62));
+			cos = as_double(as_bits((quadrant & 1) ? s : c) ^ (((quadrant + 1) & 2) << 62));
+		}
+
+		double sin_poly(double x)
+		{
+			double s, c;
+			sin_cos_poly(x, s, c);
+			return s;
+		}
+
+		double sigmoid_fast(double x) { return 1 / (1 + exp_poly(sigmoid_gain * x)); }
+		double tanh_fast(double x) { return 1 - 2 / (exp_poly(2 * x) + 1); }
+		double relu(double x) { return x > 0 ? x : 0; }
+		double gaussian_fast(double x) { return exp_poly(-(x * x)); }
+		double identity(double x) { return x; }
+
+		double sigmoid_exact(double x) { return modified_sigmoid(x); }
+		double tanh_exact(double x) { return std::tanh(x); }
+		double gaussian_exact(double x) { return std::exp(-(x * x)); }
+		double sine_exact(double x) { return std::sin(x); }
+
+#if defined(__AVX2__)
+		__m256d exp_poly_x4(__m256d x)
+		{
+			x = _mm256_min_pd(x, _mm256_set1_pd(exp_max));
+			x = _mm256_max_pd(x, _mm256_set1_pd(exp_min));
+			const __m256d t = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(log2e)), _mm256_set1_pd(shifter));
+			const __m256d k = _mm256_sub_pd(t, _mm256_set1_pd(shifter));
+			const __m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(ln2_hi))), _mm256_mul_pd(k, _mm256_set1_pd(ln2_lo)));
+
+			__m256d p = _mm256_set1_pd(exp_coef[0]);
+			for (uint32_t i = 1; i < 12; ++i) p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(exp_coef[i]));
+
+			__m256i scale = _mm256_sub_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(int64_t(shifter_bits)));
+			scale = _mm256_slli_epi64(_mm256_add_epi64(scale, _mm256_set1_epi64x(1023)), 52);
+			return _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+		}
+
+		void sin_cos_poly_x4(__m256d x, __m256d& sin, __m256d& cos)
+		{
+			const __m256d t = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(two_over_pi)), _mm256_set1_pd(shifter));
+			const __m256d q = _mm256_sub_pd(t, _mm256_set1_pd(shifter));
+			const __m256i quadrant = _mm256_sub_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(int64_t(shifter_bits)));
+			const __m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(q, _mm256_set1_pd(pio2_1))), _mm256_mul_pd(q, _mm256_set1_pd(pio2_1t)));
+			const __m256d r2 = _mm256_mul_pd(r, r);
+
+			__m256d s = _mm256_set1_pd(sin_coef[0]);
+			for (uint32_t i = 1; i < 7; ++i) s = _mm256_add_pd(_mm256_mul_pd(s, r2), _mm256_set1_pd(sin_coef[i]));
+			s = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(r, r2), s));
+
+			__m256d c = _mm256_set1_pd(cos_coef[0]);
+			for (uint32_t i = 1; i < 8; ++i) c = _mm256_add_pd(_mm256_mul_pd(c, r2), _mm256_set1_pd(cos_coef[i]));
+			c = _mm256_add_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(r2, c));
+
+			const __m256i one = _mm256_set1_epi64x(1);
+			const __m256i two = _mm256_set1_epi64x(2);
+			const __m256d use_cos = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(quadrant, one), one));
+			const __m256i sin_sign = _mm256_slli_epi64(_mm256_and_si256(quadrant, two), 62);
+			const __m256i cos_sign = _mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(quadrant, one), two), 62);
+			sin = _mm256_xor_pd(_mm256_blendv_pd(s, c, use_cos), _mm256_castsi256_pd(sin_sign));
+			cos = _mm256_xor_pd(_mm256_blendv_pd(c, s, use_cos), _mm256_castsi256_pd(cos_sign));
+		}
+
+		__m256d sin_poly_x4(__m256d x)
+		{
+			__m256d s, c;
+			sin_cos_poly_x4(x, s, c);
+			return s;
+		}
+
+		__m256d sigmoid_fast_x4(__m256d x)
+		{
+			const __m256d one = _mm256_set1_pd(1.0);
+			return _mm256_div_pd(one, _mm256_add_pd(one, exp_poly_x4(_mm256_mul_pd(_mm256_set1_pd(sigmoid_gain), x))));
+		}
+
+		__m256d tanh_fast_x4(__m256d x)
+		{
+			const __m256d one = _mm256_set1_pd(1.0);
+			const __m256d e = exp_poly_x4(_mm256_mul_pd(_mm256_set1_pd(2.0), x));
+			return _mm256_sub_pd(one, _mm256_div_pd(_mm256_set1_pd(2.0), _mm256_add_pd(e, one)));
+		}
+
+		__m256d gaussian_fast_x4(__m256d x)
+		{
+			return exp_poly_x4(_mm256_xor_pd(_mm256_mul_pd(x, x), _mm256_set1_pd(-0.0)));
+		}
+
+		__m256d relu_x4(__m256d x) { return _mm256_max_pd(x, _mm256_setzero_pd()); }
+
+		template <typename F>
+		uint32_t apply(F f, const double* in, double* out, uint32_t n)
+		{
+			uint32_t i = 0;
+			for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, f(_mm256_loadu_pd(in + i)));
+			return i;
+		}
+#endif
+	}
+
+	const char* activation_name(Activation a)
+	{
+		switch (a) {
+		case Activation::sigmoid: return "sigmoid";
+		case Activation::tanh: return "tanh";
+		case Activation::relu: return "relu";
+		case Activation::gaussian: return "gaussian";
+		case Activation::sine: return "sine";
+		case Activation::identity: return "identity";
+		default: return "unknown";
+		}
+	}
+
+	double activate(Activation a, double x)
+	{
+		switch (a) {
+		case Activation::sigmoid: return modified_sigmoid(x);
+		case Activation::tanh: return std::tanh(x);
+		case Activation::relu: return x > 0 ? x : 0;
+		case Activation::gaussian: return std::exp(-(x * x));
+		case Activation::sine: return std::sin(x);
+		default: return x;
+		}
+	}
+
+	float activate(Activation a, float x)
+	{
+		switch (a) {
+		case Activation::sigmoid: return modified_sigmoid(x);
+		case Activation::tanh: return std::tanh(x);
+		case Activation::relu: return x > 0 ? x : 0;
+		case Activation::gaussian: return std::exp(-(x * x));
+		case Activation::sine: return std::sin(x);
+		default: return x;
+		}
+	}
+
+	void activate(Activation a, const double* in, double* out, uint32_t n)
+	{
+		for (uint32_t i = 0; i < n; ++i) out[i] = activate(a, in[i]);
+	}
+
+	double activate_fast(Activation a, double x)
+	{
+		switch (a) {
+		case Activation::sigmoid: return sigmoid_fast(x);
+		case Activation::tanh: return tanh_fast(x);
+		case Activation::relu: return relu(x);
+		case Activation::gaussian: return gaussian_fast(x);
+		case Activation::sine: return sin_poly(x);
+		default: return x;
+		}
+	}
+
+	void activate_fast(Activation a, const double* in, double* out, uint32_t n)
+	{
+		uint32_t i = 0;
+#if defined(__AVX2__)
+		switch (a) {
+		case Activation::sigmoid: i = apply([](__m256d x) { return sigmoid_fast_x4(x); }, in, out, n); break;
+		case Activation::tanh: i = apply([](__m256d x) { return tanh_fast_x4(x); }, in, out, n); break;
+		case Activation::relu: i = apply([](__m256d x) { return relu_x4(x); }, in, out, n); break;
+		case Activation::gaussian: i = apply([](__m256d x) { return gaussian_fast_x4(x); }, in, out, n); break;
+		case Activation::sine: i = apply([](__m256d x) { return sin_poly_x4(x); }, in, out, n); break;
+		default: break;
+		}
+#endif
+		for (; i < n; ++i) out[i] = activate_fast(a, in[i]);
+	}
+
+	void sin_cos_fast(const double* x, double* sin, double* cos, uint32_t n)
+	{
+		uint32_t i = 0;
+#if defined(__AVX2__)
+		for (; i + 4 <= n; i += 4) {
+			__m256d s, c;
+			sin_cos_poly_x4(_mm256_loadu_pd(x + i), s, c);
+			_mm256_storeu_pd(sin + i, s);
+			_mm256_storeu_pd(cos + i, c);
+		}
+#endif
+		for (; i < n; ++i) sin_cos_poly(x[i], sin[i], cos[i]);
+	}
+
+	double activation_error_bound(Activation a)
+	{
+		switch (a) {
+		case Activation::sigmoid: return 1e-14;
+		case Activation::tanh: return 1e-14;
+		case Activation::gaussian: return 1e-14;
+		case Activation::sine: return 1e-15;
+		default: return 0;
+		}
+	}
+
+	const ExpPolynomial& exp_polynomial()
+	{
+		static const ExpPolynomial polynomial{ exp_max, exp_min, log2e, shifter, ln2_hi, ln2_lo, shifter_bits, exp_coef,
+			uint32_t(sizeof(exp_coef) / sizeof(exp_coef[0])), sigmoid_gain };
+		return polynomial;
+	}
+
+	ActivationFunction activation_function(Activation a, bool fast)
+	{
+		switch (a) {
+		case Activation::sigmoid: return fast ? &sigmoid_fast : &sigmoid_exact;
+		case Activation::tanh: return fast ? &tanh_fast : &tanh_exact;
+		case Activation::relu: return &relu;
+		case Activation::gaussian: return fast ? &gaussian_fast : &gaussian_exact;
+		case Activation::sine: return fast ? &sin_poly : &sine_exact;
+		default: return &identity;
+		}
+	}
+}
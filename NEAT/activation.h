@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+
+namespace NEAT {
+	// The activation functions a node can use. sigmoid is the modified sigmoid from the 2002 paper
+	// (1 / (1 + exp(-4.9x))) and is what every node starts with.
+	enum class Activation : uint8_t { sigmoid, tanh, relu, gaussian, sine, identity };
+	const uint32_t activation_count = 6;
+
+	const char* activation_name(Activation a);
+
+	// reference implementations using the standard library
+	double activate(Activation a, double x);
+	float activate(Activation a, float x);
+
+	// applies the reference implementation to every element: out[i] = activate(a, in[i])
+	void activate(Activation a, const double* in, double* out, uint32_t n);
+
+	// Polynomial approximations evaluated with AVX2 where available (a scalar loop computing the same
+	// polynomials otherwise). exp is reduced to 2^k * e^r with |r| <= ln(2) / 2 and a degree 11
+	// polynomial, sin and cos to |r| <= pi / 4 with degree 15 and 16 polynomials.
+	// The absolute error against activate is at most activation_error_bound(a) for every input of
+	// sigmoid, tanh and gaussian, and for |x| < 2^20 for sine.
+	void activate_fast(Activation a, const double* in, double* out, uint32_t n);
+	double activate_fast(Activation a, double x);
+	double activation_error_bound(Activation a);
+
+	// the sine kernel's sine and cosine of each element together, from one range reduction, for simulators
+	// stepping many environments at once. the same error bound and range as activate_fast for sine
+	void sin_cos_fast(const double* x, double* sin, double* cos, uint32_t n);
+
+	// a plain function pointer for one activation, for callers (like the JIT) that need an address to call
+	typedef double (*ActivationFunction)(double);
+	ActivationFunction activation_function(Activation a, bool fast);
+
+	// the constants of the polynomial exp behind the fast sigmoid, for the JIT to compute it in line: the input is
+	// clamped to [min, max], k = (x * log2e + shifter) - shifter, r = (x - k * ln2_hi) - k * ln2_lo, the polynomial
+	// in r is evaluated by Horner's rule from coefficients[0], and scaled by 2^k built from the bits of x * log2e + shifter
+	struct ExpPolynomial {
+		double max, min;
+		double log2e, shifter, ln2_hi, ln2_lo;
+		uint64_t shifter_bits;
+		const double* coefficients;
+		uint32_t terms;
+		double sigmoid_gain; // sigmoid(x) = 1 / (1 + exp(sigmoid_gain * x))
+	};
+	const ExpPolynomial& exp_polynomial();
+}
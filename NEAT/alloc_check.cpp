@@ -0,0 +1,151 @@
+#include "alloc_check.h"
+#include "system.h"
+
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+#ifdef NEAT_COUNT_ALLOCATIONS
+namespace {
+	thread_local uint64_t allocations = 0;
+	thread_local uint64_t atomic_operations = 0;
+
+	void* allocate(std::size_t size)
+	{
+		allocations++;
+		return std::malloc(size ? size : 1);
+	}
+
+	void* allocate(std::size_t size, std::align_val_t alignment)
+	{
+		allocations++;
+		const std::size_t align = std::size_t(alignment);
+#ifdef _MSC_VER
+		return _aligned_malloc(size ? size : 1, align);
+#else
+		return std::aligned_alloc(align, size ? (size + align - 1) / align * align : align); // a multiple of align
+#endif
+	}
+
+	void release(void* p, std::align_val_t)
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+
+	template <typename... Alignment>
+	void* allocate_or_throw(std::size_t size, Alignment... alignment)
+	{
+		if (void* p = allocate(size, alignment...)) return p;
+		throw std::bad_alloc{};
+	}
+}
+
+void* operator new(std::size_t size) { return allocate_or_throw(size); }
+void* operator new[](std::size_t size) { return allocate_or_throw(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t a) { return allocate_or_throw(size, a); }
+void* operator new[](std::size_t size, std::align_val_t a) { return allocate_or_throw(size, a); }
+void* operator new(std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(size, a); }
+void* operator new[](std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(size, a); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t a) noexcept { release(p, a); }
+void operator delete[](void* p, std::align_val_t a) noexcept { release(p, a); }
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept { release(p, a); }
+void operator delete[](void* p, std::size_t, std::align_val_t a) noexcept { release(p, a); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept { release(p, a); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept { release(p, a); }
+#endif
+
+namespace NEAT {
+	namespace {
+		// the counts of the timesteps the longer run had over the shorter
+		double per_timestep(const uint64_t counts[2], const uint64_t ran[2])
+		{
+			if (ran[1] <= ran[0]) throw std::runtime_error("Episodes too short for NEAT::count_per_timestep: both runs ended early");
+			return (double(counts[1]) - double(counts[0])) / double(ran[1] - ran[0]);
+		}
+
+		template <typename Run>
+		TimestepCounts count_runs(Run run)
+		{
+			uint64_t allocated[2], atomics[2], ran[2];
+			for (uint32_t r = 0; r < 2; ++r) {
+				const uint64_t allocations_before = allocation_count();
+				const uint64_t atomics_before = atomic_operation_count();
+				ran[r] = run(r + 1);
+				allocated[r] = allocation_count() - allocations_before;
+				atomics[r] = atomic_operation_count() - atomics_before;
+			}
+			return TimestepCounts{ per_timestep(allocated, ran), per_timestep(atomics, ran) };
+		}
+	}
+
+	bool counting_allocations()
+	{
+#ifdef NEAT_COUNT_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	uint64_t allocation_count()
+	{
+#ifdef NEAT_COUNT_ALLOCATIONS
+		return allocations;
+#else
+		return 0;
+#endif
+	}
+
+	uint64_t atomic_operation_count()
+	{
+#ifdef NEAT_COUNT_ALLOCATIONS
+		return atomic_operations;
+#else
+		return 0;
+#endif
+	}
+
+#ifdef NEAT_COUNT_ALLOCATIONS
+	void count_atomic_operations(uint32_t n)
+	{
+		atomic_operations += n;
+	}
+#endif
+
+	TimestepCounts count_per_timestep(Network& net, Simulator& sim, uint32_t steps)
+	{
+		// a first run leaves behind anything made once per network, such as its state
+		sim.reset();
+		net.simulate(sim, steps);
+
+		return count_runs([&](uint32_t times) {
+			sim.reset();
+			return uint64_t(net.simulate(sim, steps * times));
+		});
+	}
+
+	TimestepCounts count_per_timestep(System& sys, uint32_t steps)
+	{
+		sys.reset_simulators();
+		sys.simulate_population(steps);
+
+		return count_runs([&](uint32_t times) {
+			sys.reset_simulators();
+			sys.simulate_population(steps * times);
+			return sys.get_evaluation_stats().timesteps;
+		});
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+
+namespace NEAT {
+	class Network;
+	class Simulator;
+	class System;
+
+	// Counts heap allocations and atomic reference counting, to check that evaluation does neither per timestep.
+	// Counting replaces every global operator new (plain, array, nothrow and aligned), so it is only compiled in
+	// with NEAT_COUNT_ALLOCATIONS defined. Without it counting_allocations() is false and the counts stay 0.
+	// Atomic operations can't be seen from outside the standard library, so the library counts the ones it makes
+	// itself, where it makes them: each copy of a shared_ptr it holds (a Network's genes, layout and compiled
+	// code, a BatchEnvironment's batch) and each read of a use_count. tools/check_allocations.cpp fails if a
+	// timestep makes either; tools/run_checks.sh builds and runs it
+	bool counting_allocations();
+	uint64_t allocation_count(); // made on this thread since it started
+	uint64_t atomic_operation_count(); // counted on this thread since it started
+
+#ifdef NEAT_COUNT_ALLOCATIONS
+	void count_atomic_operations(uint32_t n);
+#else
+	inline void count_atomic_operations(uint32_t) {}
+#endif
+
+	// A member that counts n atomic operations whenever the object holding it is copied, n being the number of
+	// shared_ptrs the object holds. Moves take the pointers over without touching the counts
+	template <uint32_t n>
+	struct SharedCopies {
+		SharedCopies() = default;
+		SharedCopies(const SharedCopies&) { count_atomic_operations(n); }
+		SharedCopies(SharedCopies&&) noexcept = default;
+		SharedCopies& operator=(const SharedCopies&) { count_atomic_operations(n); return *this; }
+		SharedCopies& operator=(SharedCopies&&) noexcept = default;
+	};
+
+	struct TimestepCounts {
+		double allocations;
+		double atomic_operations;
+	};
+
+	// what each timestep of net.simulate(sim, ...) costs, from runs of steps and 2 * steps so that compiling
+	// the network and setting up the evaluator don't count. the episodes must last longer than steps.
+	// sim is reset before each run, and net keeps the state and fitness of the last
+	TimestepCounts count_per_timestep(Network& net, Simulator& sim, uint32_t steps);
+
+	// the same for the lockstep path, through System::simulate_population. the simulators are reset before each run
+	TimestepCounts count_per_timestep(System& sys, uint32_t steps);
+}
@@ -25,6 +25,7 @@ void Cart_beam_system::calculate_values(double ts)
 
 void Cart_beam_system::calculate_values(double ts, double x_ddot)
 {
+	// no clamp at the rails: the episode ends there instead (see is_terminal)
 	//if ((x >= rail_limit && x_dot > 0) || (x <= -rail_limit && x_dot < 0)) x_dot = 0;
 
 	x_double_dot = x_ddot;
@@ -32,16 +32,18 @@ public:
 	}
 
 	const std::vector<double>& get_inputs_to_network() override {
-		inputs.clear();
-
-		double in_phi = fmod(phi-M_PI, 2 * M_PI)/M_PI;
-
-		inputs.push_back(in_phi);
-		inputs.push_back(phi_dot);
-		inputs.push_back(x - x_desired);
+		inputs.resize(3);
+		write_inputs_to_network(inputs.data(), 3);
 		return inputs;
 	}
 
+	void write_inputs_to_network(double* in, uint32_t count) override {
+		if (count != 3) throw std::runtime_error("Cart_beam_system takes three inputs");
+		in[0] = fmod(phi - M_PI, 2 * M_PI) / M_PI;
+		in[1] = phi_dot;
+		in[2] = x - x_desired;
+	}
+
 	void reset() override {
 		x = 0;
 		x_dot = 0;
@@ -59,6 +61,12 @@ public:
 	
 	double get_fitness() override { return fitness; }
 
+	// off the end of the rails: the episode is lost. calculate_values(ts, x_ddot) doesn't stop the cart at the
+	// rails (its clamp is commented out), so this is what enforces them. the reward is positive every step,
+	// so a cart that leaves the rails stops scoring where it left, rather than scoring on past them as it did
+	// before episodes could end
+	bool is_terminal() override { return std::abs(x) > rail_limit; }
+
 	friend std::ostream& operator<<(std::ostream& os, const Cart_beam_system& cbs)
 	{
 		os << "phi: " << std::setw(15) << cbs.phi << '\n';
@@ -66,6 +74,7 @@ public:
 	}
 
 	double get_x() const { return x; }
+	double get_phi() const { return phi; }
 
 private:
 	double x, x_dot, x_double_dot, phi, phi_dot, phi_double_dot;
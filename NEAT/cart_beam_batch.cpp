@@ -0,0 +1,175 @@
+#include "cart_beam_batch.h"
+#include "cart_beam.h"
+#include "activation.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace {
+	const double ts = 0.01; // the timestep Cart_beam_system::update_with_network_output integrates with
+	const double two_pi = 2 * M_PI;
+}
+
+Cart_beam_batch::Cart_beam_batch(uint32_t carts)
+	:Cart_beam_batch{ carts, 1, 1, 1, 0.1, 3 }
+{
+	std::fill(phi.begin(), phi.end(), M_PI);
+	update_trig(0, carts);
+}
+
+Cart_beam_batch::Cart_beam_batch(uint32_t carts, double mr, double mc, double length, double drag_, double rail_limit_)
+	:mass_cart{ mc }, mass_rod{ mr }, length_rod{ length }, drag{ drag_ }, rail_limit{ rail_limit_ }, x(carts), x_dot(carts),
+	phi(carts), phi_dot(carts), x_desired(carts, 1), fitness(carts), sin_phi(carts), cos_phi(carts), scratch(carts),
+	timesteps(carts), generation(carts)
+{
+	update_trig(0, carts);
+}
+
+void Cart_beam_batch::get_inputs_to_network(uint32_t first, uint32_t last, double* inputs)
+{
+	for (uint32_t k = first; k < last; ++k) {
+		// fmod(phi - pi, 2 pi), with the quotient truncated as fmod does
+		const double a = phi[k] - M_PI;
+		double* row = inputs + size_t(k - first) * 3;
+		row[0] = (a - std::trunc(a / two_pi) * two_pi) / M_PI;
+		row[1] = phi_dot[k];
+		row[2] = x[k] - x_desired[k];
+	}
+}
+
+void Cart_beam_batch::update_with_network_output(uint32_t first, uint32_t last, const double* outputs, const uint8_t* running)
+{
+	// Cart_beam_system::calculate_values(ts, x_ddot), with the expressions grouped the same way
+	const double inertia = (1.0 / 3) * mass_rod * (length_rod * length_rod);
+	const double mass = mass_rod + mass_cart;
+	const double damping = drag / mass_rod;
+	const double weight = mass_rod * 9.81;
+
+	for (uint32_t k = first; k < last; ++k) {
+		const bool run = running[k - first] != 0;
+		const double x_ddot = 5 * (outputs[k - first] - 0.5);
+		const double new_x_dot = x_dot[k] + x_ddot * ts;
+		const double new_x = x[k] + new_x_dot * ts;
+
+		const double tension = phi_dot[k] * phi_dot[k] * length_rod / 2 * mass_rod;
+		const double force_x = -x_ddot * mass + tension * sin_phi[k];
+		const double force_y = -tension * cos_phi[k] - weight;
+		const double phi_ddot = (force_x * cos_phi[k] + force_y * sin_phi[k] - damping * phi_dot[k]) / inertia;
+		const double new_phi_dot = phi_dot[k] + phi_ddot * ts;
+		const double new_phi = phi[k] + new_phi_dot * ts;
+
+		x_dot[k] = run ? new_x_dot : x_dot[k];
+		x[k] = run ? new_x : x[k];
+		phi_dot[k] = run ? new_phi_dot : phi_dot[k];
+		phi[k] = run ? new_phi : phi[k];
+	}
+	update_trig(first, last);
+
+	// the target follows sin(0.01 * timesteps), from the step count before this step
+	for (uint32_t k = first; k < last; ++k) scratch[k] = 0.01 * timesteps[k];
+	NEAT::activate_fast(NEAT::Activation::sine, &scratch[first], &scratch[first], last - first);
+
+	// Cart_beam_system::update_fitness
+	for (uint32_t k = first; k < last; ++k) {
+		const bool run = running[k - first] != 0;
+		const double dx = length_rod * sin_phi[k] + (x[k] - x_desired[k]);
+		const double dy = length_rod * (1 + cos_phi[k]);
+		const double reward = 1 / ((5 * std::sqrt(dx * dx + dy * dy) + 1) * (1 + std::abs(phi_dot[k] / 10)));
+
+		fitness[k] += run ? reward : 0;
+		x_desired[k] = run ? (generation[k] / 1000.0) * scratch[k] : x_desired[k];
+		timesteps[k] += run ? 1 : 0;
+	}
+}
+
+void Cart_beam_batch::get_fitness(uint32_t first, uint32_t last, double* fitness)
+{
+	std::copy(this->fitness.begin() + first, this->fitness.begin() + last, fitness);
+}
+
+void Cart_beam_batch::reset(uint32_t first, uint32_t last)
+{
+	std::fill(x.begin() + first, x.begin() + last, 0.0);
+	std::fill(x_dot.begin() + first, x_dot.begin() + last, 0.0);
+	std::fill(phi.begin() + first, phi.begin() + last, M_PI);
+	std::fill(phi_dot.begin() + first, phi_dot.begin() + last, 0.0);
+	std::fill(x_desired.begin() + first, x_desired.begin() + last, 0.0);
+	std::fill(fitness.begin() + first, fitness.begin() + last, 0.0);
+	std::fill(timesteps.begin() + first, timesteps.begin() + last, 0.0);
+	for (uint32_t k = first; k < last; ++k) generation[k]++;
+	update_trig(first, last);
+}
+
+void Cart_beam_batch::is_terminal(uint32_t first, uint32_t last, uint8_t* terminal)
+{
+	for (uint32_t k = first; k < last; ++k) terminal[k - first] = std::abs(x[k]) > rail_limit;
+}
+
+void Cart_beam_batch::update_trig(uint32_t first, uint32_t last)
+{
+	NEAT::sin_cos_fast(&phi[first], &sin_phi[first], &cos_phi[first], last - first);
+}
+
+void benchmark_cart_beam(std::ostream& os, uint32_t carts, uint32_t steps)
+{
+	// open-loop controls, different for each cart, repeating every 256 steps
+	const uint32_t period = 256;
+	std::vector<double> controls(size_t(period) * carts);
+	for (uint32_t s = 0; s < period; ++s) {
+		for (uint32_t c = 0; c < carts; ++c) {
+			controls[size_t(s) * carts + c] = 0.5 + 0.4 * std::sin(0.05 * s + 0.7 * c) + 0.1 * std::sin(0.31 * s * (c % 7 + 1));
+		}
+	}
+
+	std::vector<Cart_beam_system> scalar(carts);
+	Cart_beam_batch batch{ carts };
+	std::vector<double> inputs(size_t(carts) * 3);
+	std::vector<uint8_t> running(carts, 1);
+	std::vector<double> out(1);
+
+	double scalar_time = 0, batch_time = 0;
+	double max_x = 0, max_phi = 0;
+	double early_x = 0, early_phi = 0; // over the first trajectory_steps steps
+	for (uint32_t s = 0; s < steps; ++s) {
+		const double* row = &controls[size_t(s % period) * carts];
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t c = 0; c < carts; ++c) {
+			scalar[c].get_inputs_to_network();
+			out[0] = row[c];
+			scalar[c].update_with_network_output(out);
+		}
+		auto end = std::chrono::steady_clock::now();
+		scalar_time += std::chrono::duration<double>(end - start).count();
+
+		start = std::chrono::steady_clock::now();
+		batch.get_inputs_to_network(0, carts, inputs.data());
+		batch.update_with_network_output(0, carts, row, running.data());
+		end = std::chrono::steady_clock::now();
+		batch_time += std::chrono::duration<double>(end - start).count();
+
+		for (uint32_t c = 0; c < carts; ++c) {
+			max_x = std::max(max_x, std::abs(scalar[c].get_x() - batch.get_x(c)) / std::max(1.0, std::abs(scalar[c].get_x())));
+			max_phi = std::max(max_phi, std::abs(scalar[c].get_phi() - batch.get_phi(c)) / std::max(1.0, std::abs(scalar[c].get_phi())));
+		}
+		if (s < Cart_beam_batch::trajectory_steps) {
+			early_x = max_x;
+			early_phi = max_phi;
+		}
+	}
+
+	std::vector<double> fitness(carts);
+	batch.get_fitness(0, carts, fitness.data());
+	double max_fitness = 0;
+	for (uint32_t c = 0; c < carts; ++c) {
+		max_fitness = std::max(max_fitness, std::abs(scalar[c].get_fitness() - fitness[c]) / std::max(1.0, std::abs(scalar[c].get_fitness())));
+	}
+
+	const double stepped = double(carts) * steps;
+	os << "Cart beam physics, " << carts << " carts for " << steps << " steps\n";
+	os << "Scalar: " << stepped / scalar_time << " cart steps per second\n";
+	os << "Batch:  " << stepped / batch_time << " cart steps per second (" << scalar_time / batch_time << "x)\n";
+	os << "Largest relative difference in the first " << Cart_beam_batch::trajectory_steps << " steps: x " << early_x
+		<< ", phi " << early_phi << " (tolerance " << Cart_beam_batch::trajectory_tolerance << ")\n";
+	os << "Largest relative difference in all steps: x " << max_x << ", phi " << max_phi << ", fitness " << max_fitness << '\n';
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+
+#include "simulator.h"
+
+// Cart_beam_system for many carts at once. The state of every cart is kept structure-of-arrays and a block of
+// carts is advanced together: sine and cosine come from the polynomial kernels in activation.h, and the rest
+// of the integrator is straight-line loops over the arrays that the compiler vectorises.
+// The arithmetic is that of Cart_beam_system step for step, apart from the trig and the wrapping of the angle
+// input, so one step from the same state agrees to within step_tolerance. The swinging beam is chaotic, so the
+// difference then grows exponentially: under benchmark_cart_beam's controls the trajectories agree to within
+// trajectory_tolerance for the first trajectory_steps steps (measured, not proven), and a 5000 step episode's
+// fitness to a fraction of a percent. Any change to the scalar rounding, such as a compiler fusing multiplies
+// and adds, diverges the same way.
+class Cart_beam_batch : public NEAT::BatchSimulator {
+public:
+	// carts as made by Cart_beam_system's constructors
+	explicit Cart_beam_batch(uint32_t carts);
+	Cart_beam_batch(uint32_t carts, double mr, double mc, double length, double drag_, double rail_limit_);
+
+	uint32_t size() const override { return uint32_t(x.size()); }
+
+	void get_inputs_to_network(uint32_t first, uint32_t last, double* inputs) override;
+	void update_with_network_output(uint32_t first, uint32_t last, const double* outputs, const uint8_t* running) override;
+	void get_fitness(uint32_t first, uint32_t last, double* fitness) override;
+	void reset(uint32_t first, uint32_t last) override;
+	void is_terminal(uint32_t first, uint32_t last, uint8_t* terminal) override;
+
+	double get_x(uint32_t cart) const { return x[cart]; }
+	double get_phi(uint32_t cart) const { return phi[cart]; }
+
+	static constexpr double step_tolerance = 1e-13; // relative, on each state variable and the fitness
+	static constexpr double trajectory_tolerance = 1e-6; // relative, on x and phi
+	static constexpr uint32_t trajectory_steps = 1000;
+
+private:
+	double mass_cart, mass_rod;
+	double length_rod;
+	double drag;
+	double rail_limit;
+
+	std::vector<double> x, x_dot, phi, phi_dot;
+	std::vector<double> x_desired;
+	std::vector<double> fitness;
+	std::vector<double> sin_phi, cos_phi; // of the current phi
+	std::vector<double> scratch;
+	std::vector<double> timesteps, generation; // counts, held as doubles for the vector loops
+
+	void update_trig(uint32_t first, uint32_t last);
+};
+
+// steps carts with Cart_beam_system and with Cart_beam_batch under the same open-loop controls, and reports
+// the carts stepped per second by each and the largest differences between their trajectories and fitnesses
+void benchmark_cart_beam(std::ostream& os, uint32_t carts, uint32_t steps);
@@ -0,0 +1,44 @@
+#include "checkpoint.h"
+#include "system.h"
+
+#include <cstring>
+
+namespace NEAT {
+	void checkpoint::write_double(std::ostream& os, double d)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &d, sizeof(bits));
+		os << std::hex << bits << std::dec;
+	}
+
+	double checkpoint::read_double(std::istream& is)
+	{
+		uint64_t bits;
+		if (!(is >> std::hex >> bits >> std::dec)) throw std::runtime_error("Truncated or corrupt NEAT checkpoint");
+		double d;
+		std::memcpy(&d, &bits, sizeof(d));
+		return d;
+	}
+
+	void checkpoint::expect(std::istream& is, const char* tag)
+	{
+		std::string field;
+		if (!(is >> field) || field != tag) {
+			throw std::runtime_error(std::string("Expected ") + tag + " in NEAT checkpoint");
+		}
+	}
+
+	void replay(System& sys, std::istream& checkpoint, uint32_t generation, uint32_t timesteps)
+	{
+		sys.load_checkpoint(checkpoint);
+		if (!sys.is_seeded()) throw std::runtime_error("NEAT::replay needs the checkpoint of a seeded run");
+		if (generation < sys.get_generation()) throw std::runtime_error("NEAT::replay can't go back before the checkpoint");
+
+		sys.reset_simulators();
+		while (sys.get_generation() < generation) {
+			sys.simulate_multithread(timesteps);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace NEAT {
+	class System;
+
+	// Checkpoints are plain text: whitespace separated fields, each section opened by a tag.
+	// Doubles are written as the hex of their bits, so a reloaded run carries on bit for bit.
+	namespace checkpoint {
+		void write_double(std::ostream& os, double d);
+		double read_double(std::istream& is);
+
+		// throws if the next field isn't tag
+		void expect(std::istream& is, const char* tag);
+
+		template <typename T>
+		T read(std::istream& is)
+		{
+			T value;
+			if (!(is >> value)) throw std::runtime_error("Truncated or corrupt NEAT checkpoint");
+			return value;
+		}
+	}
+
+	// reloads a seeded run from checkpoint (written by System::save_checkpoint) and runs it the way run_NEAT
+	// does, simulating for timesteps each generation, until it reaches generation. sys must be set up as the
+	// original run was: the same constructor arguments and setters, with its simulators initialised.
+	// the population is then the one the original run had at the start of that generation
+	void replay(System& sys, std::istream& checkpoint, uint32_t generation, uint32_t timesteps);
+}
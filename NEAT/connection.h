@@ -2,25 +2,24 @@
 
 #include <iostream>
 #include <iomanip>
+#include <stdint.h>
 
 namespace NEAT {
+	// A gene: only what is inherited. The value a connection carries between timesteps is runtime state,
+	// kept by the network (see Network::State), so the record stays 24 bytes and copies of genomes are dense
 	struct Connection {
-		Connection(unsigned int node1_, unsigned int node2_)
-			:node1{ node1_ }, node2{ node2_ }, enabled{ false }, recursive{ false }, weight{ 0.0 }, value{ 0.0 }, innov_num{ 0 } {}
-		Connection(unsigned int node1_, unsigned int node2_, bool enabled_, uint32_t innov_num, bool recursive_)
-			:node1{ node1_ }, node2{ node2_ }, enabled{ enabled_ }, weight{ 0.0 }, value{ 0.0 }, innov_num{ innov_num }, recursive{ recursive_ } {}
-		Connection(unsigned int node1_, unsigned int node2_, bool enabled_, double weight_, uint32_t innov_num, bool recursive_)
-			:node1{ node1_ }, node2{ node2_ }, enabled{ enabled_ }, weight{ weight_ }, value{ 0.0 }, innov_num{ innov_num }, recursive{ recursive_ } {}
-
-		unsigned int node1, node2;
-		bool enabled;
-		bool recursive;
-		double weight;
-		double value;
+		Connection(uint32_t node1_, uint32_t node2_)
+			:weight{ 0.0 }, node1{ node1_ }, node2{ node2_ }, innov_num{ 0 }, enabled{ false }, recursive{ false } {}
+		Connection(uint32_t node1_, uint32_t node2_, bool enabled_, uint32_t innov_num, bool recursive_)
+			:weight{ 0.0 }, node1{ node1_ }, node2{ node2_ }, innov_num{ innov_num }, enabled{ enabled_ }, recursive{ recursive_ } {}
+		Connection(uint32_t node1_, uint32_t node2_, bool enabled_, double weight_, uint32_t innov_num, bool recursive_)
+			:weight{ weight_ }, node1{ node1_ }, node2{ node2_ }, innov_num{ innov_num }, enabled{ enabled_ }, recursive{ recursive_ } {}
 
+		double weight;
+		uint32_t node1, node2;
 		uint32_t innov_num;
-
-		void update_value(double input) { value = weight * input; }
+		bool enabled;
+		bool recursive;
 
 		bool operator == (const Connection& rhs) const { return (rhs.node1 == node1 && rhs.node2 == node2); } // check if the connection has the same innovation number
 		bool operator != (const Connection& rhs) const { return !(rhs.node1 == node1 && rhs.node2 == node2); }
@@ -36,4 +35,6 @@ namespace NEAT {
 			return os;
 		}
 	};
+
+	static_assert(sizeof(Connection) == 24, "NEAT::Connection should stay a compact gene record");
 };
\ No newline at end of file
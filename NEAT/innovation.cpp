@@ -0,0 +1,124 @@
+#include "innovation.h"
+#include "network.h"
+#include "checkpoint.h"
+
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+namespace NEAT {
+	InnovationRegistry::InnovationRegistry(bool per_generation)
+		:next{ 0 }, per_generation{ per_generation } {}
+
+	uint32_t InnovationRegistry::get(const Connection& gene)
+	{
+		const uint64_t k = key(gene);
+		Shard& s = shard_of(k);
+		{
+			std::shared_lock<std::shared_mutex> read{ s.lock };
+			auto it = s.innovations.find(k);
+			if (it != s.innovations.end()) return it->second;
+		}
+
+		std::unique_lock<std::shared_mutex> write{ s.lock };
+		auto it = s.innovations.find(k); // another thread may have added it in between
+		if (it != s.innovations.end()) return it->second;
+		const uint32_t innov_num = next++;
+		s.innovations.emplace(k, innov_num);
+		return innov_num;
+	}
+
+	bool InnovationRegistry::find(const Connection& gene, uint32_t& innov_num) const
+	{
+		const uint64_t k = key(gene);
+		const Shard& s = shard_of(k);
+		std::shared_lock<std::shared_mutex> read{ s.lock };
+		auto it = s.innovations.find(k);
+		if (it == s.innovations.end()) return false;
+		innov_num = it->second;
+		return true;
+	}
+
+	void InnovationRegistry::next_generation(const std::vector<Network>& population)
+	{
+		next_generation(std::vector<const std::vector<Network>*>{ &population });
+	}
+
+	void InnovationRegistry::next_generation(const std::vector<const std::vector<Network>*>& populations)
+	{
+		if (!per_generation) return;
+
+		for (Shard& s : shards) s.innovations.clear();
+		for (const std::vector<Network>* population : populations) {
+			for (const Network& net : *population) {
+				for (const Connection& c : net.get_genome()) {
+					const uint64_t k = key(c);
+					shard_of(k).innovations.emplace(k, c.innov_num);
+				}
+			}
+		}
+	}
+
+	size_t InnovationRegistry::size() const
+	{
+		size_t total = 0;
+		for (const Shard& s : shards) {
+			std::shared_lock<std::shared_mutex> read{ s.lock };
+			total += s.innovations.size();
+		}
+		return total;
+	}
+
+	void InnovationRegistry::save(std::ostream& os) const
+	{
+		std::vector<std::pair<uint32_t, uint64_t>> pairs; // in number order, so equal tables write equal checkpoints
+		for (const Shard& s : shards) {
+			for (const auto& p : s.innovations) pairs.emplace_back(p.second, p.first);
+		}
+		std::sort(pairs.begin(), pairs.end());
+
+		os << "innovations " << next << ' ' << pairs.size() << '\n';
+		for (const auto& p : pairs) {
+			os << uint32_t(p.second >> 32) << ' ' << uint32_t(p.second) << ' ' << p.first << '\n';
+		}
+	}
+
+	void InnovationRegistry::load(std::istream& is)
+	{
+		checkpoint::expect(is, "innovations");
+		const uint32_t count = checkpoint::read<uint32_t>(is);
+		const size_t pairs = checkpoint::read<size_t>(is);
+
+		std::vector<std::pair<uint64_t, uint32_t>> table(pairs);
+		for (auto& p : table) {
+			const uint32_t node1 = checkpoint::read<uint32_t>(is);
+			const uint32_t node2 = checkpoint::read<uint32_t>(is);
+			p = { key(Connection{ node1, node2 }), checkpoint::read<uint32_t>(is) };
+			if (p.second >= count) throw std::runtime_error("Innovation number out of range in NEAT::InnovationRegistry::load");
+		}
+
+		for (Shard& s : shards) s.innovations.clear();
+		for (const auto& p : table) shard_of(p.first).innovations.emplace(p.first, p.second);
+		next = count;
+	}
+
+	uint32_t InnovationBatch::get(const Connection& gene)
+	{
+		uint32_t innov_num;
+		if (registry->find(gene, innov_num)) return innov_num;
+
+		for (uint32_t i = 0; i < found.size(); ++i) {
+			if (found[i] == gene) return first_provisional + i;
+		}
+		found.push_back(Connection{ gene.node1, gene.node2 });
+		return first_provisional + uint32_t(found.size() - 1);
+	}
+
+	std::vector<uint32_t> InnovationBatch::resolve(InnovationRegistry& registry) const
+	{
+		std::vector<uint32_t> numbers;
+		numbers.reserve(found.size());
+		for (const Connection& gene : found) numbers.push_back(registry.get(gene));
+		return numbers;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include <iostream>
+#include <stdint.h>
+
+#include "connection.h"
+
+namespace NEAT {
+	class Network;
+
+	// Gives each structural innovation (a connection from node1 to node2) its innovation number.
+	// The table is split into shards by a hash of the pair, each with its own lock, so many threads can
+	// look up innovations at once: readers share a shard, and only the first sighting of a pair takes it
+	// exclusively. Numbers are handed out from one atomic counter.
+	//
+	// By default a pair keeps its number for the whole run. With per-generation scoping, the table is
+	// rebuilt by next_generation from the genes still in the population, so it stays the size of the
+	// live gene pool. Numbering stays consistent for everything alive, and a pair that died out and is
+	// later rediscovered gets a new number (as in the 2002 paper, where only innovations of the same
+	// generation are matched).
+	class InnovationRegistry {
+	public:
+		explicit InnovationRegistry(bool per_generation = false);
+
+		InnovationRegistry(const InnovationRegistry&) = delete;
+		InnovationRegistry& operator=(const InnovationRegistry&) = delete;
+
+		// the number for gene's (node1, node2), assigning the next free one if the pair is new
+		uint32_t get(const Connection& gene);
+
+		// a number previously given out, without adding anything: false if the pair isn't known
+		bool find(const Connection& gene, uint32_t& innov_num) const;
+
+		// with per-generation scoping, forget every pair that is not in population.
+		// must not run concurrently with get
+		void next_generation(const std::vector<Network>& population);
+
+		// the same for a registry shared by several systems: forget every pair in none of their populations
+		void next_generation(const std::vector<const std::vector<Network>*>& populations);
+
+		bool is_per_generation() const { return per_generation; }
+		size_t size() const; // the number of pairs currently held
+		uint32_t get_count() const { return next; } // the number of innovations ever assigned
+
+		// writes the table and the counter for a checkpoint, and reads them back in place of the current ones.
+		// must not run concurrently with get
+		void save(std::ostream& os) const;
+		void load(std::istream& is);
+
+	private:
+		static const uint32_t shard_count = 64;
+
+		struct alignas(64) Shard {
+			mutable std::shared_mutex lock;
+			std::unordered_map<uint64_t, uint32_t> innovations;
+		};
+
+		static uint64_t key(const Connection& gene) { return (uint64_t(gene.node1) << 32) | gene.node2; }
+		Shard& shard_of(uint64_t key) { return shards[(key * 0x9E3779B97F4A7C15ull) >> 58]; }
+		const Shard& shard_of(uint64_t key) const { return shards[(key * 0x9E3779B97F4A7C15ull) >> 58]; }
+
+		Shard shards[shard_count];
+		std::atomic<uint32_t> next;
+		bool per_generation;
+	};
+
+	// The innovations one child finds while the registry is left alone, so that the numbers they end up with
+	// don't depend on which thread asked first. Pairs the registry already knows keep their numbers; new
+	// pairs get provisional numbers from first_provisional up, in the order the child found them. first_provisional
+	// must be at least the registry's count, so provisional numbers still sort after every existing gene.
+	// Resolving the batches of a generation one after another in a fixed order numbers its innovations
+	// the same way however many threads built it.
+	class InnovationBatch {
+	public:
+		InnovationBatch(const InnovationRegistry& registry, uint32_t first_provisional)
+			:registry{ &registry }, first_provisional{ first_provisional } {}
+
+		uint32_t get(const Connection& gene);
+
+		// registers the new pairs, returning their real numbers in provisional order
+		std::vector<uint32_t> resolve(InnovationRegistry& registry) const;
+
+		bool empty() const { return found.empty(); }
+		uint32_t get_first_provisional() const { return first_provisional; }
+
+	private:
+		const InnovationRegistry* registry;
+		uint32_t first_provisional;
+		std::vector<Connection> found; // the new pairs, in provisional order
+	};
+}
@@ -0,0 +1,177 @@
+#include "island.h"
+#include "network.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace NEAT {
+	Islands::Islands(uint32_t islands, uint32_t size, uint32_t inputs, uint32_t outputs, double err,
+		bool per_generation_innovations, uint32_t threads_per_island)
+		:innovations{ std::make_shared<InnovationRegistry>(per_generation_innovations) }, pool{ std::max(islands, 1u) },
+		interval{}, migrants{}, topology{ Topology::ring }, generation{}, island_stats(islands, IslandStats{}),
+		migration_stats{}, phase_time(islands)
+	{
+		if (islands == 0) throw std::runtime_error("NEAT::Islands needs at least one island");
+		if (threads_per_island == 0) threads_per_island = std::max(std::thread::hardware_concurrency() / islands, 1u);
+
+		for (uint32_t i = 0; i < islands; ++i) {
+			this->islands.emplace_back(std::make_unique<System>(size, inputs, outputs, err, innovations));
+			this->islands.back()->set_shared_innovations(true);
+			this->islands.back()->set_threads(threads_per_island);
+		}
+	}
+
+	void Islands::set_migration(uint32_t interval, uint32_t migrants, Topology topology)
+	{
+		// the most any island takes in at once
+		const uint32_t sources = topology == Topology::ring ? 1 : size() - 1;
+		for (const auto& island : islands) {
+			if (uint64_t(migrants) * sources >= island->get_size()) throw std::runtime_error("Too many migrants for a NEAT island");
+		}
+
+		this->interval = interval;
+		this->migrants = migrants;
+		this->topology = topology;
+	}
+
+	void Islands::set_seed(uint64_t seed)
+	{
+		for (uint32_t i = 0; i < size(); ++i) islands[i]->set_seed(RandomStream::key_for(seed, 0, i, Stream::initial));
+	}
+
+	template<typename Work>
+	void Islands::each_island(bool serial, Work work)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		auto run = [&](uint32_t i) {
+			const auto island_start = std::chrono::steady_clock::now();
+			work(*islands[i], i);
+			phase_time[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - island_start).count();
+		};
+
+		// one island to each of the pool's workers, and each island's own pool under it
+		if (serial) {
+			for (uint32_t i = 0; i < size(); ++i) run(i);
+		}
+		else {
+			pool.run(size(), 1, size(), [&](uint32_t first, uint32_t last, uint32_t) {
+				for (uint32_t i = first; i < last; ++i) run(i);
+			});
+		}
+
+		const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (uint32_t i = 0; i < size(); ++i) {
+			island_stats[i].busy += phase_time[i];
+			island_stats[i].waiting += std::max(wall - phase_time[i], 0.0);
+		}
+	}
+
+	void Islands::evolve(uint32_t timesteps)
+	{
+		each_island(false, [&](System& s, uint32_t i) {
+			s.simulate_multithread(timesteps);
+			island_stats[i].evaluations += s.get_size();
+			island_stats[i].timesteps += s.get_evaluation_stats().timesteps;
+
+			const std::vector<Network>& population = s.get_population();
+			island_stats[i].max_fitness = std::max_element(population.begin(), population.end(), [](const Network& a, const Network& b)
+				{return a.get_raw_fitness() < b.get_raw_fitness(); })->get_raw_fitness();
+		});
+
+		uint32_t best = 0;
+		for (uint32_t i = 1; i < size(); ++i) {
+			if (island_stats[i].max_fitness > island_stats[best].max_fitness) best = i;
+		}
+		const std::vector<Network>& population = islands[best]->get_population();
+		const Network& champion = *std::max_element(population.begin(), population.end(), [](const Network& a, const Network& b)
+			{return a.get_raw_fitness() < b.get_raw_fitness(); });
+		if (fittest) *fittest = champion;
+		else fittest = std::make_unique<Network>(champion);
+
+		if (interval > 0 && (generation + 1) % interval == 0) migrate();
+
+		// seeded islands number their new innovations one island at a time, so the numbers don't depend on timing
+		const bool seeded = std::any_of(islands.begin(), islands.end(), [](const auto& s) { return s->is_seeded(); });
+		each_island(seeded, [&](System& s, uint32_t i) {
+			s.produce_next_generation();
+			s.reset_simulators();
+			island_stats[i].generations++;
+		});
+
+		// the islands are all between generations, so the shared table can be rebuilt from every population
+		std::vector<const std::vector<Network>*> populations;
+		for (const auto& island : islands) populations.push_back(&island->get_population());
+		innovations->next_generation(populations);
+		generation++;
+	}
+
+	void Islands::migrate()
+	{
+		if (migrants == 0 || size() < 2) return;
+		const auto start = std::chrono::steady_clock::now();
+
+		// every island's emigrants are copied out before any island takes its immigrants in, so that no genome
+		// moves more than one island per migration
+		std::vector<std::vector<Network>> emigrants(size());
+		std::vector<uint32_t> order;
+		for (uint32_t i = 0; i < size(); ++i) {
+			const std::vector<Network>& population = islands[i]->get_population();
+			order.resize(population.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::partial_sort(order.begin(), order.begin() + migrants, order.end(), [&](uint32_t a, uint32_t b) {
+				const double fa = population[a].get_raw_fitness(), fb = population[b].get_raw_fitness();
+				return fa > fb || (fa == fb && a < b);
+			});
+			for (uint32_t m = 0; m < migrants; ++m) emigrants[i].push_back(population[order[m]]);
+		}
+
+		std::vector<Network> incoming;
+		for (uint32_t to = 0; to < size(); ++to) {
+			incoming.clear();
+			for (uint32_t from = 0; from < size(); ++from) {
+				const bool sends = topology == Topology::ring ? (from + 1) % size() == to : from != to;
+				if (!sends) continue;
+				incoming.insert(incoming.end(), emigrants[from].begin(), emigrants[from].end());
+				island_stats[from].sent += migrants;
+			}
+
+			migration_stats.fitter += islands[to]->immigrate(incoming);
+			island_stats[to].received += incoming.size();
+			migration_stats.migrants += incoming.size();
+		}
+
+		migration_stats.migrations++;
+		migration_stats.wall_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double Islands::get_max_fitness() const
+	{
+		double best = island_stats[0].max_fitness;
+		for (const IslandStats& s : island_stats) best = std::max(best, s.max_fitness);
+		return best;
+	}
+
+	const Network& Islands::get_fittest() const
+	{
+		if (!fittest) throw std::runtime_error("No NEAT island has been simulated yet");
+		return *fittest;
+	}
+
+	std::ostream& Islands::log(std::ostream& os) const
+	{
+		os << "====ISLANDS, GENERATION " << generation << "====\n";
+		for (uint32_t i = 0; i < size(); ++i) {
+			const IslandStats& s = island_stats[i];
+			const std::vector<Species>& species = islands[i]->get_species();
+			os << "Island " << i << ":          max fitness " << s.max_fitness << ", "
+				<< std::count_if(species.begin(), species.end(), [](const Species& sp) { return sp.count > 0; }) << " species, "
+				<< s.genomes_per_second() << " genomes/s, " << s.timesteps_per_second() << " timesteps/s, "
+				<< (s.busy + s.waiting > 0 ? 100 * s.waiting / (s.busy + s.waiting) : 0) << "% waiting, "
+				<< s.sent << " migrants sent, " << s.received << " received\n";
+		}
+		os << "Migration:         " << migration_stats.migrations << " migrations, " << migration_stats.migrants << " migrants, "
+			<< migration_stats.fitter << " fitter than the genome they replaced, " << migration_stats.wall_time * 1000 << " ms\n";
+		os << "Innovations:       " << innovations->get_count() << " assigned, " << innovations->size() << " held\n\n";
+		return os;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <stdint.h>
+
+#include "system.h"
+#include "thread_pool.h"
+
+namespace NEAT {
+	// The island model: several Systems evolve side by side, each on its own thread with a share of the cores,
+	// and every interval generations the fittest migrants genomes of each island are copied to its neighbours,
+	// where they replace the least fit. Small populations speciate and reproduce in less than a share of the
+	// time one large population would, and migration keeps the islands from each converging on their own.
+	// The islands share one InnovationRegistry, so a pair found on any island has the same number on all of
+	// them and migrants cross over with their new neighbours as if they had been bred there.
+	// A generation is evaluated on every island at once, then migrants move while the islands wait for each
+	// other, then every island produces its next generation. Unseeded islands reproduce at the same time. Seeded
+	// islands (see set_seed) reproduce one after another in island order, so that the registry hands out new
+	// innovations in the same order each run and the whole run can be replayed.
+	class Islands {
+	public:
+		enum class Topology {
+			ring, // island i sends to island i + 1, the last to the first
+			all_to_all // every island sends to every other
+		};
+
+		// islands Systems of size genomes each, as made by System's constructor. threads_per_island counts
+		// the island's own thread, 0 to share the cores out evenly
+		Islands(uint32_t islands, uint32_t size, uint32_t inputs, uint32_t outputs, double err,
+			bool per_generation_innovations = false, uint32_t threads_per_island = 0);
+
+		Islands(const Islands&) = delete;
+		Islands& operator=(const Islands&) = delete;
+
+		uint32_t size() const { return uint32_t(islands.size()); }
+		System& get_island(uint32_t i) { return *islands[i]; }
+		const System& get_island(uint32_t i) const { return *islands[i]; }
+		const InnovationRegistry& get_innovations() const { return *innovations; }
+
+		// every interval generations, each island sends copies of its migrants fittest genomes along topology.
+		// an interval of 0 keeps the islands apart. an island takes in fewer genomes than it has
+		void set_migration(uint32_t interval, uint32_t migrants, Topology topology);
+
+		// seeds each island with its own stream, derived from seed
+		void set_seed(uint64_t seed);
+
+		// simulates every island for timesteps, migrates if one is due, then produces every island's next
+		// generation. the islands' simulators must have been set up (System::init_simulators) first
+		void evolve(uint32_t timesteps);
+
+		uint32_t get_generation() const { return generation; }
+		double get_max_fitness() const; // of the last generation simulated, over every island
+		const Network& get_fittest() const; // the genome with that fitness. only once a generation has been simulated
+
+		struct IslandStats {
+			uint64_t generations;
+			uint64_t evaluations; // genomes simulated
+			uint64_t timesteps;
+			double busy; // seconds spent simulating and reproducing
+			double waiting; // seconds spent waiting for the other islands to catch up
+			uint64_t sent, received; // migrants
+			double max_fitness; // of the last generation simulated
+
+			double genomes_per_second() const { return busy > 0 ? evaluations / busy : 0; }
+			double timesteps_per_second() const { return busy > 0 ? timesteps / busy : 0; }
+		};
+		const std::vector<IslandStats>& get_island_stats() const { return island_stats; }
+
+		struct MigrationStats {
+			uint64_t migrations; // generations at which migrants moved
+			uint64_t migrants; // genomes moved, over every island
+			uint64_t fitter; // migrants fitter than the genome they replaced
+			double wall_time; // seconds spent moving them
+		};
+		const MigrationStats& get_migration_stats() const { return migration_stats; }
+
+		// a line for each island and one for migration
+		std::ostream& log(std::ostream& os) const;
+
+	private:
+		std::shared_ptr<InnovationRegistry> innovations;
+		std::vector<std::unique_ptr<System>> islands;
+		ThreadPool pool; // one worker per island
+
+		uint32_t interval, migrants;
+		Topology topology;
+		uint32_t generation;
+		std::unique_ptr<Network> fittest;
+
+		std::vector<IslandStats> island_stats;
+		MigrationStats migration_stats;
+		std::vector<double> phase_time; // by island: seconds spent in the current phase
+
+		// runs work on every island at once, or one after another for serial, and charges its time to the islands
+		template<typename Work>
+		void each_island(bool serial, Work work);
+
+		void migrate();
+	};
+}
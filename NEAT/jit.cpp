@@ -0,0 +1,207 @@
+#include "jit.h"
+#include "network.h"
+
+#include <map>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#define NEAT_JIT_WIN64
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define NEAT_JIT_SYSV
+#endif
+#endif
+
+namespace NEAT {
+	namespace {
+		// appends little-endian immediates and the handful of SSE2 instructions the generated code uses.
+		// constants are read relative to the instruction pointer from a pool placed after the code
+		struct Assembler {
+			std::vector<uint8_t> code;
+			std::vector<uint64_t> pool;
+			std::map<uint64_t, uint32_t> pooled; // the index of each constant in pool, by its bits
+			std::vector<std::pair<size_t, uint32_t>> references; // (offset of a displacement, index in pool)
+
+			// scalar double arithmetic
+			enum Operation : uint8_t { add = 0x58, multiply = 0x59, subtract = 0x5C, minimum = 0x5D, divide = 0x5E, maximum = 0x5F };
+
+			void bytes(std::initializer_list<uint8_t> b) { code.insert(code.end(), b); }
+			void imm32(uint32_t v) { for (int i = 0; i < 4; ++i) code.push_back(uint8_t(v >> (8 * i))); }
+			void imm64(uint64_t v) { for (int i = 0; i < 8; ++i) code.push_back(uint8_t(v >> (8 * i))); }
+
+			// the activation array pointer lives in rbx for the whole function
+			void load(uint8_t xmm, uint32_t slot) { bytes({ 0xF2, 0x0F, 0x10, uint8_t(0x83 | (xmm << 3)) }); imm32(slot * 8); } // movsd xmm, [rbx + slot * 8]
+			void store(uint8_t xmm, uint32_t slot) { bytes({ 0xF2, 0x0F, 0x11, uint8_t(0x83 | (xmm << 3)) }); imm32(slot * 8); } // movsd [rbx + slot * 8], xmm
+			void copy(uint8_t to, uint8_t from) { bytes({ 0x66, 0x0F, 0x28, uint8_t(0xC0 | (to << 3) | from) }); } // movapd to, from
+			void apply(Operation op, uint8_t xmm, uint8_t other) { bytes({ 0xF2, 0x0F, op, uint8_t(0xC0 | (xmm << 3) | other) }); } // xmm = xmm op other
+
+			// the constant's disp32 from the end of the instruction, filled in by finish()
+			void reference(double c) {
+				uint64_t bits;
+				std::memcpy(&bits, &c, sizeof(bits));
+				const auto p = pooled.emplace(bits, uint32_t(pool.size()));
+				if (p.second) pool.push_back(bits);
+				references.emplace_back(code.size(), p.first->second);
+				imm32(0);
+			}
+			void constant(uint8_t xmm, double c) { bytes({ 0xF2, 0x0F, 0x10, uint8_t(0x05 | (xmm << 3)) }); reference(c); } // movsd xmm, [rip + c]
+			void apply_constant(Operation op, uint8_t xmm, double c) { bytes({ 0xF2, 0x0F, op, uint8_t(0x05 | (xmm << 3)) }); reference(c); } // xmm = xmm op c
+
+			// appends the pool, 8 byte aligned, and points every reference at its constant
+			void finish() {
+				while (code.size() % 8) code.push_back(0xCC); // int3
+				const size_t start = code.size();
+				for (uint64_t bits : pool) imm64(bits);
+				for (const auto& [offset, index] : references) {
+					const uint32_t displacement = uint32_t(start + size_t(index) * 8 - (offset + 4));
+					for (int i = 0; i < 4; ++i) code[offset + i] = uint8_t(displacement >> (8 * i));
+				}
+			}
+
+			// xmm0 = 1 / (1 + exp(sigmoid_gain * xmm0)) with the polynomial exp, operation for operation as
+			// activate_fast computes it. uses xmm1 to xmm3, rax and rdx
+			void fast_sigmoid() {
+				const ExpPolynomial& e = exp_polynomial();
+				apply_constant(multiply, 0, e.sigmoid_gain);
+				apply_constant(minimum, 0, e.max); // x < max ? x : max
+				apply_constant(maximum, 0, e.min); // x > min ? x : min
+				copy(1, 0); apply_constant(multiply, 1, e.log2e); apply_constant(add, 1, e.shifter); // xmm1 = t
+				copy(2, 1); apply_constant(subtract, 2, e.shifter); // xmm2 = k
+				copy(3, 2); apply_constant(multiply, 3, e.ln2_hi); apply(subtract, 0, 3);
+				apply_constant(multiply, 2, e.ln2_lo); apply(subtract, 0, 2); // xmm0 = r
+
+				constant(2, e.coefficients[0]);
+				for (uint32_t i = 1; i < e.terms; ++i) {
+					apply(multiply, 2, 0);
+					apply_constant(add, 2, e.coefficients[i]);
+				}
+
+				bytes({ 0x66, 0x48, 0x0F, 0x7E, 0xC8 }); // movq rax, xmm1
+				bytes({ 0x48, 0xBA }); imm64(1023 - e.shifter_bits); // mov rdx, imm64
+				bytes({ 0x48, 0x01, 0xD0 }); // add rax, rdx
+				bytes({ 0x48, 0xC1, 0xE0, 0x34 }); // shl rax, 52
+				bytes({ 0x66, 0x48, 0x0F, 0x6E, 0xD8 }); // movq xmm3, rax
+				apply(multiply, 2, 3); // exp
+
+				apply_constant(add, 2, 1.0);
+				constant(0, 1.0);
+				apply(divide, 0, 2);
+			}
+		};
+	}
+
+	JitPhenotype::JitPhenotype(const Network& net, bool fast_activation)
+		:phenotype{ net, fast_activation }, code{ nullptr }, code_size{}, entry{ nullptr }
+	{
+		if (!supported()) return;
+
+		// every slot is addressed with a 32 bit displacement
+		if (uint64_t(phenotype.get_activation_count()) * 8 > INT32_MAX) return;
+
+		std::vector<uint8_t> machine_code = emit(phenotype);
+		code_size = machine_code.size();
+
+#if defined(NEAT_JIT_WIN64)
+		code = VirtualAlloc(nullptr, code_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (!code) return;
+		std::memcpy(code, machine_code.data(), code_size);
+		DWORD old_protect;
+		if (!VirtualProtect(code, code_size, PAGE_EXECUTE_READ, &old_protect)) {
+			VirtualFree(code, 0, MEM_RELEASE);
+			code = nullptr;
+			return;
+		}
+		FlushInstructionCache(GetCurrentProcess(), code, code_size);
+#elif defined(NEAT_JIT_SYSV)
+		code = mmap(nullptr, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (code == MAP_FAILED) {
+			code = nullptr;
+			return;
+		}
+		std::memcpy(code, machine_code.data(), code_size);
+		if (mprotect(code, code_size, PROT_READ | PROT_EXEC) != 0) {
+			munmap(code, code_size);
+			code = nullptr;
+			return;
+		}
+#endif
+		entry = reinterpret_cast<void (*)(double*)>(code);
+	}
+
+	JitPhenotype::~JitPhenotype()
+	{
+		if (!code) return;
+#if defined(NEAT_JIT_WIN64)
+		VirtualFree(code, 0, MEM_RELEASE);
+#elif defined(NEAT_JIT_SYSV)
+		munmap(code, code_size);
+#endif
+	}
+
+	bool JitPhenotype::supported()
+	{
+#if defined(NEAT_JIT_WIN64) || defined(NEAT_JIT_SYSV)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	std::vector<uint8_t> JitPhenotype::emit(const Phenotype& p)
+	{
+		Assembler a;
+
+		// prologue: keep the activation pointer in rbx (callee saved in both ABIs) and leave the stack
+		// 16 byte aligned with 32 bytes of shadow space for the calls to the activation functions
+#if defined(__AVX__)
+		// legacy SSE instructions run slowly while the upper halves of the registers hold AVX state
+		a.bytes({ 0xC5, 0xF8, 0x77 }); // vzeroupper
+#endif
+		a.bytes({ 0x53 }); // push rbx
+		a.bytes({ 0x48, 0x83, 0xEC, 0x20 }); // sub rsp, 32
+#if defined(NEAT_JIT_WIN64)
+		a.bytes({ 0x48, 0x89, 0xCB }); // mov rbx, rcx
+#else
+		a.bytes({ 0x48, 0x89, 0xFB }); // mov rbx, rdi
+#endif
+
+		for (uint32_t i = 0; i < p.compute_slots.size(); ++i) {
+			const Activation activation = p.row_activations[i];
+			a.bytes({ 0x66, 0x0F, 0x57, 0xC0 }); // xorpd xmm0, xmm0
+			for (uint32_t e = p.row_start[i]; e < p.row_start[i + 1]; ++e) {
+				a.load(1, p.sources[e]);
+				if (p.weights[e] != 1.0) a.apply_constant(Assembler::multiply, 1, p.weights[e]); // carried connections already hold weight * value
+				a.apply(Assembler::add, 0, 1);
+			}
+
+			// the standard library's exp, tanh and sin are called, there being no way to reproduce them in line bit for bit
+			if (activation == Activation::sigmoid && p.fast_activation) a.fast_sigmoid();
+			else if (activation == Activation::relu) {
+				a.bytes({ 0x66, 0x0F, 0x57, 0xC9 }); // xorpd xmm1, xmm1
+				a.apply(Assembler::maximum, 0, 1); // x > 0 ? x : 0
+			}
+			else if (activation != Activation::identity) {
+				const ActivationFunction function = activation_function(activation, p.fast_activation);
+				a.bytes({ 0x48, 0xB8 }); a.imm64(uint64_t(reinterpret_cast<uintptr_t>(function))); // mov rax, function
+				a.bytes({ 0xFF, 0xD0 }); // call rax
+			}
+			a.store(0, p.compute_slots[i]);
+		}
+
+		for (uint32_t k = 0; k < p.refreshed; ++k) {
+			a.load(1, p.carried_sources[k]);
+			a.apply_constant(Assembler::multiply, 1, p.carried_weights[k]);
+			a.store(1, p.node_count + k);
+		}
+
+		a.bytes({ 0x48, 0x83, 0xC4, 0x20 }); // add rsp, 32
+		a.bytes({ 0x5B }); // pop rbx
+		a.bytes({ 0xC3 }); // ret
+
+		a.finish();
+		return a.code;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "phenotype.h"
+
+namespace NEAT {
+	class Network;
+
+	// A Phenotype translated into straight-line x86-64 machine code, with the connection weights and
+	// activation slots baked in as constants. The generated function runs one timestep over an
+	// activation array laid out exactly as the Evaluator's, so its results are bit-identical to the
+	// interpreter. relu, identity and the polynomial sigmoid are computed in line, the last operation for
+	// operation as activate_fast does; the rest are called, as std::exp, std::tanh and std::sin can't be
+	// reproduced in line bit for bit. No external compiler is needed. On other architectures or platforms
+	// nothing is generated, compiled() returns false and callers use the interpreter.
+	class JitPhenotype {
+	public:
+		explicit JitPhenotype(const Network& net, bool fast_activation = false);
+		~JitPhenotype();
+
+		JitPhenotype(const JitPhenotype&) = delete;
+		JitPhenotype& operator=(const JitPhenotype&) = delete;
+
+		static bool supported();
+
+		bool compiled() const { return entry != nullptr; }
+		const Phenotype& get_phenotype() const { return phenotype; }
+		size_t get_code_size() const { return code_size; }
+
+		// evaluates the computed nodes and refreshes the carried connections,
+		// the inputs must already be in place
+		void run(double* activations) const { entry(activations); }
+
+	private:
+		Phenotype phenotype;
+		void* code;
+		size_t code_size;
+		void (*entry)(double*);
+
+		static std::vector<uint8_t> emit(const Phenotype& p);
+	};
+}
@@ -0,0 +1,267 @@
+#include "lockstep.h"
+#include "network.h"
+#include "simd.h"
+
+#include <map>
+#include <algorithm>
+
+namespace NEAT {
+	namespace {
+		// a run of n nodes is padded to the next power of two when grouping
+		uint32_t width_bucket(uint32_t n)
+		{
+			uint32_t bucket = 1;
+			while (bucket < n) bucket *= 2;
+			return bucket;
+		}
+	}
+
+	LockstepEvaluator::LockstepEvaluator(const std::vector<Network>& population, uint32_t first, uint32_t last, bool fast_activation)
+		:first{ first }, last{ last }, inputs{}, outputs{}, lane_of(last >= first ? last - first : 0)
+	{
+		if (first > last || last > population.size()) {
+			throw std::runtime_error("Invalid population range passed to NEAT::LockstepEvaluator");
+		}
+
+		// group the compiled phenotypes by shape: the activation function and bucketed width of each run of nodes
+		std::map<std::vector<uint32_t>, uint32_t> group_of;
+		for (uint32_t i = first; i < last; ++i) {
+			Phenotype p{ population[i], fast_activation };
+			inputs = p.inputs;
+			outputs = p.outputs;
+
+			// a genome compiled to native code runs it in a group of its own, however many share its shape
+			std::shared_ptr<const JitPhenotype> jit = population[i].get_jit();
+			if (jit && jit->get_phenotype().uses_fast_activation() != fast_activation) jit.reset();
+
+			std::vector<uint32_t> key;
+			if (jit) key = { UINT32_MAX, i };
+			for (const Phenotype::Run& run : p.runs) {
+				key.push_back(uint32_t(run.activation));
+				key.push_back(width_bucket(run.last - run.first));
+			}
+
+			auto g = group_of.find(key);
+			if (g == group_of.end()) {
+				g = group_of.emplace(std::move(key), uint32_t(groups.size())).first;
+				groups.emplace_back();
+				groups.back().jit = std::move(jit);
+			}
+			lane_of[i - first] = { g->second, uint32_t(groups[g->second].members.size()) };
+			groups[g->second].members.push_back(i - first);
+			groups[g->second].phenotypes.push_back(std::move(p));
+		}
+
+		for (Group& g : groups) build(g, population);
+	}
+
+	void LockstepEvaluator::build(Group& g, const std::vector<Network>& population) const
+	{
+		const uint32_t lanes = g.lanes();
+		const uint32_t padding = UINT32_MAX;
+
+		// each run of the group is as wide as its widest member's
+		const std::vector<Phenotype::Run>& runs = g.phenotypes[0].runs;
+		std::vector<uint32_t> run_start(runs.size() + 1);
+		for (uint32_t r = 0; r < runs.size(); ++r) {
+			uint32_t width = 0;
+			for (const Phenotype& p : g.phenotypes) width = std::max(width, p.runs[r].last - p.runs[r].first);
+			run_start[r + 1] = run_start[r] + width;
+			g.row_activations.insert(g.row_activations.end(), width, runs[r].activation);
+		}
+		const uint32_t rows = run_start.back();
+
+		// own[row * lanes + lane]: the lane's own row, or padding
+		std::vector<uint32_t> own(size_t(rows) * lanes, padding);
+		uint32_t slots = 0;
+		for (uint32_t l = 0; l < lanes; ++l) {
+			const Phenotype& p = g.phenotypes[l];
+			for (uint32_t r = 0; r < runs.size(); ++r) {
+				for (uint32_t i = p.runs[r].first; i < p.runs[r].last; ++i) own[size_t(run_start[r] + i - p.runs[r].first) * lanes + l] = i;
+			}
+			slots = std::max(slots, p.get_activation_count());
+		}
+		g.zero_slot = slots;
+		g.spare_slot = slots + 1;
+		if ((uint64_t(slots) + 2) * lanes > INT32_MAX) throw std::runtime_error("Too many activations for NEAT::LockstepEvaluator");
+
+		// every row has as many connections as its busiest lane, the rest read the zero slot with a weight of -0.0
+		g.row_start.assign(rows + 1, 0);
+		for (uint32_t row = 0; row < rows; ++row) {
+			uint32_t count = 0;
+			for (uint32_t l = 0; l < lanes; ++l) {
+				const uint32_t i = own[size_t(row) * lanes + l];
+				if (i != padding) count = std::max(count, g.phenotypes[l].row_start[i + 1] - g.phenotypes[l].row_start[i]);
+			}
+			g.row_start[row + 1] = g.row_start[row] + count;
+		}
+
+		const uint32_t connections = g.row_start.back();
+		g.sources.resize(size_t(connections) * lanes);
+		g.weights.resize(size_t(connections) * lanes);
+		g.common_sources.assign(connections, 1);
+		g.targets.resize(size_t(rows) * lanes);
+		g.common_targets.assign(rows, 1);
+		for (uint32_t row = 0; row < rows; ++row) {
+			for (uint32_t l = 0; l < lanes; ++l) {
+				const Phenotype& p = g.phenotypes[l];
+				const uint32_t i = own[size_t(row) * lanes + l];
+				const uint32_t own_count = i != padding ? p.row_start[i + 1] - p.row_start[i] : 0;
+				for (uint32_t k = 0; k < g.row_start[row + 1] - g.row_start[row]; ++k) {
+					const uint32_t e = g.row_start[row] + k;
+					const uint32_t slot = k < own_count ? p.sources[p.row_start[i] + k] : g.zero_slot;
+					g.sources[size_t(e) * lanes + l] = slot * lanes + l;
+					g.weights[size_t(e) * lanes + l] = k < own_count ? p.weights[p.row_start[i] + k] : -0.0;
+					if (slot * lanes != g.sources[size_t(e) * lanes]) g.common_sources[e] = 0;
+				}
+				const uint32_t target = i != padding ? p.compute_slots[i] : g.spare_slot;
+				g.targets[size_t(row) * lanes + l] = target * lanes + l;
+				if (target * lanes != g.targets[size_t(row) * lanes]) g.common_targets[row] = 0;
+			}
+		}
+
+		// the carried connections past a lane's own are refreshed from the zero slot into the spare one
+		g.refreshed = 0;
+		for (const Phenotype& p : g.phenotypes) g.refreshed = std::max(g.refreshed, p.refreshed);
+		g.carried_sources.resize(size_t(g.refreshed) * lanes);
+		g.carried_targets.resize(size_t(g.refreshed) * lanes);
+		g.carried_weights.resize(size_t(g.refreshed) * lanes);
+		g.common_carried.assign(g.refreshed, 1);
+		for (uint32_t k = 0; k < g.refreshed; ++k) {
+			for (uint32_t l = 0; l < lanes; ++l) {
+				const Phenotype& p = g.phenotypes[l];
+				const bool own_carried = k < p.refreshed;
+				const uint32_t source = own_carried ? p.carried_sources[k] : g.zero_slot;
+				const uint32_t target = own_carried ? p.node_count + k : g.spare_slot;
+				g.carried_sources[size_t(k) * lanes + l] = source * lanes + l;
+				g.carried_targets[size_t(k) * lanes + l] = target * lanes + l;
+				g.carried_weights[size_t(k) * lanes + l] = own_carried ? p.carried_weights[k] : 0.0;
+				if (source * lanes != g.carried_sources[size_t(k) * lanes] || target * lanes != g.carried_targets[size_t(k) * lanes]) {
+					g.common_carried[k] = 0;
+				}
+			}
+		}
+
+		g.activations.assign(size_t(slots + 2) * lanes, 0.0);
+		g.sum.resize(lanes);
+		g.retired.assign(lanes, 0);
+		g.running = lanes;
+
+		for (uint32_t l = 0; l < lanes; ++l) {
+			const Phenotype& p = g.phenotypes[l];
+			const Network& net = population[first + g.members[l]];
+			for (uint32_t i = 0; i < p.node_count; ++i) {
+				g.activations[size_t(i) * lanes + l] = net.state.node(i);
+			}
+			for (uint32_t k = 0; k < p.carried_genes.size(); ++k) {
+				g.activations[size_t(p.node_count + k) * lanes + l] = net.state.gene(p.carried_genes[k]);
+			}
+		}
+	}
+
+	void LockstepEvaluator::calculate(const double* input_data, double* output_data)
+	{
+		for (Group& g : groups) {
+			if (g.running > 0) calculate(g, input_data, output_data);
+		}
+	}
+
+	void LockstepEvaluator::calculate(Group& g, const double* input_data, double* output_data)
+	{
+		const uint32_t lanes = g.lanes();
+		const uint32_t in_width = inputs - 1;
+		double* act = g.activations.data();
+
+		for (uint32_t l = 0; l < lanes; ++l) {
+			const Phenotype& p = g.phenotypes[l];
+			const double* in = input_data + size_t(g.members[l]) * in_width;
+			for (uint32_t i = 0; i < in_width; ++i) act[size_t(p.input_slots[i]) * lanes + l] = in[i];
+			act[size_t(p.input_slots[in_width]) * lanes + l] = 1; // bias
+		}
+
+		if (g.jit) {
+			g.jit->run(act);
+		}
+		else {
+			calculate_nodes(g);
+		}
+
+		for (uint32_t l = 0; l < lanes; ++l) {
+			const Phenotype& p = g.phenotypes[l];
+			double* out = output_data + size_t(g.members[l]) * outputs;
+			for (uint32_t o = 0; o < outputs; ++o) out[o] = act[size_t(p.output_slots[o]) * lanes + l];
+		}
+	}
+
+	void LockstepEvaluator::calculate_nodes(Group& g)
+	{
+		const Phenotype& p = g.phenotypes[0];
+		const uint32_t lanes = g.lanes();
+		double* act = g.activations.data();
+		double* sum = g.sum.data();
+
+		for (uint32_t row = 0; row + 1 < g.row_start.size(); ++row) {
+			std::fill_n(sum, lanes, 0.0);
+			for (uint32_t e = g.row_start[row]; e < g.row_start[row + 1]; ++e) {
+				const uint32_t* source = &g.sources[size_t(e) * lanes];
+				const double* w = &g.weights[size_t(e) * lanes];
+				if (g.common_sources[e]) simd::multiply_add(sum, act + source[0], w, lanes);
+				else simd::multiply_add(sum, act, source, w, lanes);
+			}
+
+			const uint32_t* target = &g.targets[size_t(row) * lanes];
+			if (g.common_targets[row]) p.activate(g.row_activations[row], sum, act + target[0], lanes);
+			else {
+				p.activate(g.row_activations[row], sum, sum, lanes);
+				for (uint32_t l = 0; l < lanes; ++l) act[target[l]] = sum[l];
+			}
+		}
+
+		for (uint32_t k = 0; k < g.refreshed; ++k) {
+			const uint32_t* source = &g.carried_sources[size_t(k) * lanes];
+			const uint32_t* target = &g.carried_targets[size_t(k) * lanes];
+			const double* w = &g.carried_weights[size_t(k) * lanes];
+			if (g.common_carried[k]) simd::multiply(act + target[0], act + source[0], w, lanes);
+			else for (uint32_t l = 0; l < lanes; ++l) act[target[l]] = w[l] * act[source[l]];
+		}
+	}
+
+	void LockstepEvaluator::store_state(std::vector<Network>& population) const
+	{
+		for (const Group& g : groups) {
+			for (uint32_t l = 0; l < g.lanes(); ++l) {
+				if (!g.retired[l]) store_state(g, l, population[first + g.members[l]]);
+			}
+		}
+	}
+
+	void LockstepEvaluator::retire(std::vector<Network>& population, uint32_t genome)
+	{
+		if (genome < first || genome >= last) throw std::runtime_error("Invalid genome passed to NEAT::LockstepEvaluator::retire");
+
+		const auto [group, lane] = lane_of[genome - first];
+		Group& g = groups[group];
+		if (g.retired[lane]) return;
+		store_state(g, lane, population[genome]);
+		g.retired[lane] = 1;
+		g.running--;
+	}
+
+	void LockstepEvaluator::store_state(const Group& g, uint32_t lane, Network& net) const
+	{
+		const uint32_t lanes = g.lanes();
+		const Phenotype& p = g.phenotypes[lane];
+		Network::State& state = net.prepare_state();
+
+		for (uint32_t i = 0; i < p.node_count; ++i) {
+			state.nodes[i] = g.activations[size_t(i) * lanes + lane];
+		}
+		for (uint32_t k = 0; k < p.live_genes.size(); ++k) {
+			const uint32_t gene = p.live_genes[k];
+			state.genes[gene] = net.get_genome()[gene].weight * g.activations[size_t(p.live_gene_sources[k]) * lanes + lane];
+		}
+		for (uint32_t o = 0; o < p.outputs; ++o) {
+			net.output_data[o] = g.activations[size_t(p.output_slots[o]) * lanes + lane];
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+#include "phenotype.h"
+#include "jit.h"
+#include "alloc_check.h"
+
+namespace NEAT {
+	class Network;
+
+	// Advances many networks by one timestep in a single sweep.
+	// The compiled phenotypes of a range of the population are grouped by shape: genomes whose layers
+	// have the same activation functions and node counts in the same power of two bucket share a group,
+	// and their weights and activations are packed structure-of-arrays with one lane per genome. Each lane
+	// keeps its own slot numbering; a group has as many rows per layer as its widest member and as many
+	// connections per row as its busiest one, and a lane short of either reads a slot that stays zero
+	// through a weight of -0.0, which leaves its sum exactly as it was, and writes its padded rows to a
+	// slot nothing reads. A connection every lane reads from the same slot is a single dense multiply-add
+	// across the group, and others are gathered lane by lane. Each genome's outputs are bit-identical to
+	// running it alone through an Evaluator. A genome compiled with Network::compile_jit is given a group
+	// of its own and runs its native code.
+	class LockstepEvaluator {
+	public:
+		// compiles networks [first, last) of population, starting from their current state
+		LockstepEvaluator(const std::vector<Network>& population, uint32_t first, uint32_t last, bool fast_activation = false);
+
+		// inputs: one row of (inputs - 1) values per genome in the range, without the bias
+		// outputs: one row of outputs per genome in the range
+		void calculate(const double* inputs, double* outputs);
+
+		// writes the node and connection values back into the networks the evaluator was built from
+		void store_state(std::vector<Network>& population) const;
+
+		// stores population[genome]'s state now, and leaves it out of store_state. its outputs are no longer
+		// meaningful, and once a group has no genomes left running it is skipped
+		void retire(std::vector<Network>& population, uint32_t genome);
+
+		uint32_t get_genomes() const { return last - first; }
+		uint32_t get_groups() const { return uint32_t(groups.size()); }
+		uint32_t get_inputs() const { return inputs; }
+		uint32_t get_outputs() const { return outputs; }
+
+	private:
+		struct Group {
+			std::vector<uint32_t> members; // index of each lane's genome relative to first
+			std::vector<Phenotype> phenotypes; // each member's own plan, for loading and storing state
+			uint32_t zero_slot, spare_slot; // after every member's own slots
+
+			// rows[row_start[i], row_start[i + 1]) are the connections into row i
+			std::vector<uint32_t> row_start;
+			std::vector<Activation> row_activations;
+			std::vector<uint8_t> common_targets; // by row: every lane writes the same slot
+			std::vector<uint32_t> targets; // targets[row * lanes + lane], as an index into activations
+			std::vector<uint8_t> common_sources; // by connection: every lane reads the same slot
+			std::vector<uint32_t> sources; // sources[connection * lanes + lane], as an index into activations
+			std::vector<double> weights; // weights[connection * lanes + lane]
+
+			uint32_t refreshed; // the most carried connections any member refreshes
+			std::vector<uint8_t> common_carried; // by carried connection: every lane reads and writes the same slots
+			std::vector<uint32_t> carried_sources, carried_targets; // [carried * lanes + lane], as indices into activations
+			std::vector<double> carried_weights; // carried_weights[carried * lanes + lane]
+
+			std::vector<double> activations; // activations[slot * lanes + lane]
+			std::vector<double> sum;
+			std::shared_ptr<const JitPhenotype> jit; // for a compiled genome's group of its own
+			SharedCopies<1> shared_copies; // jit, for alloc_check
+			std::vector<uint8_t> retired; // by lane
+			uint32_t running; // lanes not retired
+
+			uint32_t lanes() const { return uint32_t(members.size()); }
+		};
+
+		uint32_t first, last;
+		uint32_t inputs, outputs;
+		std::vector<Group> groups;
+		std::vector<std::pair<uint32_t, uint32_t>> lane_of; // (group, lane) of each genome relative to first
+
+		void build(Group& g, const std::vector<Network>& population) const;
+		void calculate(Group& g, const double* inputs, double* outputs);
+		void calculate_nodes(Group& g); // the interpreted part of a timestep
+		void store_state(const Group& g, uint32_t lane, Network& net) const;
+	};
+}
@@ -1,6 +1,10 @@
 #include "system.h"
 #include "network.h"
 #include "xor_test.h"
+#include "checkpoint.h"
+#include "alloc_check.h"
+#include "island.h"
+#include "precision.h"
 
 #include <fstream>
 #include <string>
@@ -17,12 +21,27 @@ bool test(const short vk)
 }
 
 
-void run_NEAT(NEAT::System* sys, double converge, uint32_t sims, std::ostream* os, std::mutex* lock)
+// checkpoint_prefix: if not empty, the state at the start of each generation is saved to <prefix>.<generation>
+// steady: evolve in real time (System::steady_state), logging once per generation's worth of replacements
+void run_NEAT(NEAT::System* sys, double converge, uint32_t sims, std::ostream* os, std::mutex* lock, std::string checkpoint_prefix = "",
+	bool steady = false)
 {
 	lock->lock();
 	while (sys->get_max_fitness() < converge)
 	{
 		uint32_t gens = ((sys->get_generation()/5 + 1) < 5000) ? sys->get_generation() + 1 : 5000;
+		if (!checkpoint_prefix.empty()) {
+			std::ofstream checkpoint{ checkpoint_prefix + "." + std::to_string(sys->get_generation()) };
+			sys->save_checkpoint(checkpoint);
+		}
+		if (steady) {
+			// the population changes throughout, so the lock is held
+			sys->steady_state(sims, sys->get_size());
+			lock->unlock();
+			sys->log(*os);
+			lock->lock();
+			continue;
+		}
 		sys->simulate_multithread(sims);
 		lock->unlock();
 
@@ -37,20 +56,117 @@ void run_NEAT(NEAT::System* sys, double converge, uint32_t sims, std::ostream* o
 
 #if XOR_TEST == 0
 #include "cart_beam.h"
+#include "cart_beam_batch.h"
 #include "render.h"
 #include <SDL.h>
 
+// options:
+//   --seed <n>                         a seeded run, reproducible with any number of threads
+//   --checkpoint <prefix>              save a checkpoint at the start of every generation
+//   --replay <checkpoint> <generation> rerun a seeded run from a checkpoint up to generation, then carry on
+//   --steady-state                     real-time evolution, replacing a few genomes at a time rather than generations
+//   --batch-physics                    step every cart together with Cart_beam_batch
+//   --benchmark-physics <carts> <steps> time Cart_beam_system against Cart_beam_batch, then exit
+//   --measure-reproduction             build each generation's children again on one thread, logging the
+//                                      measured speedup rather than an estimate
+//   --precision <double|float32|fp16|int8> evaluate with weights and activations in that precision
+//   --compare-precision <steps>        evaluate the population, print how far the fittest genome drifts from
+//                                      double in each precision over steps timesteps on the cart, then exit
+//   --check-allocations                count the heap allocations per evaluation timestep, then exit
+//                                      (build with NEAT_COUNT_ALLOCATIONS defined)
+//   --islands <count> <ring|all-to-all> split the population into islands that trade their best genomes,
+//                                      and evolve them without rendering
 int main(int argc, char* argv[])
 {
 	try {
 		Cart_beam_system test;
 	
 		NEAT::System sys{ 500, 4, 1, 1 };
+		std::string checkpoint_prefix;
+		bool steady = false;
+		bool batch_physics = false;
+		bool check_allocations = false;
+		uint32_t compare_steps = 0;
+		uint32_t islands = 0;
+		NEAT::Islands::Topology topology = NEAT::Islands::Topology::ring;
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			if (arg == "--seed" && i + 1 < argc) sys.set_seed(std::stoull(argv[++i]));
+			else if (arg == "--steady-state") steady = true;
+			else if (arg == "--batch-physics") batch_physics = true;
+			else if (arg == "--check-allocations") check_allocations = true;
+			else if (arg == "--measure-reproduction") sys.set_measure_serial_reproduction(true);
+			else if (arg == "--precision" && i + 1 < argc) sys.set_precision(NEAT::parse_precision(argv[++i]));
+			else if (arg == "--compare-precision" && i + 1 < argc) compare_steps = std::stoul(argv[++i]);
+			else if (arg == "--benchmark-physics" && i + 2 < argc) {
+				benchmark_cart_beam(std::cout, std::stoul(argv[i + 1]), std::stoul(argv[i + 2]));
+				return 0;
+			}
+			else if (arg == "--islands" && i + 2 < argc) {
+				islands = std::stoul(argv[++i]);
+				const std::string name = argv[++i];
+				if (name == "all-to-all") topology = NEAT::Islands::Topology::all_to_all;
+				else if (name != "ring") throw std::runtime_error("Unknown island topology " + name);
+			}
+			else if (arg == "--checkpoint" && i + 1 < argc) checkpoint_prefix = argv[++i];
+			else if (arg == "--replay" && i + 2 < argc) {
+				std::ifstream checkpoint{ argv[i + 1] };
+				if (!checkpoint) throw std::runtime_error(std::string("Can't open checkpoint ") + argv[i + 1]);
+				Cart_beam_system replay_sim;
+				NEAT::initialise_system<Cart_beam_system>(sys, replay_sim);
+				NEAT::replay(sys, checkpoint, std::stoul(argv[i + 2]), 5000);
+				i += 2;
+			}
+			else throw std::runtime_error("Unknown option " + arg);
+		}
+
+		if (islands > 0) {
+			NEAT::Islands model{ islands, sys.get_size() / islands, 4, 1, 1 };
+			model.set_migration(5, 2, topology);
+			if (sys.is_seeded()) model.set_seed(sys.get_seed());
+			for (uint32_t i = 0; i < islands; ++i) {
+				NEAT::System& island = model.get_island(i);
+				if (batch_physics) island.init_simulators(std::make_shared<Cart_beam_batch>(island.get_size()));
+				else NEAT::initialise_system<Cart_beam_system>(island, test);
+			}
+			while (model.get_max_fitness() < 19000) {
+				model.evolve(5000);
+				model.log(std::cout);
+			}
+			return 0;
+		}
+
+		if (batch_physics) sys.init_simulators(std::make_shared<Cart_beam_batch>(sys.get_size()));
+		else NEAT::initialise_system<Cart_beam_system>(sys, test);
+
+		if (compare_steps > 0) {
+			// the fittest genome is compared from the state it was evaluated from
+			const std::vector<NEAT::Network> start = sys.get_population();
+			sys.simulate_population(compare_steps);
+			const std::vector<NEAT::Network>& population = sys.get_population();
+			const auto fittest = std::max_element(population.begin(), population.end(),
+				[](const NEAT::Network& a, const NEAT::Network& b) { return a.get_raw_fitness() < b.get_raw_fitness(); });
+			std::cout << NEAT::compare_precision(start[fittest - population.begin()], Cart_beam_system{}, compare_steps);
+			return 0;
+		}
+
+		if (check_allocations) {
+			if (!NEAT::counting_allocations()) throw std::runtime_error("--check-allocations needs a build with NEAT_COUNT_ALLOCATIONS defined");
+			NEAT::Network net = sys.get_population()[0];
+			// with outputs in [0, 1] no cart can reach the end of the rails within 100 steps
+			const NEAT::TimestepCounts single = NEAT::count_per_timestep(net, test, 50);
+			const NEAT::TimestepCounts lockstep = NEAT::count_per_timestep(sys, 50);
+			std::cout << "Allocations per timestep: " << single.allocations << " through Network::simulate, " << lockstep.allocations
+				<< " through System::simulate_population\n";
+			std::cout << "Atomic operations per timestep: " << single.atomic_operations << " through Network::simulate, "
+				<< lockstep.atomic_operations << " through System::simulate_population\n";
+			return single.allocations == 0 && lockstep.allocations == 0 && single.atomic_operations == 0 && lockstep.atomic_operations == 0 ? 0 : 1;
+		}
+
 		Game render{ "NEAT Cart Beam Testing", 100, 100, 800, 800, false, sys.get_population()[0]};
-		NEAT::initialise_system<Cart_beam_system>(sys, test);
 
 		std::mutex lock;
-		std::thread thread_test(run_NEAT, &sys, 19000, 5000, &std::cout, &lock);
+		std::thread thread_test(run_NEAT, &sys, 19000, 5000, &std::cout, &lock, checkpoint_prefix, steady);
 		
 		int frame_delay = 1000 / 60;
 		uint32_t frame_start = 0;
@@ -88,12 +204,11 @@ int main(int argc, char* argv[])
 #else
 int main() {
 	try {
-		XOR test;
 		NEAT::System xor_sys{ 500, 3, 1, 1 };
-		NEAT::initialise_system<XOR>(xor_sys, test);
+		xor_sys.init_dataset(std::make_shared<XOR>());
 
 		std::mutex lock;
-		std::thread xor_exec(run_NEAT, &xor_sys, 3.9999, 4, &std::cout, &lock);
+		std::thread xor_exec(run_NEAT, &xor_sys, 3.9999, 4, &std::cout, &lock, std::string{}, false);
 		xor_exec.join();
 
 		return 0;
@@ -2,9 +2,9 @@
 
 uint32_t NEAT::nodes_in_layer(const Network& net, uint32_t layer)
 {
-    return std::count_if(net.get_nodes().begin(),
-        net.get_nodes().end(),
-        [layer](const Network::Node& n) { return n.get_layer() == layer; });
+    const std::vector<uint32_t>& layer_start = net.get_layer_start();
+    if (layer + 1 >= layer_start.size()) return 0;
+    return layer_start[layer + 1] - layer_start[layer];
 }
 
 uint32_t NEAT::max_nodes_in_layer(const Network& net)
@@ -21,30 +21,25 @@ uint32_t NEAT::max_nodes_in_layer(const Network& net)
 SDL_Point NEAT::get_node_pos(SDL_Rect* rect, const Network& net, uint32_t node)
 {
     SDL_Point point;
-    auto nodeit = std::find_if(net.get_nodes().begin(),
-        net.get_nodes().end(),
-        [node](const Network::Node& n) { return n.get_node() == node; });
+    const std::vector<Network::Node>& nodes = net.get_nodes();
+    auto nodeit = std::lower_bound(nodes.begin(), nodes.end(), node,
+        [](const Network::Node& n, uint32_t node) { return n.get_node() < node; });
 
-    if (nodeit == net.get_nodes().end())
+    if (nodeit == nodes.end() || nodeit->get_node() != node)
         throw std::runtime_error("Invalid node passed to NEAT::get_node_pos");
 
-    Network::Node net_node = *nodeit;
+    const Network::Node& net_node = *nodeit;
 
-    std::vector<Network::Node> net_nodes = net.get_nodes();
-    std::sort(net_nodes.begin(), net_nodes.end(),
-        [](const Network::Node& a,
-            const Network::Node& b) { return a.get_node() < b.get_node(); });
+    // the node's place in its layer, from the network's node order
+    const std::vector<uint32_t>& order = net.get_node_order();
+    const uint32_t first_in_layer = net.get_layer_start()[net_node.get_layer()];
+    const int rank = int(std::find(order.begin() + first_in_layer, order.end(), uint32_t(nodeit - nodes.begin())) - order.begin() - first_in_layer);
 
-    uint32_t first_node_in_layer = std::find_if(net_nodes.begin(), net_nodes.end(),
-        [net_node](const Network::Node& n)
-        {return n.get_layer() == net_node.get_layer(); })->get_node();
-
-    uint32_t layer_num = nodes_in_layer(net, net_node.get_layer());
-    uint32_t layer_space = rect->h / max_nodes_in_layer(net);
+    const int layer_num = int(nodes_in_layer(net, net_node.get_layer()));
+    const int layer_space = rect->h / max_nodes_in_layer(net);
 
     point.x = rect->x + int(rect->w * (double(net_node.get_layer()) / net.get_max_layer()));
-    point.y = rect->h / 2 + (net_node.get_node() - first_node_in_layer - (layer_num + 1) / 2) *
-        layer_space + rect->y;
+    point.y = rect->h / 2 + (rank - (layer_num + 1) / 2) * layer_space + rect->y;
 
     return point;
 }
@@ -64,14 +59,16 @@ void NEAT::render_connection_weight(SDL_Renderer* ren, SDL_Rect* rect, const Net
     SDL_RenderDrawLine(ren, p1.x, p1.y, p2.x, p2.y);
 }
 
-void NEAT::render_connection_value(SDL_Renderer* ren, SDL_Rect* rect, const Network& net, const Connection& c)
+void NEAT::render_connection_value(SDL_Renderer* ren, SDL_Rect* rect, const Network& net, uint32_t gene)
 {
+    const Connection& c = net.get_genome()[gene];
+    const double value = net.get_state().gene(gene);
     SDL_Point p1 = get_node_pos(rect, net, c.node1);
     SDL_Point p2 = get_node_pos(rect, net, c.node2);
 
     // colour
-    int r = (c.value > 0) * 100 * c.value;
-    int b = -(c.value < 0) * 100 * c.value;
+    int r = (value > 0) * 100 * value;
+    int b = -(value < 0) * 100 * value;
     r = std::clamp(r, 0, 255);
     b = std::clamp(b, 0, 255);
     if (c.recursive) SDL_SetRenderDrawColor(ren, r, 100, b, 255);
@@ -94,7 +91,7 @@ void NEAT::render_network(SDL_Renderer* ren, SDL_Rect* rect, const Network& net)
         SDL_RenderFillRect(ren, &r);
     }
 
-    for (const auto& c : net.get_genome()) {
-        render_connection_value(ren, rect, net, c);
+    for (uint32_t gene = 0; gene < net.get_genome().size(); ++gene) {
+        render_connection_value(ren, rect, net, gene);
     }
 }
@@ -11,7 +11,8 @@ namespace NEAT {
 	SDL_Point get_node_pos(SDL_Rect*, const Network&, uint32_t node);
 
 	void render_connection_weight(SDL_Renderer*, SDL_Rect*, const Network&, const Connection&);
-	void render_connection_value(SDL_Renderer*, SDL_Rect*, const Network&, const Connection&);
+	// the value gene (a position in the genome) carried on the last timestep, from the network's state
+	void render_connection_value(SDL_Renderer*, SDL_Rect*, const Network&, uint32_t gene);
 	void render_network(SDL_Renderer*, SDL_Rect*, const Network&);
 	void render_fittest(SDL_Renderer*, SDL_Rect*, const System&);
 }
\ No newline at end of file
@@ -1,9 +1,16 @@
 #include "network.h"
+#include "jit.h"
+#include "species.h"
+#include "checkpoint.h"
+
+#include <atomic>
 
 namespace NEAT {
 	Network::Network(System& sys, uint32_t inputs, uint32_t outputs)
-		:inputs{ inputs }, outputs{ outputs }, fitness{}, species{}, nodes{}, output_data(outputs), max_layer{ 1 }, shared_fitness{ 0 }
+		:Network{ inputs + outputs, inputs, outputs }
 	{
+		std::vector<Connection>& genome = *genes;
+		std::vector<Node>& nodes = layout->nodes;
 		for (uint32_t inn = 0; inn < inputs; ++inn) {
 			for (uint32_t outn = 0; outn < outputs; ++outn) {
 				// constructor automatically initialises to weight 0.0
@@ -14,22 +21,21 @@ namespace NEAT {
 		}
 
 		for (uint32_t n = 0; n < inputs; ++n) {
-			nodes.emplace_back(Node{ n, 0, {} });
+			nodes.emplace_back(Node{ n, 0 });
 		}
 
-		std::vector<uint32_t> in_nodes(inputs); // the default inputs for the output nodes initialised below
-		for (uint32_t i = 0; i < inputs; ++i) in_nodes[i] = i;
-
 		for (uint32_t n = 0; n < outputs; ++n) {
-			nodes.emplace_back(Node{ n + inputs, 1, in_nodes });
+			nodes.emplace_back(Node{ n + inputs, 1 });
 		}
 
-		node_num = inputs + outputs;
+		finish_layers();
 	}
 
 	Network::Network(System& sys, uint32_t inputs, uint32_t outputs, double random_thresh)
-		:inputs{ inputs }, outputs{ outputs }, fitness{}, species{}, nodes{}, output_data(outputs), max_layer{ 1 }, shared_fitness{ 0 }
+		:Network{ inputs + outputs, inputs, outputs }
 	{
+		std::vector<Connection>& genome = *genes;
+		std::vector<Node>& nodes = layout->nodes;
 		for (uint32_t inn = 0; inn < inputs; ++inn) {
 			for (uint32_t outn = 0; outn < outputs; ++outn) {
 				uint32_t innov = genome.size();
@@ -39,56 +45,33 @@ namespace NEAT {
 		}
 
 		for (uint32_t n = 0; n < inputs; ++n) {
-			nodes.emplace_back(Node{ n, 0, {} });
+			nodes.emplace_back(Node{ n, 0 });
 		}
 
-		std::vector<uint32_t> in_nodes(inputs); // the default inputs for the output nodes initialised below
-		for (uint32_t i = 0; i < inputs; ++i) in_nodes[i] = i;
-
 		for (uint32_t n = 0; n < outputs; ++n) {
-			nodes.emplace_back(Node{ n + inputs, 1, in_nodes });
+			nodes.emplace_back(Node{ n + inputs, 1 });
 		}
 
-		node_num = inputs + outputs;
+		finish_layers();
 	}
 
 	bool Network::speciate(double c1, double c2, double c3, const std::vector<Connection>& rhs, double thresh) const
 	{
-		uint32_t max_innov_this = std::max_element(genome.begin(), genome.end())->innov_num;
-		uint32_t max_innov_rhs = std::max_element(rhs.begin(), rhs.end())->innov_num;
-
-		double weight_diff_sum = 0; // the sum of the weights
-		uint32_t match = 0;
-		uint32_t disjoint = 0;
-		uint32_t excess = 0;
-
-		for (uint32_t innov = 0; innov <= std::max(max_innov_this, max_innov_rhs); ++innov)
-		{
-			auto rhs_conn_iter = std::find_if(rhs.begin(), rhs.end(), [innov](const Connection& carg) {return (carg.innov_num == innov); });
-			auto this_conn_iter = std::find_if(genome.begin(), genome.end(), [innov](const Connection& carg) {return (carg.innov_num == innov); });
-			if (rhs_conn_iter != rhs.end() && this_conn_iter != genome.end()) // the gene is in both genomes
-			{
-				match++;
-				weight_diff_sum += std::abs(rhs_conn_iter->weight - this_conn_iter->weight);
-			}
-			else if (rhs_conn_iter == rhs.end() && this_conn_iter != genome.end()) // the gene is in this->genome but not rhs
-			{
-				if (this_conn_iter->innov_num < max_innov_rhs) disjoint++; // the gene in this->genome is within range of rhs
-				else excess++;
-			}
-			else if (rhs_conn_iter != rhs.end() && this_conn_iter == genome.end()) // the gene is in rhs but not in this->genome
-			{
-				if (rhs_conn_iter->innov_num < max_innov_this) disjoint++; // the gene in rhs->genome is within range of rhs
-				else excess++;
-			}
-		}
+		return compatibility_distance(GenomeKey{ *genes }, GenomeKey{ rhs }, c1, c2, c3) <= thresh;
+	}
+
+	thread_local Network::Scratch Network::scratch;
 
-		uint32_t max_size = std::max(genome.size(), rhs.size());
-		//uint32_t max_size = 1;
-		//if (max_size < 20) max_size = std::min(genome.size(), rhs.size());
-		double delta = c1 * (disjoint / double(max_size)) + c2 * (excess / double(max_size)) + c3 * (weight_diff_sum / match);
+	uint64_t Network::new_genome_id()
+	{
+		static std::atomic<uint64_t> next{ 0 };
+		return next++;
+	}
 
-		return (delta <= thresh);
+	void Network::insert_gene(const Connection& c)
+	{
+		std::vector<Connection>& genome = own_genes();
+		genome.insert(std::upper_bound(genome.begin(), genome.end(), c), c);
 	}
 
 	void Network::adjust_fitness(const System& sys)
@@ -103,63 +86,79 @@ namespace NEAT {
 			throw std::runtime_error("Incorrect input array size to NEAT::Network::calculate");
 		}
 
-		uint32_t working_layer = 0;
+		const std::vector<Connection>& genome = *genes;
+		const std::vector<Node>& nodes = layout->nodes;
+		const uint32_t max_layer = layout->max_layer;
+		const std::vector<uint32_t> index = node_positions();
+		const NodeLists incoming = incoming_genes(index);
+		State& values = prepare_state();
 
 		// initialise the neurons in layer zero (input layer)
 		// NB: caller is responsible for bias input
-		for (Node& n : nodes) {
-			if (n.get_layer() == 0 && n.get_node() < inputs) {
-				if (n.get_node() != inputs - 1)
-					n.set_value(input_data[n.get_node()]);
-
-				else n.set_value(1); // add the bias on at the end
+		for (uint32_t i = 0; i < nodes.size(); ++i) {
+			const uint32_t n = nodes[i].get_node();
+			if (nodes[i].get_layer() == 0 && n < inputs) {
+				if (n != inputs - 1) values.nodes[i] = input_data[n];
+				else values.nodes[i] = 1; // add the bias on at the end
 			}
 		}
 
 		// propagate forwards through the layers
+		uint32_t working_layer = 0;
 		while (working_layer <= max_layer) {
 			// update the connections that have inputs on the working layer
-			for (const Node& n : nodes) {
-				if (n.get_layer() == working_layer) {
-					for (Connection& c : genome) {
-						if (c.node1 == n.get_node()) c.update_value(n.get_value());
-					}
-				}
+			for (uint32_t g = 0; g < genome.size(); ++g) {
+				const uint32_t source = index[genome[g].node1];
+				if (nodes[source].get_layer() == working_layer) values.genes[g] = genome[g].weight * values.nodes[source];
 			}
 
 			// update neurons in the next layer
 			working_layer++;
-			// the previous for-loop only updates recursive connections on the last iteration - no more nodes to compute
+			// the previous loop only updates recursive connections on the last iteration - no more nodes to compute
 			if (working_layer <= max_layer) {
-				for (Node& n : nodes)
-				{
-					// since all the connections feeding in are updated,
-					// we can just give the node the vector of connections
-					// and it can update its value.
-					if (n.get_layer() == working_layer) n.calculate_value(genome);
+				for (uint32_t i = 0; i < nodes.size(); ++i) {
+					// all the connections feeding in are updated, so the node sums the enabled ones
+					if (nodes[i].get_layer() != working_layer) continue;
+					double sum = 0;
+					for (uint32_t g : incoming[i]) {
+						if (genome[g].enabled) sum += values.genes[g];
+					}
+					values.nodes[i] = activate(nodes[i].get_activation(), sum);
 				}
 			}
 		}
 
 		// collect the outputs
-		for (const Node& n : nodes) {
-			if (n.get_node() >= inputs && n.get_node() < inputs + outputs) { output_data[n.get_node() - inputs] = n.get_value(); }
+		for (uint32_t i = 0; i < nodes.size(); ++i) {
+			const uint32_t n = nodes[i].get_node();
+			if (n >= inputs && n < inputs + outputs) output_data[n - inputs] = values.nodes[i];
 		}
 
 		return output_data;
 	}
 
-	void Network::simulate(std::shared_ptr<Simulator> sim, uint32_t steps)
+	uint32_t Network::simulate(Simulator& sim, uint32_t steps, bool fast_activation)
 	{
-		for (uint32_t i = 0; i < steps; ++i) {
-			calculate(sim->get_inputs_to_network());
-			sim->update_with_network_output(output_data);
+		std::unique_ptr<const Phenotype> phenotype;
+		if (!jit) phenotype = std::make_unique<const Phenotype>(*this, fast_activation);
+		Evaluator evaluator = jit ? Evaluator{ *jit, *this } : Evaluator{ *phenotype, *this };
+
+		double* in = evaluator.input_buffer();
+		uint32_t step = 0;
+		for (; step < steps && !sim.is_terminal(); ++step) {
+			sim.write_inputs_to_network(in, inputs - 1);
+			sim.update_with_network_output(evaluator.calculate());
 		}
-		fitness = sim->get_fitness();
+		evaluator.store_state(*this);
+		fitness = sim.get_fitness();
+		return step;
 	}
 
 	void Network::mutate_add_node(System& sys)
 	{
+		genome_changed();
+		std::vector<Connection>& genome = own_genes();
+
 		// the index of the connection to split
 		uint32_t index = uint32_t(System::rand_dist(System::rand_gen) * genome.size());
 		if (index == genome.size()) index--;
@@ -179,20 +178,25 @@ namespace NEAT {
 		// if splitting a recursive connection which is around one node, the input connection should NOT be recursive
 		in.recursive = false;
 
-		genome.emplace_back(in);
-		genome.emplace_back(out);
+		genome[index].enabled = false;
+		const uint32_t node2 = genome[index].node2;
 
-		nodes.emplace_back(Node{ node_num, 0, {genome[index].node1} });
-		std::find_if(nodes.begin(), nodes.end(), [&](const Node& n) {return n.get_node() == genome[index].node2; })->add_input(node_num);
+		insert_gene(in);
+		insert_gene(out);
 
-		genome[index].enabled = false;
+		own_layout().nodes.emplace_back(Node{ node_num, 0 });
 		node_num++;
 
-		configure_layers();
+		// only the new node and the node at the end of the split connection have different back inputs
+		update_layers({ node_num - 1, node2 });
 	}
 
 	void Network::mutate_add_connection(System& sys, double err)
 	{
+		const std::vector<Connection>& genome = *genes;
+		const std::vector<Node>& nodes = layout->nodes;
+		const uint32_t max_layer = layout->max_layer;
+
 		// select random nodes to connect
 		const Node& n1 = nodes[random_int(nodes.size() - 1)];
 		const Node& n2 = nodes[random_int(nodes.size() - 1)];
@@ -210,18 +214,18 @@ namespace NEAT {
 		}
 		Connection c{ n1.get_node(), n2.get_node(), true, random(err), 0, recursive };
 		c.innov_num = sys.get_innov_number(c);
-		genome.push_back(c);
-
-		for (Node& n : nodes) {
-			if (n.get_node() == c.node2) n.add_input(c.node1);
-		}
+		genome_changed(); // only now, so that a failed attempt keeps the compiled code, state and distance cache entries
+		insert_gene(c); // n1 and n2 are still good: they are in the layout, not the genes
 
-		configure_layers();
+		if (!c.recursive) update_layers({ c.node2 }); // recursive connections don't affect the layers
 	}
 
 	void Network::mutate_weights(double mutate_uniform, double err)
 	{
-		for (Connection& c : genome) {
+		genome_changed();
+
+		// the layout is left shared
+		for (Connection& c : own_genes()) {
 			if (System::rand_dist(System::rand_gen) <= mutate_uniform) {
 				c.weight += random(err);
 			}
@@ -229,94 +233,169 @@ namespace NEAT {
 		}
 	}
 
+	void Network::mutate_activation()
+	{
+		if (layout->nodes.size() <= inputs) return;
+		jit.reset();
+
+		std::vector<Node>& nodes = own_layout().nodes;
+		Node& n = nodes[inputs + random_int(uint32_t(nodes.size()) - inputs)];
+		const uint32_t shift = 1 + random_int(activation_count - 1); // any activation but the current one
+		n.set_activation(Activation((uint32_t(n.get_activation()) + shift) % activation_count));
+	}
+
+	void Network::compile_jit(bool fast_activation)
+	{
+		if (jit && jit->get_phenotype().uses_fast_activation() == fast_activation) return;
+		if (!JitPhenotype::supported()) return;
+
+		auto compiled = std::make_shared<const JitPhenotype>(*this, fast_activation);
+		if (compiled->compiled()) jit = compiled;
+	}
+
 	Network Network::cross(const Network& rhs, double disable_thresh)
 	{
+		Network new_net{ 0, inputs, outputs };
+		cross(rhs, disable_thresh, new_net);
+		return new_net;
+	}
+
+	void Network::cross(const Network& rhs, double disable_thresh, Network& new_net)
+	{
+		const std::vector<Connection>& genome = *genes;
 		const std::vector<Connection>& genome_rhs = rhs.get_genome();
-		uint32_t max_innov = std::max(std::max_element(genome_rhs.begin(), genome_rhs.end())->innov_num,
-			std::max_element(genome.begin(), genome.end())->innov_num);
+		const bool rhs_fitter = rhs.get_shared_fitness() > shared_fitness;
 
-		//if (genome_rhs.size() > 4) __debugbreak();
+		new_net.reset(std::max(node_num, rhs.node_num), inputs, outputs);
+		std::vector<Connection>& new_genome = *new_net.genes;
+		new_genome.reserve(std::max(genome.size(), genome_rhs.size()));
 
-		const bool rhs_fitter = rhs.get_shared_fitness() > shared_fitness;
+		// both genomes are sorted by innovation number, so one merge pass lines up the matching genes
+		uint32_t i = 0, j = 0;
+		while (i < genome.size() || j < genome_rhs.size()) {
+			const bool in_this = i < genome.size() && (j == genome_rhs.size() || genome[i].innov_num <= genome_rhs[j].innov_num);
+			const bool in_rhs = j < genome_rhs.size() && (i == genome.size() || genome_rhs[j].innov_num <= genome[i].innov_num);
 
-		std::vector<Connection> new_genome;
-		for (uint32_t i = 0; i <= max_innov; ++i) {
 			// if the gene is disabled in either parent, this is whether we should enable it again
 			bool enabled = System::rand_dist(System::rand_gen) < (1 - disable_thresh);
 
-			std::vector<Connection>::const_iterator conn_this = std::find_if(genome.begin(), genome.end(), [&](const Connection& c) { return c.innov_num == i; });
-			std::vector<Connection>::const_iterator conn_rhs = std::find_if(genome_rhs.begin(), genome_rhs.end(), [&](const Connection& c) { return c.innov_num == i; });
-
-			if (conn_this != genome.end() && conn_rhs != genome_rhs.end()) { // both genes are present: choose a random one for the genome
-				if (System::rand_dist(System::rand_gen) < 0.5) new_genome.push_back(*conn_this);
-				else new_genome.push_back(*conn_rhs);
+			if (in_this && in_rhs) { // both genes are present: choose a random one for the genome
+				if (System::rand_dist(System::rand_gen) < 0.5) new_genome.push_back(genome[i]);
+				else new_genome.push_back(genome_rhs[j]);
 
-				if (!(conn_this->enabled) || !(conn_rhs->enabled)) { // the gene is disabled in one of the parents
-					new_genome[new_genome.size() - 1].enabled = enabled;
+				if (!(genome[i].enabled) || !(genome_rhs[j].enabled)) { // the gene is disabled in one of the parents
+					new_genome.back().enabled = enabled;
 				}
 			}
 			// disjoint / excess genes are only inherited from the fitter parent
-			else if (conn_this != genome.end() && !rhs_fitter) {
-				new_genome.push_back(*conn_this);
-				if (!new_genome[new_genome.size() - 1].enabled)
-					new_genome[new_genome.size() - 1].enabled = enabled;
+			else if (in_this && !rhs_fitter) {
+				new_genome.push_back(genome[i]);
+				if (!new_genome.back().enabled) new_genome.back().enabled = enabled;
 			}
-			else if (conn_rhs != genome_rhs.end() && rhs_fitter) {
-				new_genome.push_back(*conn_rhs);
-				if (!new_genome[new_genome.size() - 1].enabled)
-					new_genome[new_genome.size() - 1].enabled = enabled;
+			else if (in_rhs && rhs_fitter) {
+				new_genome.push_back(genome_rhs[j]);
+				if (!new_genome.back().enabled) new_genome.back().enabled = enabled;
 			}
+
+			if (in_this) i++;
+			if (in_rhs) j++;
 		}
 
-		Network new_net = derive_from_genome(new_genome, inputs, outputs);
+		new_net.derive_nodes();
 		new_net.species = species;
 
-		return new_net;
+		const Network& fitter = rhs_fitter ? rhs : *this;
+		const Network& other = rhs_fitter ? *this : rhs;
+		for (Node& n : new_net.layout->nodes) {
+			const Node* from = fitter.find_node(n.get_node());
+			if (!from) from = other.find_node(n.get_node());
+			if (from) n.set_activation(from->get_activation());
+		}
+	}
+
+	void Network::reset(uint32_t max_node, uint32_t new_inputs, uint32_t new_outputs)
+	{
+		// blocks still shared are left to the other networks, and moved from networks have none
+		count_atomic_operations(2);
+		if (genes.use_count() == 1) genes->clear();
+		else genes = std::make_shared<std::vector<Connection>>();
+		if (layout.use_count() == 1) {
+			layout->nodes.clear();
+			layout->node_order.clear();
+			layout->layer_start.clear();
+			layout->max_layer = 1;
+			layout->layering_cycle = false;
+		}
+		else layout = std::make_shared<Layout>();
+
+		state.nodes.clear();
+		state.genes.clear();
+		fitness = 0;
+		shared_fitness = 0;
+		species = 0;
+		inputs = new_inputs;
+		outputs = new_outputs;
+		node_num = max_node;
+		output_data.assign(outputs, 0.0);
+		jit.reset();
+		unchanged_generations = 0;
+		genome_id = new_genome_id();
 	}
 
 	Network Network::derive_from_genome(const std::vector<Connection>& genome, uint32_t inputs, uint32_t outputs)
 	{
-		std::vector<uint32_t> nodes_numbers;
-		for (const Connection& c : genome) {
-			if (std::find(nodes_numbers.begin(), nodes_numbers.end(), c.node1) == nodes_numbers.end())
-				nodes_numbers.push_back(c.node1);
+		uint32_t max_node = 0;
+		for (const Connection& c : genome) max_node = std::max(max_node, std::max(c.node1, c.node2) + 1);
 
-			if (std::find(nodes_numbers.begin(), nodes_numbers.end(), c.node2) == nodes_numbers.end())
-				nodes_numbers.push_back(c.node2);
-		}
+		Network new_net{ max_node, inputs, outputs };
+		*new_net.genes = genome;
+		std::sort(new_net.genes->begin(), new_net.genes->end());
+		new_net.derive_nodes();
 
-		std::vector<Node> new_nodes;
-		for (const uint32_t node_number : nodes_numbers) {
-			std::vector<uint32_t> inputs;
-			for (const Connection& c : genome) {
-				if (c.node2 == node_number) inputs.push_back(c.node1);
-			}
-			new_nodes.emplace_back(Node{ node_number, 0, inputs });
-		}
+		return new_net;
+	}
 
-		std::sort(new_nodes.begin(), new_nodes.end(), [](const Node& a, const Node& b) {return a.get_node() < b.get_node(); });
+	void Network::derive_nodes()
+	{
+		// node number -> position in nodes, for the nodes the genome refers to
+		std::vector<uint32_t>& index = scratch.index;
+		index.assign(node_num, missing_node);
+		for (const Connection& c : *genes) {
+			if (c.node1 >= node_num || c.node2 >= node_num) throw std::runtime_error("Connection to a node beyond NEAT::Network::node_num");
+			index[c.node1] = 0;
+			index[c.node2] = 0;
+		}
 
-		Network new_net{ *std::max_element(nodes_numbers.begin(), nodes_numbers.end()) + 1, inputs, outputs };
-		new_net.genome = genome;
-		new_net.nodes = new_nodes;
+		std::vector<Node>& nodes = own_layout().nodes;
+		nodes.clear();
+		for (uint32_t n = 0; n < node_num; ++n) {
+			if (index[n] == missing_node) continue;
+			index[n] = uint32_t(nodes.size());
+			nodes.emplace_back(Node{ n, 0 });
+		}
 
-		new_net.configure_layers();
+		// node_num is one more than the highest node present
+		if (!nodes.empty()) node_num = nodes.back().get_node() + 1;
 
-		return new_net;
+		configure_layers();
 	}
 
-	void Network::mutate(System& s, double node_mut, double conn_mut, double weight_mut, double mut_uniform, double err)
+	void Network::mutate(System& s, double node_mut, double conn_mut, double weight_mut, double mut_uniform, double err, double act_mut)
 	{
+		unchanged_generations = 0;
+
 		if (System::rand_dist(System::rand_gen) < weight_mut) mutate_weights(mut_uniform, err);
 		if (System::rand_dist(System::rand_gen) < conn_mut) mutate_add_connection(s, err);
 		if (System::rand_dist(System::rand_gen) < node_mut) mutate_add_node(s);
+		if (act_mut > 0 && System::rand_dist(System::rand_gen) < act_mut) mutate_activation();
 	}
 
 	std::ostream& Network::byte_genome_dump(std::ostream& os)
 	{
+		const std::vector<Connection>& genome = *genes;
 		std::cout << "Dumping network at " << this << " with fitness " << fitness << "...\n";
 		for (uint64_t i = 0; i < uint64_t(sizeof(Connection)) * genome.size(); ++i) {
-			os << reinterpret_cast<char*>(&genome[0])[i];
+			os << reinterpret_cast<const char*>(&genome[0])[i];
 		}
 		std::cout << "Done.\n";
 		return os;
@@ -338,69 +417,421 @@ namespace NEAT {
 		return is;
 	}
 
+	void Network::renumber_innovations(uint32_t first, const std::vector<uint32_t>& numbers)
+	{
+		bool renumbered = false;
+		for (const Connection& c : *genes) {
+			if (c.innov_num >= first) renumbered = true;
+		}
+		if (!renumbered) return;
+
+		std::vector<Connection>& genome = own_genes();
+		for (Connection& c : genome) {
+			if (c.innov_num < first) continue;
+			if (c.innov_num - first >= numbers.size()) throw std::runtime_error("Unknown provisional innovation in NEAT::Network::renumber_innovations");
+			c.innov_num = numbers[c.innov_num - first];
+		}
+		std::sort(genome.begin(), genome.end());
+		genome_changed();
+	}
+
+	void Network::save(std::ostream& os) const
+	{
+		const std::vector<Connection>& genome = *genes;
+		const std::vector<Node>& nodes = layout->nodes;
+		os << "network " << inputs << ' ' << outputs << ' ' << node_num << ' ' << species << ' '
+			<< unchanged_generations << ' ' << layout->layering_cycle << ' ';
+		checkpoint::write_double(os, fitness);
+		os << ' ';
+		checkpoint::write_double(os, shared_fitness);
+
+		os << "\ngenes " << genome.size() << '\n';
+		for (const Connection& c : genome) {
+			os << c.node1 << ' ' << c.node2 << ' ' << c.enabled << ' ' << c.recursive << ' ' << c.innov_num << ' ';
+			checkpoint::write_double(os, c.weight);
+			os << '\n';
+		}
+
+		os << "nodes " << nodes.size() << '\n';
+		for (const Node& n : nodes) {
+			os << n.get_node() << ' ' << n.get_layer() << ' ' << n.is_layered() << ' ' << uint32_t(n.get_activation()) << '\n';
+		}
+		save_state(os);
+	}
+
+	void Network::save_state(std::ostream& os) const
+	{
+		os << "state " << state.nodes.size() << ' ' << state.genes.size();
+		for (double v : state.nodes) {
+			os << ' ';
+			checkpoint::write_double(os, v);
+		}
+		for (double v : state.genes) {
+			os << ' ';
+			checkpoint::write_double(os, v);
+		}
+		os << '\n';
+	}
+
+	Network Network::load(std::istream& is)
+	{
+		checkpoint::expect(is, "network");
+		const uint32_t inputs = checkpoint::read<uint32_t>(is);
+		const uint32_t outputs = checkpoint::read<uint32_t>(is);
+		Network net{ checkpoint::read<uint32_t>(is), inputs, outputs };
+		net.species = checkpoint::read<uint32_t>(is);
+		net.unchanged_generations = checkpoint::read<uint32_t>(is);
+		const bool layering_cycle = checkpoint::read<bool>(is);
+		net.fitness = checkpoint::read_double(is);
+		net.shared_fitness = checkpoint::read_double(is);
+
+		checkpoint::expect(is, "genes");
+		std::vector<Connection>& genome = *net.genes;
+		genome.resize(checkpoint::read<size_t>(is), Connection{ 0, 0 });
+		for (Connection& c : genome) {
+			c.node1 = checkpoint::read<uint32_t>(is);
+			c.node2 = checkpoint::read<uint32_t>(is);
+			c.enabled = checkpoint::read<bool>(is);
+			c.recursive = checkpoint::read<bool>(is);
+			c.innov_num = checkpoint::read<uint32_t>(is);
+			c.weight = checkpoint::read_double(is);
+		}
+		if (!std::is_sorted(genome.begin(), genome.end())) throw std::runtime_error("Unsorted genome in NEAT::Network::load");
+
+		checkpoint::expect(is, "nodes");
+		std::vector<Node>& nodes = net.layout->nodes;
+		const size_t node_count = checkpoint::read<size_t>(is);
+		for (size_t i = 0; i < node_count; ++i) {
+			const uint32_t node = checkpoint::read<uint32_t>(is);
+			const uint32_t layer = checkpoint::read<uint32_t>(is);
+			const bool layered = checkpoint::read<bool>(is);
+			const uint32_t activation = checkpoint::read<uint32_t>(is);
+
+			if (activation >= activation_count) throw std::runtime_error("Unknown activation in NEAT::Network::load");
+			if (node >= net.node_num || (!nodes.empty() && node <= nodes.back().get_node())) {
+				throw std::runtime_error("Nodes out of order in NEAT::Network::load");
+			}
+
+			nodes.emplace_back(Node{ node, 0, Activation(activation) });
+			nodes.back().set_layer(layer);
+			if (!layered) nodes.back().clear_layered();
+		}
+
+		net.load_state(is);
+
+		// nodes that can't be layered keep the layers they were saved with, the rest get the same layers again
+		net.configure_layers();
+		net.layout->layering_cycle = layering_cycle;
+
+		return net;
+	}
+
+	void Network::load_state(std::istream& is)
+	{
+		checkpoint::expect(is, "state");
+		const size_t node_count = checkpoint::read<size_t>(is);
+		const size_t gene_count = checkpoint::read<size_t>(is);
+		if ((node_count != 0 && node_count != layout->nodes.size()) || (gene_count != 0 && gene_count != genes->size())) {
+			throw std::runtime_error("State doesn't fit the network in NEAT::Network::load_state");
+		}
+		state.nodes.resize(node_count);
+		state.genes.resize(gene_count);
+		for (double& v : state.nodes) v = checkpoint::read_double(is);
+		for (double& v : state.genes) v = checkpoint::read_double(is);
+	}
+
 	void Network::configure_layers()
 	{
-		std::vector<uint32_t> set(inputs); // the acceptible set of neurons that neurons in a given layer can have (non-recursive, enabled) connections to
-		std::vector<uint32_t> temp_set; // stores the nodes foud to be in a layer before they are added to the main set
-		for (uint32_t i = 0; i < inputs; ++i) { set[i] = i; }
-
-		uint32_t layer = 1;
-		bool sorting = true; // am I done configuring?
-
-		while (sorting) {
-			sorting = false;
-			for (Node& n : nodes)
-			{
-				if (n.get_node() >= inputs + outputs) {
-					n.update_back_inputs(genome);
-					if (is_subset(set, n.get_back_inputs()) && std::find(set.begin(), set.end(), n.get_node()) == set.end())
-					{
-						sorting = true;
-						n.set_layer(layer);
-						temp_set.push_back(n.get_node());
-					}
+		jit.reset();
+
+		std::vector<uint32_t>& index = scratch.index;
+		node_positions(index);
+		for (const Connection& c : *genes) {
+			if (c.node1 >= index.size() || c.node2 >= index.size() || index[c.node1] == missing_node || index[c.node2] == missing_node) {
+				throw std::runtime_error("Connection to a node missing from NEAT::Network");
+			}
+		}
+
+		const std::vector<Node>& nodes = own_layout().nodes;
+		std::vector<uint32_t>& hidden = scratch.subset;
+		hidden.clear();
+		for (uint32_t i = 0; i < nodes.size(); ++i) {
+			if (is_hidden(nodes[i].get_node())) hidden.push_back(i);
+		}
+
+		back_inputs(index, scratch.back);
+		hidden_successors(index, scratch.back, scratch.successors);
+		const bool cycle = layer_nodes(hidden, index, scratch.back, scratch.successors);
+		own_layout().layering_cycle = cycle;
+		finish_layers();
+	}
+
+	void Network::update_layers(const std::vector<uint32_t>& changed)
+	{
+		jit.reset();
+
+		std::vector<uint32_t>& index = scratch.index;
+		node_positions(index);
+		const NodeLists& back = scratch.back;
+		const NodeLists& successors = scratch.successors;
+		back_inputs(index, scratch.back);
+		hidden_successors(index, scratch.back, scratch.successors);
+
+		// the changed nodes and everything downstream of them. nodes outside this set keep their layers
+		std::vector<uint8_t>& affected = scratch.flags;
+		std::vector<uint32_t>& stack = scratch.queue;
+		std::vector<uint32_t>& visited = scratch.subset;
+		affected.assign(layout->nodes.size(), 0);
+		stack.clear();
+		visited.clear();
+		for (uint32_t n : changed) {
+			if (is_hidden(n) && !affected[index[n]]) {
+				affected[index[n]] = 1;
+				stack.push_back(index[n]);
+			}
+		}
+		while (!stack.empty()) {
+			const uint32_t i = stack.back();
+			stack.pop_back();
+			visited.push_back(i);
+			for (uint32_t next : successors[i]) {
+				if (!affected[next]) {
+					affected[next] = 1;
+					stack.push_back(next);
 				}
 			}
+		}
+
+		// mutations only add paths, so a cycle found before is still there
+		const bool cycle = layer_nodes(visited, index, back, successors);
+		own_layout().layering_cycle |= cycle;
+		finish_layers();
+
+#ifndef NDEBUG
+		check_layers();
+#endif
+	}
+
+	bool Network::layer_nodes(const std::vector<uint32_t>& subset, const std::vector<uint32_t>& index, const NodeLists& back,
+		const NodeLists& successors)
+	{
+		std::vector<Node>& nodes = own_layout().nodes;
+		std::vector<uint8_t>& in_subset = scratch.flags;
+		in_subset.assign(nodes.size(), 0);
+		for (uint32_t i : subset) in_subset[i] = 1;
+
+		// Kahn's algorithm over the subset. a node is layered once all of its back inputs are: a back input
+		// from an output node or an unlayered hidden node outside the subset blocks it for good, as does a
+		// cycle. blocked nodes keep their old layer
+		std::vector<uint32_t>& pending = scratch.pending;
+		std::vector<uint32_t>& ready = scratch.queue;
+		pending.assign(nodes.size(), 0);
+		ready.clear();
+		for (uint32_t i : subset) {
+			nodes[i].clear_layered();
+			bool blocked = false;
+			for (uint32_t in : back[i]) {
+				const uint32_t k = index[in];
+				if (in_subset[k]) pending[i]++;
+				else if (in >= inputs && !(is_hidden(in) && nodes[k].is_layered())) blocked = true;
+			}
+			if (blocked) pending[i]++; // never reaches zero
+			if (pending[i] == 0) ready.push_back(i);
+		}
+
+		// first in, first out so that a node is layered after every node it reads
+		for (uint32_t r = 0; r < ready.size(); ++r) {
+			const uint32_t i = ready[r];
+
+			uint32_t layer = 1;
+			for (uint32_t in : back[i]) {
+				layer = std::max(layer, nodes[index[in]].get_layer() + 1);
+			}
+			nodes[i].set_layer(layer);
+
+			for (uint32_t next : successors[i]) {
+				if (in_subset[next] && --pending[next] == 0) ready.push_back(next);
+			}
+		}
+
+		if (ready.size() == subset.size()) return false;
 
-			for (const uint32_t& i : temp_set) {
-				if (std::find(set.begin(), set.end(), i) == set.end()) set.push_back(i);
+		// some nodes were blocked. repeat among them alone, ignoring what blocked them from outside:
+		// whatever is still left is on (or downstream of) a cycle of non-recursive connections
+		std::vector<uint32_t>& left = scratch.left;
+		left.clear();
+		for (uint32_t i : subset) {
+			if (nodes[i].is_layered()) continue;
+			left.push_back(i);
+			pending[i] = 0;
+		}
+		for (uint32_t i : left) {
+			for (uint32_t in : back[i]) {
+				const uint32_t k = index[in];
+				if (in_subset[k] && !nodes[k].is_layered()) pending[i]++;
+			}
+		}
+
+		ready.clear();
+		for (uint32_t i : left) {
+			if (pending[i] == 0) ready.push_back(i);
+		}
+		for (uint32_t r = 0; r < ready.size(); ++r) {
+			for (uint32_t next : successors[ready[r]]) {
+				if (in_subset[next] && !nodes[next].is_layered() && --pending[next] == 0) ready.push_back(next);
 			}
+		}
+
+		return ready.size() != left.size();
+	}
 
-			temp_set.clear();
-			layer++;
+	void Network::finish_layers()
+	{
+		Layout& layers = own_layout();
+		std::vector<Node>& nodes = layers.nodes;
+		uint32_t& max_layer = layers.max_layer;
+		std::vector<uint32_t>& layer_start = layers.layer_start;
+		std::vector<uint32_t>& node_order = layers.node_order;
+
+		max_layer = 1;
+		uint32_t top = 1; // the highest layer of any node, including the old layers of unlayered nodes
+		for (const Node& n : nodes) {
+			if (is_hidden(n.get_node()) && n.is_layered()) max_layer = std::max(max_layer, n.get_layer() + 1);
+			top = std::max(top, n.get_layer());
 		}
+		top = std::max(top, max_layer);
 
 		// set up the output layer nodes to all have the same layer
-		for (Node& n : nodes)
-		{
-			if (n.get_node() >= inputs && n.get_node() < inputs + outputs) { n.set_layer(layer - 1); }
+		for (Node& n : nodes) {
+			if (n.get_node() >= inputs && n.get_node() < inputs + outputs) n.set_layer(max_layer);
 		}
 
-		max_layer = layer - 1;
+		// counting sort by layer, keeping nodes in node number order within a layer
+		layer_start.assign(top + 2, 0);
+		for (const Node& n : nodes) layer_start[n.get_layer() + 1]++;
+		for (uint32_t l = 1; l < layer_start.size(); ++l) layer_start[l] += layer_start[l - 1];
+
+		node_order.resize(nodes.size());
+		std::vector<uint32_t>& next = scratch.pending;
+		next.assign(layer_start.begin(), layer_start.end() - 1);
+		for (uint32_t i = 0; i < nodes.size(); ++i) node_order[next[nodes[i].get_layer()]++] = i;
 	}
-	void Network::Node::update_back_inputs(const std::vector<Connection>& genome)
+
+	std::vector<uint32_t> Network::node_positions() const
 	{
-		back_inputs.clear();
+		std::vector<uint32_t> index;
+		node_positions(index);
+		return index;
+	}
 
-		for (uint32_t in_node : input_nodes)
-		{
-			auto in_conn = std::find(genome.begin(), genome.end(), Connection{ in_node, node });
-			if (!in_conn->recursive && in_conn->enabled) {
-				back_inputs.push_back(in_node);
+	void Network::node_positions(std::vector<uint32_t>& index) const
+	{
+		const std::vector<Node>& nodes = layout->nodes;
+		index.assign(node_num, missing_node);
+		for (uint32_t i = 0; i < nodes.size(); ++i) {
+			const uint32_t n = nodes[i].get_node();
+			if (n >= node_num || index[n] != missing_node || (i > 0 && nodes[i - 1].get_node() > n)) {
+				throw std::runtime_error("Nodes out of order in NEAT::Network");
 			}
+			index[n] = i;
 		}
 	}
-	void Network::Node::calculate_value(const std::vector<Connection>& genome)
+
+	Network::NodeLists Network::incoming_genes(const std::vector<uint32_t>& index) const
+	{
+		const std::vector<Connection>& genome = *genes;
+		NodeLists incoming;
+		incoming.build(uint32_t(layout->nodes.size()), [&](auto add) {
+			for (uint32_t g = 0; g < genome.size(); ++g) add(index[genome[g].node2], g);
+		});
+		return incoming;
+	}
+
+	void Network::back_inputs(const std::vector<uint32_t>& index, NodeLists& back) const
 	{
-		double temp_val = 0;
-		for (uint32_t n : input_nodes)
-		{
-			auto conn = std::find(genome.begin(), genome.end(), Connection{ n, node });
-			if (conn->enabled) {
-				temp_val += conn->value;
+		back.build(uint32_t(layout->nodes.size()), [&](auto add) {
+			for (const Connection& c : *genes) {
+				if (c.enabled && !c.recursive && is_hidden(c.node2)) add(index[c.node2], c.node1);
 			}
-		}
+		});
+	}
+
+	void Network::hidden_successors(const std::vector<uint32_t>& index, const NodeLists& back, NodeLists& successors) const
+	{
+		const std::vector<Node>& nodes = layout->nodes;
+		successors.build(uint32_t(nodes.size()), [&](auto add) {
+			for (uint32_t i = 0; i < nodes.size(); ++i) {
+				if (!is_hidden(nodes[i].get_node())) continue;
+				for (uint32_t in : back[i]) add(index[in], i);
+			}
+		});
+	}
+
+	Network::State& Network::prepare_state()
+	{
+		state.nodes.resize(layout->nodes.size());
+		state.genes.resize(genes->size());
+		return state;
+	}
+
+	void Network::genome_changed()
+	{
+		jit.reset();
+		genome_id = new_genome_id();
+		state.nodes.clear();
+		state.genes.clear();
+	}
+
+	std::vector<Connection>& Network::own_genes()
+	{
+		count_atomic_operations(1);
+		if (genes.use_count() != 1) genes = std::make_shared<std::vector<Connection>>(*genes);
+		return *genes;
+	}
+
+	Network::Layout& Network::own_layout()
+	{
+		count_atomic_operations(1);
+		if (layout.use_count() != 1) layout = std::make_shared<Layout>(*layout);
+		return *layout;
+	}
+
+	size_t Network::memory_footprint() const
+	{
+		const size_t gene_bytes = sizeof(*genes) + genes->capacity() * sizeof(Connection);
+		const size_t layout_bytes = sizeof(Layout) + layout->nodes.capacity() * sizeof(Node)
+			+ (layout->node_order.capacity() + layout->layer_start.capacity()) * sizeof(uint32_t);
+
+		count_atomic_operations(2);
+		return sizeof(Network) + gene_bytes / genes.use_count() + layout_bytes / layout.use_count()
+			+ (state.nodes.capacity() + state.genes.capacity() + output_data.capacity()) * sizeof(double);
+	}
+
+	const Network::Node* Network::find_node(uint32_t n) const
+	{
+		const std::vector<Node>& nodes = layout->nodes;
+		auto it = std::lower_bound(nodes.begin(), nodes.end(), n, [](const Node& a, uint32_t b) { return a.get_node() < b; });
+		return it != nodes.end() && it->get_node() == n ? &*it : nullptr;
+	}
 
-		calculate(temp_val);
+	uint32_t Network::node_index(uint32_t n) const
+	{
+		const Node* node = find_node(n);
+		if (!node) throw std::runtime_error("Node missing from NEAT::Network");
+		return uint32_t(node - layout->nodes.data());
+	}
+
+	void Network::check_layers() const
+	{
+		Network full{ *this };
+		full.configure_layers();
+
+		const Layout& a = *full.layout;
+		const Layout& b = *layout;
+		bool same = a.max_layer == b.max_layer && a.layering_cycle == b.layering_cycle && a.node_order == b.node_order;
+		for (uint32_t i = 0; i < b.nodes.size(); ++i) {
+			same = same && a.nodes[i].get_layer() == b.nodes[i].get_layer() && a.nodes[i].is_layered() == b.nodes[i].is_layered();
+		}
+		if (!same) throw std::runtime_error("NEAT::Network::update_layers disagrees with configure_layers");
 	}
 }
@@ -8,12 +8,16 @@
 #include "system.h"
 #include "connection.h"
 #include "simulator.h"
+#include "phenotype.h"
+#include "alloc_check.h"
 
 namespace NEAT {
 	class System;
 	class Simulator;
+	class JitPhenotype;
 
 	double act_func(double);
+	float act_func(float);
 
 	class Network {
 	public:
@@ -28,11 +32,13 @@ namespace NEAT {
 		// c2: coeficcient for excess genes
 		// c3: coeficcient for weights
 		// thresh is the speciation threshold - delta_t in the 2002 paper
+		// (see compatibility_distance in species.h)
 		bool speciate(double c1, double c2, double c3, const std::vector<Connection>& rhs, double thresh) const;
 		void set_species(uint32_t new_species) { species = new_species; }
 
 		// the fitness before the adjustments according to explicit fitness sharing
 		double get_raw_fitness() const { return fitness; }
+		void set_fitness(double new_fitness) { fitness = new_fitness; }
 
 		// adjust fitness does fitness sharing and divides the raw fitness by the number of individuals
 		// in a species.
@@ -40,87 +46,183 @@ namespace NEAT {
 		double get_shared_fitness() const { return shared_fitness; }
 
 		// does what it says on the tin
-		const std::vector<Connection>& get_genome() const { return genome; }
+		// the genome is kept sorted by innovation number
+		const std::vector<Connection>& get_genome() const { return *genes; }
 		uint32_t get_species() const { return species; }
+
+		// changes whenever the genes do, so two networks with the same id have the same genome.
+		// copies share the id of the network they were copied from
+		uint64_t get_genome_id() const { return genome_id; }
 		const std::vector<double>& get_output() const { return output_data; }
-		uint32_t get_max_layer() const { return max_layer; }
+		uint32_t get_max_layer() const { return layout->max_layer; }
 
-		uint32_t get_hidden_nodes() const { return nodes.size() - inputs - outputs; }
+		uint32_t get_hidden_nodes() const { return layout->nodes.size() - inputs - outputs; }
 
-		// calculates by propagating the activations through the network using act_func at each node
-		const std::vector<double>& calculate(const std::vector<double>& inputs);
+		// indices into get_nodes() sorted by layer, and by node number within a layer.
+		// the nodes in layer l are node_order[layer_start[l]] up to node_order[layer_start[l + 1]]
+		const std::vector<uint32_t>& get_node_order() const { return layout->node_order; }
+		const std::vector<uint32_t>& get_layer_start() const { return layout->layer_start; }
 
-		// run the simulator for steps timesteps, and obtains fitness at the end of the run
-		void simulate(std::shared_ptr<Simulator> sim, uint32_t steps);
+		// whether the last layering found a cycle of non-recursive connections between hidden nodes
+		bool has_layering_cycle() const { return layout->layering_cycle; }
 
-		// performs crossover with rhs.
+		// calculates by propagating the activations through the network using each node's activation function
+		const std::vector<double>& calculate(const std::vector<double>& inputs);
+
+		// run the simulator for steps timesteps, or until it reports a terminal state, and obtains fitness at the
+		// end of the run. returns the timesteps run.
+		// the network is compiled into a Phenotype for the run, giving the same results as calculate.
+		// after that the timesteps allocate nothing: the simulator writes its inputs into the evaluator's
+		// buffer and reads the outputs from it
+		// fast_activation interprets with the polynomial activation kernels if the network isn't compiled
+		uint32_t simulate(Simulator& sim, uint32_t steps, bool fast_activation = false);
+
+		// compiles the network to native code (where supported) so that later simulations skip the interpreter.
+		// the code is shared between copies of the network and dropped when the genome changes.
+		// fast_activation selects the polynomial activation kernels (see activation.h)
+		void compile_jit(bool fast_activation = false);
+		bool is_jit_compiled() const { return jit != nullptr; }
+		std::shared_ptr<const JitPhenotype> get_jit() const { count_atomic_operations(1); return jit; }
+
+		// the number of generations the genome has been passed on unchanged as a species champion
+		uint32_t get_unchanged_generations() const { return unchanged_generations; }
+		void increment_unchanged_generations() { unchanged_generations++; }
+
+		// performs crossover with rhs in a single merge over the parents' genomes.
 		// matching genes are inherited randomly
 		// disjoint and excess genes are inherited from the fitter parent
 		// disable_thresh: the probability that an offspring gene will be disabled
 		// if it is disabled in either parent
+		// node activation functions are inherited from the fitter parent where it has the node
 		Network cross(const Network& rhs, double disable_thresh);
+
+		// the same, building the child in place of child (which must not be this network or rhs),
+		// so that the memory child holds is reused
+		void cross(const Network& rhs, double disable_thresh, Network& child);
 		static Network derive_from_genome(const std::vector<Connection>& genome, uint32_t, uint32_t);
 
 		// parameters are probabilities of their respective types of mutations occuring
-		void mutate(System& s, double node_mut, double conn_mut, double weight_mut, double mut_uniform, double err);
+		void mutate(System& s, double node_mut, double conn_mut, double weight_mut, double mut_uniform, double err, double act_mut = 0);
 
-		// this procedure recalcaultes the layers of the nodes after a topology mutation
-		// assumes layers are in vaild state (updated)
+		// this procedure recalcaultes the layers of the nodes after a topology mutation, in O(nodes + genes).
+		// a hidden node's layer is one more than the deepest node feeding it through a non-recursive, enabled
+		// connection. nodes fed that way by an output node or through a cycle can't be layered and keep
+		// their old layer. throws if the genome refers to nodes the network doesn't have
 		void configure_layers();
 
+		// recalculates the layers after the back inputs of the changed nodes have changed, only visiting
+		// them and the hidden nodes downstream of them. gives the same layers as configure_layers
+		void update_layers(const std::vector<uint32_t>& changed);
+
+		// gives the genes numbered first and up the numbers numbers[innov_num - first], keeping the genome sorted.
+		// used to replace the provisional numbers of an InnovationBatch
+		void renumber_innovations(uint32_t first, const std::vector<uint32_t>& numbers);
+
 		std::ostream& byte_genome_dump(std::ostream& os);
 		std::istream& byte_genome_read(std::istream& is);
 
-		class Node {
-		public:
-			Node(uint32_t node, uint8_t layer, const std::vector<uint32_t>& input_nodes)
-				:node{ node }, layer{ layer }, input_nodes{ input_nodes }, value{}, back_inputs{} {}
+		// the whole network, including its state and the layers of nodes that can't be layered, for a checkpoint
+		void save(std::ostream& os) const;
+		static Network load(std::istream& is);
 
-			void calculate(double input) { value = act_func(input); }
+		// the state alone, as save writes it, for returning a run's state to the network it was copied from
+		void save_state(std::ostream& os) const;
+		void load_state(std::istream& is);
 
-			void update_back_inputs(const std::vector<Connection>& genome);
-
-			void calculate_value(const std::vector<Connection>& genome);
+		// what a node is, without its value or its inputs: the value is runtime state (see State) and the
+		// inputs are the genes into it, in genome order
+		class Node {
+		public:
+			Node(uint32_t node, uint32_t layer, Activation activation = Activation::sigmoid)
+				:node{ node }, layer{ layer }, activation{ activation }, layered{ false } {}
 
-			double get_value() const { return value; }
 			uint32_t get_layer() const { return layer; }
 			uint32_t get_node() const { return node; }
-			const std::vector<uint32_t>& get_inputs() const { return input_nodes; }
-			const std::vector<uint32_t>& get_back_inputs() const { return back_inputs; }
+			Activation get_activation() const { return activation; }
+			bool is_layered() const { return layered; }
 
-			void set_layer(uint32_t new_layer) { layer = new_layer; }
-			void set_value(double new_value) { value = new_value; }
-			void add_input(uint32_t new_input) { input_nodes.push_back(new_input); }
+			void set_layer(uint32_t new_layer) { layer = new_layer; layered = true; }
+			void clear_layered() { layered = false; }
+			void set_activation(Activation new_activation) { activation = new_activation; }
 
 			bool operator==(const Node& n) const { return n.get_node() == node; }
 
 		private:
-			double value; // value after activation function
 			uint32_t node; // the index of the node in the Network's structure
 			uint32_t layer;
-			std::vector<uint32_t> input_nodes; // the nodes that the node is connected to for input
-			std::vector<uint32_t> back_inputs; // the nodes that input non-recursive, enabled connections into the node
+			Activation activation;
+			bool layered; // hidden nodes only: whether the last layering reached the node, if not it keeps its old layer
+		};
+
+		const std::vector<Node>& get_nodes() const { return layout->nodes; }
+
+		// The values a network carries from one timestep to the next, kept apart from the genome so that
+		// copying genes for crossover, culling and representatives doesn't copy them. Empty until the
+		// network is first run, and again once its genes change, which reads as every value being zero
+		struct State {
+			std::vector<double> nodes; // by position in get_nodes()
+			std::vector<double> genes; // by position in get_genome(): weight * the source node's value
+
+			double node(uint32_t i) const { return i < nodes.size() ? nodes[i] : 0; }
+			double gene(uint32_t g) const { return g < genes.size() ? genes[g] : 0; }
 		};
+		const State& get_state() const { return state; }
 
-		const std::vector<Node>& get_nodes() const { return nodes; }
+		// the bytes held by the network: the object itself and everything it allocates, with each
+		// shared block divided evenly between the networks sharing it
+		size_t memory_footprint() const;
 
 	private:
+		friend class Phenotype;
+		friend class Evaluator;
+		friend class BatchEvaluator;
+		friend class LockstepEvaluator;
+		template <typename, typename> friend class PrecisionEvaluator;
+
 		Network(uint32_t max_node, uint32_t inputs, uint32_t outputs)
-			:fitness{}, shared_fitness{}, species{}, max_layer{ 1 }, inputs{ inputs }, outputs{ outputs }, node_num{ max_node },
-		output_data(outputs) {}
+			:genes{ std::make_shared<std::vector<Connection>>() }, layout{ std::make_shared<Layout>() }, fitness{}, shared_fitness{},
+		species{}, inputs{ inputs }, outputs{ outputs }, node_num{ max_node }, output_data(outputs), unchanged_generations{},
+		genome_id{ new_genome_id() } {}
+
+		// the nodes and their layers, which only change with the topology
+		struct Layout {
+			std::vector<Node> nodes; // sorted by node number
+			std::vector<uint32_t> node_order;
+			std::vector<uint32_t> layer_start;
+			uint32_t max_layer = 1; // the layer number of the output nodes
+			bool layering_cycle = false;
+		};
 
-		std::vector<Connection> genome;
-		std::vector<Node> nodes;
+		// Copies of a network share its genes and layout until one of them writes to them (copy on write),
+		// so plain copies, champions and species representatives cost a few pointers. A weight mutation
+		// takes its own genes but keeps sharing the layout. Only change them through own_genes and own_layout
+		std::shared_ptr<std::vector<Connection>> genes;
+		std::shared_ptr<Layout> layout;
+		State state;
 
 		double fitness;
 		double shared_fitness;
 		uint32_t species;
 		uint32_t inputs, outputs;
 		uint32_t node_num; // one more than the maximum node number in the network
-		uint32_t max_layer; // the layer number of the output nodes
 
 		std::vector<double> output_data;
 
+		std::shared_ptr<const JitPhenotype> jit; // null unless compile_jit has been called since the last change
+		uint32_t unchanged_generations;
+		SharedCopies<3> shared_copies; // genes, layout and jit, for alloc_check
+
+		uint64_t genome_id;
+		static uint64_t new_genome_id(); // unique across threads
+
+		// the genes or layout for writing, copied first if another network shares them
+		std::vector<Connection>& own_genes();
+		Layout& own_layout();
+
+		// starts again as a network with no genes or nodes, as the private constructor makes,
+		// keeping the memory already held
+		void reset(uint32_t max_node, uint32_t new_inputs, uint32_t new_outputs);
+
 		// mutate_uniform: the probability that a given weight will be mutated by adding to its original value
 		// if not, it is assigned a new random value
 		// err is the maximum value either side of zero
@@ -133,5 +235,85 @@ namespace NEAT {
 		// attempts to connect 2 previously unconnected nodes
 		void mutate_add_connection(System& sys, double err);
 
+		// gives a random hidden or output node a different activation function
+		void mutate_activation();
+
+		// adds c to the genome in innovation number order
+		void insert_gene(const Connection& c);
+
+		// builds the nodes and their inputs from the (sorted) genome, then layers them
+		void derive_nodes();
+
+		// the position of node number n in nodes, which is kept sorted by node number
+		uint32_t node_index(uint32_t n) const;
+		const Node* find_node(uint32_t n) const; // null if the network doesn't have the node
+		static constexpr uint32_t missing_node = UINT32_MAX;
+		std::vector<uint32_t> node_positions() const; // node number -> position, or missing_node
+		void node_positions(std::vector<uint32_t>& index) const;
+
+		// a list per node, stored contiguously: the list of nodes[i] is items[start[i]] up to items[start[i + 1]]
+		struct NodeLists {
+			struct List {
+				const uint32_t* first;
+				const uint32_t* last;
+				const uint32_t* begin() const { return first; }
+				const uint32_t* end() const { return last; }
+			};
+			List operator[](uint32_t i) const { return List{ items.data() + start[i], items.data() + start[i + 1] }; }
+
+			// a counting sort: each(add) must call add(list, item) for every item, in the same order both
+			// times it is run, and the items keep that order within their lists. reuses the memory held
+			template <typename Each>
+			void build(uint32_t lists, Each each)
+			{
+				start.assign(lists + 1, 0);
+				each([&](uint32_t list, uint32_t) { start[list + 1]++; });
+				for (uint32_t i = 1; i <= lists; ++i) start[i] += start[i - 1];
+
+				items.resize(start[lists]);
+				each([&](uint32_t list, uint32_t item) { items[start[list]++] = item; });
+				for (uint32_t i = lists; i > 0; --i) start[i] = start[i - 1];
+				start[0] = 0;
+			}
+
+			std::vector<uint32_t> start, items;
+		};
+
+		// the genome positions of the genes into each node, in genome order
+		NodeLists incoming_genes(const std::vector<uint32_t>& index) const;
+
+		// for each hidden node, the nodes that input non-recursive, enabled connections into it
+		void back_inputs(const std::vector<uint32_t>& index, NodeLists& back) const;
+
+		// for each node, the hidden nodes it feeds through non-recursive, enabled connections
+		void hidden_successors(const std::vector<uint32_t>& index, const NodeLists& back, NodeLists& successors) const;
+
+		// layers subset, which must hold every hidden node downstream of its members, with Kahn's algorithm.
+		// returns whether part of it is stuck on a cycle
+		bool layer_nodes(const std::vector<uint32_t>& subset, const std::vector<uint32_t>& index, const NodeLists& back,
+			const NodeLists& successors);
+
+		// the working memory of derive_nodes and the layering, one per thread, so that building a child
+		// doesn't allocate once it has grown. check_layers lays out a copy with it, so it runs last
+		struct Scratch {
+			std::vector<uint32_t> index, subset, pending, queue, left;
+			std::vector<uint8_t> flags;
+			NodeLists back, successors;
+		};
+		static thread_local Scratch scratch;
+
+		// state sized for the current genome, for an evaluator to write back into
+		State& prepare_state();
+
+		// after any change to the genes: drops the compiled code and the state and takes a new genome id
+		void genome_changed();
+
+		// sets max_layer and the output layers, and orders the nodes
+		void finish_layers();
+		bool is_hidden(uint32_t n) const { return n >= inputs + outputs; }
+
+		// debug builds compare the incremental layers against a full configure_layers
+		void check_layers() const;
+
 	};
 }
\ No newline at end of file
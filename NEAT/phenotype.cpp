@@ -0,0 +1,270 @@
+#include "phenotype.h"
+#include "network.h"
+#include "simd.h"
+#include "jit.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace NEAT {
+	Phenotype::Phenotype(const Network& net, bool fast_activation)
+		:inputs{ net.inputs }, outputs{ net.outputs }, node_count{ uint32_t(net.get_nodes().size()) }, max_run{},
+		fast_activation{ fast_activation }, refreshed{}
+	{
+		const std::vector<Network::Node>& nodes = net.get_nodes();
+		const std::vector<Connection>& genome = net.get_genome();
+		const uint32_t invalid = Network::missing_node;
+		const std::vector<uint32_t> slot_of = net.node_positions(); // node number -> slot
+
+		input_slots.resize(inputs);
+		output_slots.resize(outputs);
+		for (uint32_t n = 0; n < inputs + outputs; ++n) {
+			if (n >= slot_of.size() || slot_of[n] == invalid) {
+				throw std::runtime_error("Missing input or output node in NEAT::Phenotype");
+			}
+			if (n < inputs) input_slots[n] = slot_of[n];
+			else output_slots[n - inputs] = slot_of[n];
+		}
+
+		const Network::NodeLists incoming = net.incoming_genes(slot_of);
+
+		// nodes in the layered range are evaluated once per timestep, in layer order.
+		// nodes in one layer never read each other's values this timestep, so they can be grouped by activation
+		const uint32_t max_layer = net.get_max_layer();
+		const std::vector<uint32_t>& order = net.get_node_order();
+		const std::vector<uint32_t>& layer_start = net.get_layer_start();
+		for (uint32_t l = 1; l <= max_layer; ++l) {
+			const size_t first = compute_slots.size();
+			compute_slots.insert(compute_slots.end(), order.begin() + layer_start[l], order.begin() + layer_start[l + 1]);
+			std::stable_sort(compute_slots.begin() + first, compute_slots.end(),
+				[&](uint32_t a, uint32_t b) { return nodes[a].get_activation() < nodes[b].get_activation(); });
+		}
+
+		for (uint32_t i = 0; i < compute_slots.size(); ++i) {
+			const Network::Node& n = nodes[compute_slots[i]];
+			row_activations.push_back(n.get_activation());
+			if (runs.empty() || runs.back().activation != n.get_activation() || nodes[compute_slots[runs.back().first]].get_layer() != n.get_layer()) {
+				runs.push_back(Run{ i, i, n.get_activation() });
+			}
+			runs.back().last = i + 1;
+			max_run = std::max(max_run, runs.back().last - runs.back().first);
+		}
+
+		// connections out of nodes beyond max_layer are never refreshed: keep them after the rest
+		std::vector<uint32_t> frozen_sources;
+		std::vector<uint32_t> frozen_genes;
+		std::vector<std::pair<uint32_t, uint32_t>> carried_edges; // (index into sources, carried index)
+		std::vector<std::pair<uint32_t, uint32_t>> frozen_edges;
+
+		row_start.push_back(0);
+		for (uint32_t slot : compute_slots) {
+			const Network::Node& n = nodes[slot];
+			for (uint32_t gene : incoming[slot]) {
+				const Connection& c = genome[gene];
+				if (!c.enabled) continue;
+
+				const uint32_t source = slot_of[c.node1];
+				const uint32_t source_layer = nodes[source].get_layer();
+				if (source_layer > max_layer) {
+					frozen_edges.emplace_back(uint32_t(sources.size()), uint32_t(frozen_genes.size()));
+					frozen_sources.push_back(source);
+					frozen_genes.push_back(gene);
+					sources.push_back(0);
+					weights.push_back(1.0);
+				}
+				else if (source_layer >= n.get_layer()) {
+					carried_edges.emplace_back(uint32_t(sources.size()), uint32_t(carried_sources.size()));
+					carried_sources.push_back(source);
+					carried_weights.push_back(c.weight);
+					carried_genes.push_back(gene);
+					sources.push_back(0);
+					weights.push_back(1.0);
+				}
+				else {
+					sources.push_back(source);
+					weights.push_back(c.weight);
+				}
+			}
+			row_start.push_back(uint32_t(sources.size()));
+		}
+
+		refreshed = uint32_t(carried_sources.size());
+		for (const auto& e : carried_edges) sources[e.first] = node_count + e.second;
+		for (const auto& e : frozen_edges) sources[e.first] = node_count + refreshed + e.second;
+		for (uint32_t i = 0; i < frozen_genes.size(); ++i) {
+			carried_sources.push_back(frozen_sources[i]);
+			carried_weights.push_back(1.0);
+			carried_genes.push_back(frozen_genes[i]);
+		}
+
+		for (uint32_t g = 0; g < genome.size(); ++g) {
+			const uint32_t n1 = genome[g].node1;
+			if (n1 < slot_of.size() && slot_of[n1] != invalid && nodes[slot_of[n1]].get_layer() <= max_layer) {
+				live_genes.push_back(g);
+				live_gene_sources.push_back(slot_of[n1]);
+			}
+		}
+	}
+
+	Evaluator::Evaluator(const Phenotype& phenotype)
+		:phenotype{ phenotype }, jit{ nullptr }, activations(phenotype.get_activation_count()), sums(phenotype.max_run),
+		output_data(phenotype.outputs)
+	{
+		for (uint32_t i = 0; i < phenotype.inputs - 1; ++i) {
+			if (phenotype.input_slots[i] != i) {
+				staged.resize(phenotype.inputs - 1);
+				break;
+			}
+		}
+	}
+
+	Evaluator::Evaluator(const Phenotype& phenotype, const Network& net)
+		:Evaluator{ phenotype }
+	{
+		for (uint32_t i = 0; i < phenotype.node_count; ++i) {
+			activations[i] = net.state.node(i);
+		}
+		for (uint32_t k = 0; k < phenotype.carried_genes.size(); ++k) {
+			activations[phenotype.node_count + k] = net.state.gene(phenotype.carried_genes[k]);
+		}
+	}
+
+	Evaluator::Evaluator(const JitPhenotype& jit, const Network& net)
+		:Evaluator{ jit.get_phenotype(), net }
+	{
+		if (jit.compiled()) this->jit = &jit;
+	}
+
+	const std::vector<double>& Evaluator::calculate(const std::vector<double>& input_data)
+	{
+		const Phenotype& p = phenotype;
+		if (input_data.size() != p.inputs - 1) {
+			throw std::runtime_error("Incorrect input array size to NEAT::Evaluator::calculate");
+		}
+
+		double* act = activations.data();
+		for (uint32_t i = 0; i < p.inputs - 1; ++i) act[p.input_slots[i]] = input_data[i];
+		return calculate_step();
+	}
+
+	const std::vector<double>& Evaluator::calculate()
+	{
+		const Phenotype& p = phenotype;
+		double* act = activations.data();
+		if (!staged.empty()) {
+			for (uint32_t i = 0; i < p.inputs - 1; ++i) act[p.input_slots[i]] = staged[i];
+		}
+		return calculate_step();
+	}
+
+	const std::vector<double>& Evaluator::calculate_step()
+	{
+		const Phenotype& p = phenotype;
+		double* act = activations.data();
+		act[p.input_slots[p.inputs - 1]] = 1; // bias
+
+		if (jit) {
+			jit->run(act);
+		}
+		else {
+			const uint32_t* row = p.row_start.data();
+			const uint32_t* src = p.sources.data();
+			const double* w = p.weights.data();
+			for (const Phenotype::Run& run : p.runs) {
+				for (uint32_t i = run.first; i < run.last; ++i) {
+					// same summation order as Network::Node::calculate_value
+					double sum = 0;
+					for (uint32_t e = row[i]; e < row[i + 1]; ++e) {
+						sum += w[e] * act[src[e]];
+					}
+					sums[i - run.first] = sum;
+				}
+
+				p.activate(run.activation, sums.data(), sums.data(), run.last - run.first);
+				for (uint32_t i = run.first; i < run.last; ++i) act[p.compute_slots[i]] = sums[i - run.first];
+			}
+
+			// recursive connections see this timestep's values on the next timestep
+			double* carried = act + p.node_count;
+			for (uint32_t k = 0; k < p.refreshed; ++k) {
+				carried[k] = p.carried_weights[k] * act[p.carried_sources[k]];
+			}
+		}
+
+		for (uint32_t o = 0; o < p.outputs; ++o) output_data[o] = act[p.output_slots[o]];
+
+		return output_data;
+	}
+
+	void Evaluator::store_state(Network& net) const
+	{
+		const Phenotype& p = phenotype;
+		Network::State& state = net.prepare_state();
+		for (uint32_t i = 0; i < p.node_count; ++i) {
+			state.nodes[i] = activations[i];
+		}
+		for (uint32_t k = 0; k < p.live_genes.size(); ++k) {
+			const uint32_t g = p.live_genes[k];
+			state.genes[g] = net.get_genome()[g].weight * activations[p.live_gene_sources[k]];
+		}
+		net.output_data = output_data;
+	}
+
+	BatchEvaluator::BatchEvaluator(const Phenotype& phenotype, uint32_t rows)
+		:phenotype{ phenotype }, rows{ rows }, stride{ (rows + simd::lanes() - 1) / simd::lanes() * simd::lanes() },
+		activations(size_t(phenotype.get_activation_count()) * stride), sum(stride), output_data(size_t(rows) * phenotype.outputs) {}
+
+	BatchEvaluator::BatchEvaluator(const Phenotype& phenotype, uint32_t rows, const Network& net)
+		:BatchEvaluator{ phenotype, rows }
+	{
+		for (uint32_t i = 0; i < phenotype.node_count; ++i) {
+			std::fill_n(&activations[size_t(i) * stride], stride, net.state.node(i));
+		}
+		for (uint32_t k = 0; k < phenotype.carried_genes.size(); ++k) {
+			std::fill_n(&activations[size_t(phenotype.node_count + k) * stride], stride, net.state.gene(phenotype.carried_genes[k]));
+		}
+	}
+
+	void BatchEvaluator::calculate(const double* input_data, double* outputs)
+	{
+		const Phenotype& p = phenotype;
+		double* act = activations.data();
+		const uint32_t in_width = p.inputs - 1;
+
+		for (uint32_t i = 0; i < in_width; ++i) {
+			double* slot = act + size_t(p.input_slots[i]) * stride;
+			for (uint32_t r = 0; r < rows; ++r) slot[r] = input_data[size_t(r) * in_width + i];
+		}
+		std::fill_n(act + size_t(p.input_slots[in_width]) * stride, stride, 1.0); // bias
+
+		for (uint32_t i = 0; i < p.compute_slots.size(); ++i) {
+			std::fill(sum.begin(), sum.end(), 0.0);
+			for (uint32_t e = p.row_start[i]; e < p.row_start[i + 1]; ++e) {
+				simd::multiply_add(sum.data(), act + size_t(p.sources[e]) * stride, p.weights[e], stride);
+			}
+
+			double* slot = act + size_t(p.compute_slots[i]) * stride;
+			p.activate(p.row_activations[i], sum.data(), slot, stride);
+		}
+
+		for (uint32_t k = 0; k < p.refreshed; ++k) {
+			simd::multiply(act + size_t(p.node_count + k) * stride, act + size_t(p.carried_sources[k]) * stride,
+				p.carried_weights[k], stride);
+		}
+
+		for (uint32_t o = 0; o < p.outputs; ++o) {
+			const double* slot = act + size_t(p.output_slots[o]) * stride;
+			for (uint32_t r = 0; r < rows; ++r) outputs[size_t(r) * p.outputs + o] = slot[r];
+		}
+	}
+
+	const std::vector<double>& BatchEvaluator::calculate(const std::vector<double>& input_data)
+	{
+		if (input_data.size() != size_t(rows) * (phenotype.inputs - 1)) {
+			throw std::runtime_error("Incorrect input array size to NEAT::BatchEvaluator::calculate");
+		}
+
+		calculate(input_data.data(), output_data.data());
+		return output_data;
+	}
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+#include "activation.h"
+
+namespace NEAT {
+	class Network;
+	class JitPhenotype;
+
+	// A network compiled into a flat evaluation plan.
+	// Computed nodes are listed in layer order and their incoming enabled connections are stored
+	// contiguously (CSR style), so a timestep costs O(enabled connections) rather than the
+	// O(layers * nodes * genes) of Network::calculate.
+	//
+	// The activation array used by an Evaluator holds one slot per node (in the order of
+	// Network::get_nodes()) followed by one slot per "carried" connection. A carried connection
+	// is one whose value is read before its source node has been updated in the current timestep
+	// (recursive connections, or connections from nodes outside the layered range), so it holds
+	// weight * source value from the previous timestep, exactly as the network's gene state does.
+	//
+	// Within a layer, nodes are ordered by activation function so that each run of nodes sharing one
+	// is activated together over an array. With fast_activation the runs use the SIMD polynomial
+	// kernels from activation.h instead of the standard library, which is no longer bit-identical.
+	class Phenotype {
+	public:
+		explicit Phenotype(const Network& net, bool fast_activation = false);
+
+		uint32_t get_inputs() const { return inputs; }
+		uint32_t get_outputs() const { return outputs; }
+		uint32_t get_node_count() const { return node_count; }
+		uint32_t get_connection_count() const { return uint32_t(sources.size()); }
+
+		// the size of the activation array an Evaluator needs (node slots + carried slots)
+		uint32_t get_activation_count() const { return node_count + uint32_t(carried_sources.size()); }
+
+		bool uses_fast_activation() const { return fast_activation; }
+		void activate(Activation a, const double* in, double* out, uint32_t n) const {
+			if (fast_activation) activate_fast(a, in, out, n);
+			else NEAT::activate(a, in, out, n);
+		}
+
+	private:
+		friend class Evaluator;
+		friend class BatchEvaluator;
+		friend class LockstepEvaluator;
+		friend class JitPhenotype;
+		template <typename, typename> friend class PrecisionEvaluator;
+
+		uint32_t inputs, outputs; // number of input nodes and output nodes including bias
+		uint32_t node_count;
+
+		std::vector<uint32_t> input_slots; // the slot of each input node, bias last
+		std::vector<uint32_t> output_slots;
+
+		// computed nodes in evaluation order, with their incoming connections in [row_start[i], row_start[i + 1])
+		std::vector<uint32_t> compute_slots;
+		std::vector<uint32_t> row_start;
+		std::vector<uint32_t> sources; // activation slots to read from
+		std::vector<double> weights; // 1.0 for carried connections, which already hold weight * value
+		std::vector<Activation> row_activations;
+
+		// consecutive computed nodes in one layer with the same activation function
+		struct Run {
+			uint32_t first, last;
+			Activation activation;
+		};
+		std::vector<Run> runs;
+		uint32_t max_run;
+		bool fast_activation;
+
+		// carried connections: the first `refreshed` are updated at the end of each timestep,
+		// the rest come from nodes that are never evaluated and so keep their value
+		std::vector<uint32_t> carried_sources;
+		std::vector<double> carried_weights;
+		std::vector<uint32_t> carried_genes; // index into the genome, used to load and store state
+		uint32_t refreshed;
+
+		// the genome index of every connection whose source node is evaluated or an input,
+		// so that the gene state can be written back after a run
+		std::vector<uint32_t> live_genes;
+		std::vector<uint32_t> live_gene_sources;
+	};
+
+	// Runs a Phenotype. Holds all of the per-run activation state, so one Phenotype can be shared
+	// by many Evaluators. Outputs are bit-identical to Network::calculate on the same network.
+	class Evaluator {
+	public:
+		// starts from the state of a freshly constructed network (all values zero)
+		explicit Evaluator(const Phenotype& phenotype);
+
+		// starts from the node and connection values currently held by net,
+		// which must be the network the phenotype was compiled from
+		Evaluator(const Phenotype& phenotype, const Network& net);
+
+		// as above, but each timestep runs the natively compiled code when it is available
+		Evaluator(const JitPhenotype& jit, const Network& net);
+
+		// NB: as with Network::calculate, the caller does not provide the bias input
+		const std::vector<double>& calculate(const std::vector<double>& inputs);
+		const std::vector<double>& get_output() const { return output_data; }
+
+		// the allocation-free path: the caller writes the inputs (without the bias) into input_buffer(), then
+		// runs a timestep with calculate(). the buffer is the input nodes' own activations when they occupy the
+		// first slots, as they do in any network with its nodes in order, so nothing is copied
+		double* input_buffer() { return staged.empty() ? activations.data() : staged.data(); }
+		const std::vector<double>& calculate();
+
+		// writes the node and connection values back into net, leaving it in the same state
+		// as if every timestep had been run through Network::calculate
+		void store_state(Network& net) const;
+
+	private:
+		const Phenotype& phenotype;
+		const JitPhenotype* jit;
+		std::vector<double> activations;
+		std::vector<double> sums; // the inputs to one run of nodes
+		std::vector<double> output_data;
+		std::vector<double> staged; // input_buffer(), if the input nodes aren't the first slots
+
+		const std::vector<double>& calculate_step(); // with the inputs in place
+	};
+
+	// Runs one Phenotype on many independent input rows at once. Each row has its own activation
+	// state, so a call advances every row by one timestep and row r gives exactly what an Evaluator
+	// fed only row r would.
+	// Activations are stored slot-major (all rows of a node are contiguous, padded to a whole number
+	// of SIMD registers), so every connection becomes one dense multiply-add over the rows.
+	class BatchEvaluator {
+	public:
+		// every row starts from the state of a freshly constructed network
+		BatchEvaluator(const Phenotype& phenotype, uint32_t rows);
+
+		// every row starts from the node and connection values currently held by net
+		BatchEvaluator(const Phenotype& phenotype, uint32_t rows, const Network& net);
+
+		// inputs: rows x (inputs - 1) row-major, without the bias
+		// outputs: rows x outputs row-major
+		void calculate(const double* inputs, double* outputs);
+		const std::vector<double>& calculate(const std::vector<double>& inputs);
+		const std::vector<double>& get_output() const { return output_data; }
+
+		uint32_t get_rows() const { return rows; }
+
+	private:
+		const Phenotype& phenotype;
+		uint32_t rows;
+		uint32_t stride; // rows rounded up to a whole number of SIMD registers
+		std::vector<double> activations; // activations[slot * stride + row]
+		std::vector<double> sum;
+		std::vector<double> output_data;
+	};
+}
@@ -0,0 +1,189 @@
+#include "precision.h"
+#include "simulator.h"
+
+#include <cstring>
+#include <iomanip>
+
+namespace NEAT {
+	Half float_to_half(float f)
+	{
+		uint32_t x;
+		std::memcpy(&x, &f, sizeof(x));
+
+		const uint16_t sign = uint16_t((x >> 16) & 0x8000);
+		const uint32_t abs = x & 0x7FFFFFFF;
+
+		if (abs >= 0x7F800000) { // inf or nan
+			return Half{ uint16_t(sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0)) };
+		}
+		if (abs >= 0x477FF000) { // rounds to beyond the largest half
+			return Half{ uint16_t(sign | 0x7C00) };
+		}
+		if (abs < 0x38800000) { // subnormal or zero in half precision
+			if (abs < 0x33000000) return Half{ sign };
+			const uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+			const uint32_t shift = 126 - (abs >> 23); // 14 to 24
+			uint32_t h = mantissa >> shift;
+			const uint32_t rest = mantissa & ((1u << shift) - 1);
+			const uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (h & 1))) h++;
+			return Half{ uint16_t(sign | h) };
+		}
+
+		uint32_t h = ((abs - 0x38000000) >> 13); // rebias the exponent and drop 13 bits of mantissa
+		const uint32_t rest = abs & 0x1FFF;
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+		return Half{ uint16_t(sign | h) };
+	}
+
+	float half_to_float(Half h)
+	{
+		const uint32_t sign = uint32_t(h.bits & 0x8000) << 16;
+		const uint32_t exponent = (h.bits >> 10) & 0x1F;
+		uint32_t mantissa = h.bits & 0x3FF;
+
+		uint32_t x;
+		if (exponent == 0x1F) {
+			x = sign | 0x7F800000 | (mantissa << 13);
+		}
+		else if (exponent != 0) {
+			x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		else if (mantissa == 0) {
+			x = sign;
+		}
+		else { // subnormal: normalise it
+			uint32_t e = 113;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				e--;
+			}
+			x = sign | (e << 23) | ((mantissa & 0x3FF) << 13);
+		}
+
+		float f;
+		std::memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+
+	const char* precision_name(Precision p)
+	{
+		switch (p) {
+		case Precision::double_precision: return "double";
+		case Precision::single: return "float32";
+		case Precision::half: return "fp16 weights";
+		case Precision::int8: return "int8 weights";
+		default: return "unknown";
+		}
+	}
+
+	Precision parse_precision(const std::string& name)
+	{
+		if (name == "double") return Precision::double_precision;
+		if (name == "float32") return Precision::single;
+		if (name == "fp16") return Precision::half;
+		if (name == "int8") return Precision::int8;
+		throw std::runtime_error("Unknown precision " + name);
+	}
+
+	namespace {
+		template <typename Eval>
+		uint32_t run(const Phenotype& phenotype, Network& net, Simulator& sim, uint32_t steps)
+		{
+			Eval eval{ phenotype, net };
+			std::vector<double> inputs(phenotype.get_inputs() - 1);
+			uint32_t step = 0;
+			for (; step < steps && !sim.is_terminal(); ++step) {
+				sim.write_inputs_to_network(inputs.data(), uint32_t(inputs.size()));
+				sim.update_with_network_output(eval.calculate(inputs));
+			}
+			eval.store_state(net);
+			net.set_fitness(sim.get_fitness());
+			return step;
+		}
+	}
+
+	uint32_t simulate(Network& net, Simulator& sim, uint32_t steps, Precision precision)
+	{
+		const Phenotype phenotype{ net };
+		switch (precision) {
+		case Precision::double_precision: return run<PrecisionEvaluator<double>>(phenotype, net, sim, steps);
+		case Precision::single: return run<FloatEvaluator>(phenotype, net, sim, steps);
+		case Precision::half: return run<HalfEvaluator>(phenotype, net, sim, steps);
+		case Precision::int8: return run<Int8Evaluator>(phenotype, net, sim, steps);
+		default: throw std::runtime_error("Unknown NEAT::Precision");
+		}
+	}
+
+	namespace {
+		template <typename Eval>
+		PrecisionDrift measure_drift(Precision precision, const Phenotype& phenotype, const Network& net,
+			const std::vector<std::vector<double>>& reference_inputs, const std::vector<std::vector<double>>& reference_outputs,
+			double reference_fitness, Simulator& sim)
+		{
+			PrecisionDrift d{ precision, 0, 0, 0, 0, 0 };
+
+			// open loop: same inputs as the reference
+			Eval shadow{ phenotype, net };
+			uint64_t count = 0;
+			for (uint32_t i = 0; i < reference_inputs.size(); ++i) {
+				const std::vector<double>& out = shadow.calculate(reference_inputs[i]);
+				for (uint32_t o = 0; o < out.size(); ++o) {
+					const double err = std::abs(out[o] - reference_outputs[i][o]);
+					d.max_output_error = std::max(d.max_output_error, err);
+					d.mean_output_error += err;
+					count++;
+				}
+			}
+			if (count > 0) d.mean_output_error /= count;
+			d.weight_bytes = shadow.get_weight_bytes();
+
+			// closed loop: the evaluator drives its own simulator
+			Eval eval{ phenotype, net };
+			for (uint32_t i = 0; i < reference_inputs.size(); ++i) {
+				sim.update_with_network_output(eval.calculate(sim.get_inputs_to_network()));
+			}
+			d.fitness = sim.get_fitness();
+			d.fitness_error = reference_fitness != 0 ? std::abs(d.fitness - reference_fitness) / std::abs(reference_fitness)
+				: std::abs(d.fitness);
+
+			return d;
+		}
+	}
+
+	PrecisionReport compare_precision(const Network& net, const std::vector<std::shared_ptr<Simulator>>& sims, uint32_t steps)
+	{
+		if (sims.size() != 4) throw std::runtime_error("NEAT::compare_precision needs one simulator per precision");
+
+		const Phenotype phenotype{ net };
+
+		// the double reference, recording what it saw
+		std::vector<std::vector<double>> inputs;
+		std::vector<std::vector<double>> outputs;
+		PrecisionEvaluator<double> reference{ phenotype, net };
+		for (uint32_t i = 0; i < steps; ++i) {
+			inputs.push_back(sims[0]->get_inputs_to_network());
+			outputs.push_back(reference.calculate(inputs.back()));
+			sims[0]->update_with_network_output(outputs.back());
+		}
+
+		PrecisionReport report{ sims[0]->get_fitness(), steps, {} };
+		report.drift.push_back(measure_drift<FloatEvaluator>(Precision::single, phenotype, net, inputs, outputs, report.reference_fitness, *sims[1]));
+		report.drift.push_back(measure_drift<HalfEvaluator>(Precision::half, phenotype, net, inputs, outputs, report.reference_fitness, *sims[2]));
+		report.drift.push_back(measure_drift<Int8Evaluator>(Precision::int8, phenotype, net, inputs, outputs, report.reference_fitness, *sims[3]));
+
+		return report;
+	}
+
+	std::ostream& operator << (std::ostream& os, const PrecisionReport& r)
+	{
+		os << "Reference (double) fitness: " << r.reference_fitness << " over " << r.steps << " steps\n";
+		os << std::setw(14) << "precision" << std::setw(14) << "weight bytes" << std::setw(14) << "max out err"
+			<< std::setw(14) << "mean out err" << std::setw(14) << "fitness" << std::setw(14) << "fitness err" << '\n';
+		for (const PrecisionDrift& d : r.drift) {
+			os << std::setw(14) << precision_name(d.precision) << std::setw(14) << d.weight_bytes << std::setw(14) << d.max_output_error
+				<< std::setw(14) << d.mean_output_error << std::setw(14) << d.fitness << std::setw(14) << d.fitness_error << '\n';
+		}
+		return os;
+	}
+}
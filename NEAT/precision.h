@@ -0,0 +1,201 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <stdint.h>
+
+#include "phenotype.h"
+#include "network.h"
+
+namespace NEAT {
+	class Simulator;
+
+	// IEEE 754 binary16, used only as a storage format: weights are widened to float before use
+	struct Half {
+		uint16_t bits;
+	};
+
+	Half float_to_half(float f); // round to nearest even
+	float half_to_float(Half h);
+
+	// How connection weights are stored by a PrecisionEvaluator and turned back into the scalar type.
+	// Each computed node has a scale, which is 1 for every format except int8, where the node's
+	// weights are quantized symmetrically to [-127, 127] * scale.
+	template <typename Scalar, typename Storage>
+	struct WeightFormat {
+		static Scalar scale_for(double) { return Scalar(1); }
+		static Storage encode(double w, Scalar) { return Storage(w); }
+		static Scalar decode(Storage w, Scalar) { return Scalar(w); }
+	};
+
+	template <typename Scalar>
+	struct WeightFormat<Scalar, Half> {
+		static Scalar scale_for(double) { return Scalar(1); }
+		static Half encode(double w, Scalar) { return float_to_half(float(w)); }
+		static Scalar decode(Half w, Scalar) { return Scalar(half_to_float(w)); }
+	};
+
+	template <typename Scalar>
+	struct WeightFormat<Scalar, int8_t> {
+		static Scalar scale_for(double max_abs) { return max_abs > 0 ? Scalar(max_abs / 127) : Scalar(1); }
+		static int8_t encode(double w, Scalar scale) { return int8_t(std::clamp(std::lround(w / scale), -127l, 127l)); }
+		static Scalar decode(int8_t w, Scalar scale) { return Scalar(w) * scale; }
+	};
+
+	// Runs a Phenotype with activations held in Scalar and weights stored as Storage.
+	// PrecisionEvaluator<double> gives the same results as Evaluator; the narrower types trade accuracy
+	// for memory (see compare_precision for how much). The weights are decoded back into one packed array
+	// of Scalar when the evaluator is made, so a timestep reads them as Evaluator does, with no decoding
+	// per connection. The Simulator interface stays in double, so inputs and outputs are converted at the
+	// boundary.
+	template <typename Scalar, typename Storage = Scalar>
+	class PrecisionEvaluator {
+	public:
+		using Format = WeightFormat<Scalar, Storage>;
+
+		explicit PrecisionEvaluator(const Phenotype& phenotype)
+			:phenotype{ phenotype }, activations(phenotype.get_activation_count()), output_data(phenotype.outputs)
+		{
+			const Phenotype& p = phenotype;
+			weights.resize(p.weights.size());
+			scales.resize(p.compute_slots.size());
+			decoded.resize(p.weights.size());
+			for (uint32_t i = 0; i < p.compute_slots.size(); ++i) {
+				double max_abs = 0;
+				for (uint32_t e = p.row_start[i]; e < p.row_start[i + 1]; ++e) {
+					if (p.sources[e] < p.node_count) max_abs = std::max(max_abs, std::abs(p.weights[e]));
+				}
+				scales[i] = Format::scale_for(max_abs);
+				for (uint32_t e = p.row_start[i]; e < p.row_start[i + 1]; ++e) {
+					weights[e] = Format::encode(p.weights[e], scales[i]);
+					// carried slots already hold weight * value
+					decoded[e] = p.sources[e] < p.node_count ? Format::decode(weights[e], scales[i]) : Scalar(1);
+				}
+			}
+
+			// carried connections are few, so they are kept at full Scalar precision
+			carried_weights.assign(p.carried_weights.begin(), p.carried_weights.end());
+		}
+
+		PrecisionEvaluator(const Phenotype& phenotype, const Network& net)
+			:PrecisionEvaluator{ phenotype }
+		{
+			for (uint32_t i = 0; i < phenotype.node_count; ++i) {
+				activations[i] = Scalar(net.state.node(i));
+			}
+			for (uint32_t k = 0; k < phenotype.carried_genes.size(); ++k) {
+				activations[phenotype.node_count + k] = Scalar(net.state.gene(phenotype.carried_genes[k]));
+			}
+		}
+
+		// NB: as with Network::calculate, the caller does not provide the bias input
+		const std::vector<double>& calculate(const std::vector<double>& input_data)
+		{
+			const Phenotype& p = phenotype;
+			if (input_data.size() != p.inputs - 1) {
+				throw std::runtime_error("Incorrect input array size to NEAT::PrecisionEvaluator::calculate");
+			}
+
+			Scalar* act = activations.data();
+			for (uint32_t i = 0; i < p.inputs - 1; ++i) act[p.input_slots[i]] = Scalar(input_data[i]);
+			act[p.input_slots[p.inputs - 1]] = Scalar(1); // bias
+
+			// the same summation order as Evaluator's
+			const uint32_t* row = p.row_start.data();
+			const uint32_t* src = p.sources.data();
+			const Scalar* w = decoded.data();
+			for (uint32_t i = 0; i < p.compute_slots.size(); ++i) {
+				Scalar sum = 0;
+				for (uint32_t e = row[i]; e < row[i + 1]; ++e) sum += w[e] * act[src[e]];
+				act[p.compute_slots[i]] = activate(p.row_activations[i], sum);
+			}
+
+			Scalar* carried = act + p.node_count;
+			for (uint32_t k = 0; k < p.refreshed; ++k) {
+				carried[k] = carried_weights[k] * act[p.carried_sources[k]];
+			}
+
+			for (uint32_t o = 0; o < p.outputs; ++o) output_data[o] = double(act[p.output_slots[o]]);
+
+			return output_data;
+		}
+
+		const std::vector<double>& get_output() const { return output_data; }
+
+		// writes the node and connection values back into net, widened to double, as Evaluator::store_state does
+		void store_state(Network& net) const
+		{
+			const Phenotype& p = phenotype;
+			Network::State& state = net.prepare_state();
+			for (uint32_t i = 0; i < p.node_count; ++i) {
+				state.nodes[i] = double(activations[i]);
+			}
+			for (uint32_t k = 0; k < p.live_genes.size(); ++k) {
+				const uint32_t g = p.live_genes[k];
+				state.genes[g] = net.get_genome()[g].weight * double(activations[p.live_gene_sources[k]]);
+			}
+			net.output_data = output_data;
+		}
+
+		// bytes of weight storage, to compare against the double plan
+		size_t get_weight_bytes() const { return weights.size() * sizeof(Storage) + scales.size() * sizeof(Scalar); }
+
+	private:
+		const Phenotype& phenotype;
+		std::vector<Storage> weights;
+		std::vector<Scalar> scales; // one per computed node
+		std::vector<Scalar> decoded; // weights, decoded once, with 1 for the carried slots
+		std::vector<Scalar> carried_weights;
+		std::vector<Scalar> activations;
+		std::vector<double> output_data;
+	};
+
+	using FloatEvaluator = PrecisionEvaluator<float>;
+	using HalfEvaluator = PrecisionEvaluator<float, Half>;
+	using Int8Evaluator = PrecisionEvaluator<float, int8_t>;
+
+	enum class Precision { double_precision, single, half, int8 };
+	const char* precision_name(Precision p);
+
+	// from the names "double", "float32", "fp16" and "int8"
+	Precision parse_precision(const std::string& name);
+
+	// Network::simulate in precision: runs net from its current state on sim for up to steps timesteps,
+	// stopping early at a terminal state, then stores its state and fitness and returns the timesteps run
+	uint32_t simulate(Network& net, Simulator& sim, uint32_t steps, Precision precision);
+
+	// how far one precision drifts from the double reference on a simulator
+	struct PrecisionDrift {
+		Precision precision;
+		size_t weight_bytes;
+		double max_output_error; // open loop: the reference run's inputs fed to both evaluators
+		double mean_output_error;
+		double fitness; // closed loop: the precision drives its own copy of the simulator
+		double fitness_error; // relative to the reference fitness
+	};
+
+	struct PrecisionReport {
+		double reference_fitness;
+		uint32_t steps;
+		std::vector<PrecisionDrift> drift; // one entry per reduced precision
+
+		friend std::ostream& operator << (std::ostream& os, const PrecisionReport& r);
+	};
+
+	// runs net from its current state for steps timesteps in every precision.
+	// sims must hold one freshly reset simulator per Precision, in enum order
+	PrecisionReport compare_precision(const Network& net, const std::vector<std::shared_ptr<Simulator>>& sims, uint32_t steps);
+
+	template<typename Sim>
+	PrecisionReport compare_precision(const Network& net, const Sim& s, uint32_t steps) {
+		std::vector<std::shared_ptr<Simulator>> sims;
+		for (uint32_t i = 0; i < 4; ++i) {
+			sims.emplace_back(std::make_shared<Sim>(s));
+		}
+		return compare_precision(net, sims, steps);
+	}
+}
@@ -0,0 +1,327 @@
+#include "process_pool.h"
+#include "network.h"
+#include "simulator.h"
+#include "checkpoint.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <cerrno>
+#define NEAT_PROCESS_POOL 1
+#endif
+
+namespace NEAT {
+#ifdef NEAT_PROCESS_POOL
+	namespace {
+#ifdef MSG_NOSIGNAL
+		const int send_flags = MSG_NOSIGNAL; // a dead peer is an error to handle, not a SIGPIPE
+#else
+		const int send_flags = 0;
+#endif
+		const uint32_t max_frame = 1u << 30;
+
+		bool write_all(int fd, const char* data, size_t n)
+		{
+			while (n > 0) {
+				const ssize_t sent = ::send(fd, data, n, send_flags);
+				if (sent < 0 && errno == EINTR) continue;
+				if (sent <= 0) return false;
+				data += sent;
+				n -= size_t(sent);
+			}
+			return true;
+		}
+
+		bool read_all(int fd, char* data, size_t n)
+		{
+			while (n > 0) {
+				const ssize_t got = ::read(fd, data, n);
+				if (got < 0 && errno == EINTR) continue;
+				if (got <= 0) return false;
+				data += got;
+				n -= size_t(got);
+			}
+			return true;
+		}
+
+		// a frame is its length in bytes, then the bytes. both ends are on one machine, so the length is native
+		bool write_frame(int fd, const std::string& frame)
+		{
+			const uint32_t length = uint32_t(frame.size());
+			return write_all(fd, reinterpret_cast<const char*>(&length), sizeof(length)) && write_all(fd, frame.data(), frame.size());
+		}
+
+		bool read_frame(int fd, std::string& frame)
+		{
+			uint32_t length;
+			if (!read_all(fd, reinterpret_cast<char*>(&length), sizeof(length)) || length > max_frame) return false;
+			frame.resize(length);
+			return read_all(fd, &frame[0], length);
+		}
+
+		void no_sigpipe(int fd)
+		{
+#ifdef SO_NOSIGPIPE
+			const int on = 1;
+			setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+			(void)fd;
+#endif
+		}
+	}
+
+	ProcessPool::ProcessPool(uint32_t workers, SimulatorFactory make_simulator)
+		:make_simulator{ std::move(make_simulator) }, workers(workers, Worker{ -1, -1, -1 }), stats{}
+	{
+		if (workers == 0) throw std::runtime_error("NEAT::ProcessPool needs at least one worker");
+		for (Worker& w : this->workers) start(w);
+	}
+
+	ProcessPool::ProcessPool(uint32_t workers, std::vector<std::string> command)
+		:command{ std::move(command) }, workers(workers, Worker{ -1, -1, -1 }), stats{}
+	{
+		if (workers == 0 || this->command.empty()) throw std::runtime_error("NEAT::ProcessPool needs a worker command and at least one worker");
+		for (Worker& w : this->workers) start(w);
+	}
+
+	ProcessPool::~ProcessPool()
+	{
+		// closing its socket tells a worker to exit
+		for (Worker& w : workers) {
+			if (w.socket >= 0) close(w.socket);
+			w.socket = -1;
+		}
+		for (Worker& w : workers) stop(w);
+	}
+
+	void ProcessPool::start(Worker& w)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) throw std::runtime_error("Can't create a socket for a NEAT worker process");
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		no_sigpipe(fds[0]);
+		no_sigpipe(fds[1]);
+
+		const pid_t pid = fork();
+		if (pid < 0) {
+			close(fds[0]);
+			close(fds[1]);
+			throw std::runtime_error("Can't start a NEAT worker process");
+		}
+
+		if (pid == 0) {
+			// the child: nothing of the parent's may run here, not even destructors, so it leaves with _exit
+			close(fds[0]);
+			for (const Worker& other : workers) {
+				if (other.socket >= 0) close(other.socket);
+			}
+			if (command.empty()) _exit(run_worker(fds[1], make_simulator));
+
+			std::vector<std::string> args = command;
+			args.push_back(std::to_string(fds[1]));
+			std::vector<char*> argv;
+			for (std::string& a : args) argv.push_back(&a[0]);
+			argv.push_back(nullptr);
+			execvp(argv[0], argv.data());
+			_exit(127);
+		}
+
+		close(fds[1]);
+		w.pid = pid;
+		w.socket = fds[0];
+		w.task = -1;
+	}
+
+	void ProcessPool::stop(Worker& w)
+	{
+		if (w.socket >= 0) close(w.socket);
+		w.socket = -1;
+		if (w.pid > 0) {
+			kill(w.pid, SIGKILL);
+			while (waitpid(w.pid, nullptr, 0) < 0 && errno == EINTR) {}
+		}
+		w.pid = -1;
+	}
+
+	void ProcessPool::restart(Worker& w)
+	{
+		const int64_t task = w.task;
+		stop(w);
+		start(w);
+		stats.restarts++;
+
+		if (task >= 0) {
+			if (++attempts[size_t(task)] >= max_attempts) {
+				throw std::runtime_error("Genome " + std::to_string(task) + " was lost by " + std::to_string(max_attempts) + " NEAT worker processes");
+			}
+			queue.push_front(uint32_t(task));
+			stats.retried++;
+		}
+	}
+
+	void ProcessPool::send(Worker& w, uint32_t task, std::vector<Network>& population, uint32_t timesteps, const Settings& settings)
+	{
+		std::ostringstream os;
+		os << "task " << task << ' ' << timesteps << ' ' << settings.resets << ' ' << settings.jit_generations << ' '
+			<< settings.fast_activation << '\n';
+		population[task].save(os);
+
+		w.task = task;
+		if (!write_frame(w.socket, os.str())) restart(w);
+	}
+
+	const std::vector<uint32_t>& ProcessPool::evaluate(std::vector<Network>& population, uint32_t timesteps, const Settings& settings)
+	{
+		const uint32_t count = uint32_t(population.size());
+		ran.assign(count, 0);
+		attempts.assign(count, 0);
+		queue.clear();
+		for (uint32_t i = 0; i < count; ++i) queue.push_back(i);
+
+		uint32_t remaining = count;
+		std::vector<pollfd> polled;
+		std::vector<Worker*> polled_workers;
+		std::string frame;
+
+		try {
+			while (remaining > 0) {
+				for (Worker& w : workers) {
+					if (w.task < 0 && !queue.empty()) {
+						const uint32_t task = queue.front();
+						queue.pop_front();
+						send(w, task, population, timesteps, settings);
+					}
+				}
+
+				polled.clear();
+				polled_workers.clear();
+				for (Worker& w : workers) {
+					if (w.task < 0) continue;
+					polled.push_back(pollfd{ w.socket, POLLIN, 0 });
+					polled_workers.push_back(&w);
+				}
+				if (polled.empty()) continue;
+				if (poll(polled.data(), nfds_t(polled.size()), -1) < 0) {
+					if (errno == EINTR) continue;
+					throw std::runtime_error("NEAT::ProcessPool can't wait for its workers");
+				}
+
+				for (size_t k = 0; k < polled.size(); ++k) {
+					if (polled[k].revents == 0) continue;
+					Worker& w = *polled_workers[k];
+					if (!read_frame(w.socket, frame)) {
+						restart(w); // it died
+						continue;
+					}
+
+					std::istringstream is{ frame };
+					std::string kind;
+					is >> kind;
+					if (kind == "error") {
+						std::string message;
+						std::getline(is, message);
+						throw std::runtime_error("NEAT worker process:" + message);
+					}
+
+					try {
+						if (kind != "result" || checkpoint::read<int64_t>(is) != w.task) throw std::runtime_error("Unexpected reply");
+						const uint32_t steps = checkpoint::read<uint32_t>(is);
+						const double fitness = checkpoint::read_double(is);
+						Network& net = population[size_t(w.task)];
+						net.load_state(is);
+						net.set_fitness(fitness);
+						ran[size_t(w.task)] = steps;
+					}
+					catch (std::runtime_error&) {
+						restart(w); // a worker that breaks the protocol can't be trusted with another task
+						continue;
+					}
+
+					w.task = -1;
+					remaining--;
+					stats.tasks++;
+				}
+			}
+		}
+		catch (...) {
+			// the replies still to come belong to this call, so the workers that owe one are replaced
+			for (Worker& w : workers) {
+				if (w.task < 0) continue;
+				w.task = -1;
+				stop(w);
+				start(w);
+			}
+			queue.clear();
+			throw;
+		}
+
+		return ran;
+	}
+
+	int ProcessPool::run_worker(int socket, const SimulatorFactory& make_simulator)
+	{
+		std::string frame;
+		while (read_frame(socket, frame)) {
+			std::istringstream is{ frame };
+			std::ostringstream os;
+			int64_t task = -1;
+			try {
+				checkpoint::expect(is, "task");
+				task = checkpoint::read<int64_t>(is);
+				const uint32_t timesteps = checkpoint::read<uint32_t>(is);
+				const uint64_t resets = checkpoint::read<uint64_t>(is);
+				const uint32_t jit_generations = checkpoint::read<uint32_t>(is);
+				const bool fast_activation = checkpoint::read<bool>(is);
+
+				// the simulator the System's own would be by now: made, then reset once a generation
+				std::unique_ptr<Simulator> sim = make_simulator();
+				for (uint64_t r = 0; r < resets; ++r) sim->reset();
+
+				Network net = Network::load(is);
+				if (net.get_unchanged_generations() >= jit_generations) net.compile_jit(fast_activation);
+				const uint32_t steps = net.simulate(*sim, timesteps, fast_activation);
+
+				os << "result " << task << ' ' << steps << ' ';
+				checkpoint::write_double(os, net.get_raw_fitness());
+				os << '\n';
+				net.save_state(os);
+			}
+			catch (std::exception& e) {
+				os.str("");
+				os << "error " << task << ' ' << e.what();
+			}
+			if (!write_frame(socket, os.str())) return 1;
+		}
+		return 0;
+	}
+#else
+	ProcessPool::ProcessPool(uint32_t, SimulatorFactory)
+	{
+		throw std::runtime_error("NEAT::ProcessPool needs a POSIX system");
+	}
+
+	ProcessPool::ProcessPool(uint32_t, std::vector<std::string>)
+	{
+		throw std::runtime_error("NEAT::ProcessPool needs a POSIX system");
+	}
+
+	ProcessPool::~ProcessPool() {}
+
+	const std::vector<uint32_t>& ProcessPool::evaluate(std::vector<Network>&, uint32_t, const Settings&)
+	{
+		return ran;
+	}
+
+	int ProcessPool::run_worker(int, const SimulatorFactory&)
+	{
+		return 1;
+	}
+#endif
+}
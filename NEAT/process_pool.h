@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <functional>
+#include <stdint.h>
+
+namespace NEAT {
+	class Network;
+	class Simulator;
+
+	// Evaluates genomes in worker processes rather than threads, for simulators that aren't thread-safe or
+	// that leak, and to keep a crash in one from taking down the run. POSIX only: elsewhere the constructors
+	// throw.
+	// Each worker talks to the pool over its own Unix-domain socket. A task is a network in checkpoint form
+	// (Network::save) and how to run it (Settings); the reply is its fitness, the timesteps it ran and the
+	// state it ended in. A worker runs each task on a new simulator from its factory, reset as many times as the
+	// System has reset its own (System::reset_simulators). So a simulator whose episodes change from one reset
+	// to the next, as the cart and beam's target does, starts the episode the threaded path's would, as long as
+	// the factory makes the simulators the System was given. That costs a construction and those resets a task.
+	// A worker that dies is restarted and its task handed to the next free worker. A task that has killed
+	// max_attempts workers is given up on, and evaluate throws.
+	class ProcessPool {
+	public:
+		using SimulatorFactory = std::function<std::unique_ptr<Simulator>()>;
+
+		// workers forked from this process, each running run_worker with a simulator from make_simulator.
+		// the children only ever run on the thread that forked them, so don't fork while other threads hold locks
+		// the simulators or the networks need
+		ProcessPool(uint32_t workers, SimulatorFactory make_simulator);
+
+		// workers started from a separate binary: command, followed by the number of the worker's socket, which
+		// it inherits. the binary is expected to call run_worker on it (see tools/neat_worker.cpp)
+		ProcessPool(uint32_t workers, std::vector<std::string> command);
+
+		~ProcessPool();
+
+		ProcessPool(const ProcessPool&) = delete;
+		ProcessPool& operator=(const ProcessPool&) = delete;
+
+		uint32_t size() const { return uint32_t(workers.size()); }
+
+		// how the workers set up each network and its simulator, as System's threaded path would
+		struct Settings {
+			uint64_t resets; // times the new simulator is reset before the episode
+			uint32_t jit_generations; // networks passed on unchanged this many generations are compiled first
+			bool fast_activation; // with the polynomial activation kernels, compiled or not
+		};
+
+		// runs every network of population for timesteps steps (or until its simulator is terminal), setting
+		// its fitness and state as Network::simulate would. returns the timesteps each network ran
+		const std::vector<uint32_t>& evaluate(std::vector<Network>& population, uint32_t timesteps, const Settings& settings);
+
+		// serves tasks on socket until the pool closes it. returns the process's exit code
+		static int run_worker(int socket, const SimulatorFactory& make_simulator);
+
+		struct Stats {
+			uint64_t tasks; // completed
+			uint64_t restarts; // workers that died and were replaced
+			uint64_t retried; // tasks handed to another worker after theirs died
+		};
+		const Stats& get_stats() const { return stats; }
+
+		static const uint32_t max_attempts = 3;
+
+	private:
+		struct Worker {
+			int pid;
+			int socket; // the pool's end
+			int64_t task; // index into the population, -1 when idle
+		};
+
+		SimulatorFactory make_simulator;
+		std::vector<std::string> command;
+		std::vector<Worker> workers;
+		std::vector<uint32_t> ran; // evaluate's result
+		std::vector<uint32_t> attempts; // by task
+		std::deque<uint32_t> queue; // tasks waiting for a worker
+		Stats stats;
+
+		void start(Worker& w);
+		void stop(Worker& w); // kills the process if it is still running, and reaps it
+		void send(Worker& w, uint32_t task, std::vector<Network>& population, uint32_t timesteps, const Settings& settings);
+
+		// the worker died or broke the protocol: replaces it, and queues its task again
+		void restart(Worker& w);
+	};
+}
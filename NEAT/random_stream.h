@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+namespace NEAT {
+	// what a stream of random numbers is used for, so that the streams of different operations on the
+	// same genome never coincide
+	enum class Stream : uint32_t {
+		initial, // the random weights of the first population
+		selection, // choosing representatives, offspring counts and parents
+		offspring, // crossing over and mutating one child
+		new_network // a fresh network for a species that was not allowed to reproduce
+	};
+
+	// A counter-based random number generator: the n-th number of a stream is a hash of (key, n), so a
+	// stream can be started from its key alone without replaying any other draws. The hash is SplitMix64.
+	// Meets the UniformRandomBitGenerator requirements, so it can drive the standard distributions.
+	class RandomStream {
+	public:
+		using result_type = uint64_t;
+
+		explicit RandomStream(uint64_t key) :key{ key }, counter{} {}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return UINT64_MAX; }
+
+		result_type operator()() { return mix(key + ++counter * gamma); }
+
+		// restarts at the beginning of the stream for key
+		void seed(uint64_t new_key) { key = new_key; counter = 0; }
+
+		// the key of the stream for one operation on one genome in one generation of a seeded run
+		static uint64_t key_for(uint64_t seed, uint32_t generation, uint32_t index, Stream op)
+		{
+			uint64_t k = mix(seed + gamma);
+			k = mix(k ^ ((uint64_t(generation) << 32) | index));
+			return mix(k ^ uint64_t(op));
+		}
+
+	private:
+		static constexpr uint64_t gamma = 0x9E3779B97F4A7C15ull;
+
+		static uint64_t mix(uint64_t z)
+		{
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		uint64_t key;
+		uint64_t counter;
+	};
+}
@@ -0,0 +1,104 @@
+#include "simd.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace NEAT {
+	namespace simd {
+		void multiply_add(double* sum, const double* x, double w, uint32_t n)
+		{
+			uint32_t i = 0;
+#if defined(__AVX512F__)
+			const __m512d wv = _mm512_set1_pd(w);
+			for (; i + 8 <= n; i += 8) {
+				_mm512_storeu_pd(sum + i, _mm512_add_pd(_mm512_loadu_pd(sum + i), _mm512_mul_pd(wv, _mm512_loadu_pd(x + i))));
+			}
+#elif defined(__AVX2__)
+			const __m256d wv = _mm256_set1_pd(w);
+			for (; i + 4 <= n; i += 4) {
+				_mm256_storeu_pd(sum + i, _mm256_add_pd(_mm256_loadu_pd(sum + i), _mm256_mul_pd(wv, _mm256_loadu_pd(x + i))));
+			}
+#endif
+			for (; i < n; ++i) sum[i] += w * x[i];
+		}
+
+		void multiply(double* y, const double* x, double w, uint32_t n)
+		{
+			uint32_t i = 0;
+#if defined(__AVX512F__)
+			const __m512d wv = _mm512_set1_pd(w);
+			for (; i + 8 <= n; i += 8) _mm512_storeu_pd(y + i, _mm512_mul_pd(wv, _mm512_loadu_pd(x + i)));
+#elif defined(__AVX2__)
+			const __m256d wv = _mm256_set1_pd(w);
+			for (; i + 4 <= n; i += 4) _mm256_storeu_pd(y + i, _mm256_mul_pd(wv, _mm256_loadu_pd(x + i)));
+#endif
+			for (; i < n; ++i) y[i] = w * x[i];
+		}
+
+		void multiply_add(double* sum, const double* x, const double* w, uint32_t n)
+		{
+			uint32_t i = 0;
+#if defined(__AVX512F__)
+			for (; i + 8 <= n; i += 8) {
+				_mm512_storeu_pd(sum + i, _mm512_add_pd(_mm512_loadu_pd(sum + i), _mm512_mul_pd(_mm512_loadu_pd(w + i), _mm512_loadu_pd(x + i))));
+			}
+#elif defined(__AVX2__)
+			for (; i + 4 <= n; i += 4) {
+				_mm256_storeu_pd(sum + i, _mm256_add_pd(_mm256_loadu_pd(sum + i), _mm256_mul_pd(_mm256_loadu_pd(w + i), _mm256_loadu_pd(x + i))));
+			}
+#endif
+			for (; i < n; ++i) sum[i] += w[i] * x[i];
+		}
+
+		void multiply(double* y, const double* x, const double* w, uint32_t n)
+		{
+			uint32_t i = 0;
+#if defined(__AVX512F__)
+			for (; i + 8 <= n; i += 8) _mm512_storeu_pd(y + i, _mm512_mul_pd(_mm512_loadu_pd(w + i), _mm512_loadu_pd(x + i)));
+#elif defined(__AVX2__)
+			for (; i + 4 <= n; i += 4) _mm256_storeu_pd(y + i, _mm256_mul_pd(_mm256_loadu_pd(w + i), _mm256_loadu_pd(x + i)));
+#endif
+			for (; i < n; ++i) y[i] = w[i] * x[i];
+		}
+
+		void multiply_add(double* sum, const double* x, const uint32_t* index, const double* w, uint32_t n)
+		{
+			uint32_t i = 0;
+#if defined(__AVX512F__)
+			for (; i + 8 <= n; i += 8) {
+				const __m512d xv = _mm512_i32gather_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + i)), x, 8);
+				_mm512_storeu_pd(sum + i, _mm512_add_pd(_mm512_loadu_pd(sum + i), _mm512_mul_pd(_mm512_loadu_pd(w + i), xv)));
+			}
+#elif defined(__AVX2__)
+			for (; i + 4 <= n; i += 4) {
+				const __m256d xv = _mm256_i32gather_pd(x, _mm_loadu_si128(reinterpret_cast<const __m128i*>(index + i)), 8);
+				_mm256_storeu_pd(sum + i, _mm256_add_pd(_mm256_loadu_pd(sum + i), _mm256_mul_pd(_mm256_loadu_pd(w + i), xv)));
+			}
+#endif
+			for (; i < n; ++i) sum[i] += w[i] * x[index[i]];
+		}
+
+		uint32_t lanes()
+		{
+#if defined(__AVX512F__)
+			return 8;
+#elif defined(__AVX2__)
+			return 4;
+#else
+			return 1;
+#endif
+		}
+
+		const char* instruction_set()
+		{
+#if defined(__AVX512F__)
+			return "AVX-512";
+#elif defined(__AVX2__)
+			return "AVX2";
+#else
+			return "scalar";
+#endif
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+namespace NEAT {
+	// Dense kernels over arrays of doubles used by the batched evaluators.
+	// The widest instruction set enabled at compile time is used (AVX-512, then AVX2), with a scalar
+	// loop for the remainder and for other targets. Multiplies and adds are kept separate so each
+	// lane gives exactly the result of the scalar expression.
+	namespace simd {
+		// sum[i] += w * x[i]
+		void multiply_add(double* sum, const double* x, double w, uint32_t n);
+
+		// y[i] = w * x[i]
+		void multiply(double* y, const double* x, double w, uint32_t n);
+
+		// sum[i] += w[i] * x[i]
+		void multiply_add(double* sum, const double* x, const double* w, uint32_t n);
+
+		// y[i] = w[i] * x[i]
+		void multiply(double* y, const double* x, const double* w, uint32_t n);
+
+		// sum[i] += w[i] * x[index[i]], gathering x. every index must be below 2^31
+		void multiply_add(double* sum, const double* x, const uint32_t* index, const double* w, uint32_t n);
+
+		// the number of doubles processed per instruction
+		uint32_t lanes();
+		const char* instruction_set();
+	}
+}
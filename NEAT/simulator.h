@@ -1,7 +1,11 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
 #include "system.h"
+#include "alloc_check.h"
 
 namespace NEAT {
 	// The class that provides the interface that users of the library must use for simulation.
@@ -13,5 +17,93 @@ namespace NEAT {
 		virtual const std::vector<double>& get_inputs_to_network() = 0;
 		virtual double get_fitness() = 0;
 		virtual void reset() = 0;
+
+		// writes the inputs straight into the evaluator's buffer of count values, which is how System and
+		// Network::simulate read them. the default copies get_inputs_to_network(); override it to fill the
+		// buffer without going through a vector
+		virtual void write_inputs_to_network(double* inputs, uint32_t count) {
+			const std::vector<double>& in = get_inputs_to_network();
+			if (in.size() != count) throw std::runtime_error("Incorrect input array size from NEAT::Simulator");
+			std::copy(in.begin(), in.end(), inputs);
+		}
+
+		// whether the episode is over: lost, or at a point where nothing the network does can change its fitness.
+		// checked before each timestep, so the rest of the run is skipped and the fitness taken as it stands
+		virtual bool is_terminal() { return false; }
+	};
+	// Steps a block of environments in one call, in place of one Simulator per genome: the inputs and outputs of
+	// a block are dense matrices, one row per environment, so stepping keeps pace with the lockstep evaluator.
+	// environment i is evaluated by population[i]. calls for disjoint ranges come from several threads at once
+	class BatchSimulator {
+	public:
+		virtual ~BatchSimulator() = default;
+
+		virtual uint32_t size() const = 0; // the number of environments
+
+		// inputs: one row of (inputs - 1) values for each environment first up to last, without the bias
+		virtual void get_inputs_to_network(uint32_t first, uint32_t last, double* inputs) = 0;
+		// outputs: one row for each environment first up to last. those with running[i - first] clear have ended,
+		// and their rows are to be ignored
+		virtual void update_with_network_output(uint32_t first, uint32_t last, const double* outputs, const uint8_t* running) = 0;
+		virtual void get_fitness(uint32_t first, uint32_t last, double* fitness) = 0;
+		virtual void reset(uint32_t first, uint32_t last) = 0;
+
+		// sets terminal[i - first] for each environment first up to last that has ended (see Simulator::is_terminal)
+		virtual void is_terminal(uint32_t first, uint32_t last, uint8_t* terminal) { std::fill_n(terminal, last - first, uint8_t(0)); }
+	};
+
+	// One environment of a BatchSimulator seen as a Simulator, for the parts of System that evaluate a genome
+	// at a time
+	class BatchEnvironment : public Simulator {
+	public:
+		BatchEnvironment(std::shared_ptr<BatchSimulator> batch, uint32_t index, uint32_t inputs)
+			:batch{ batch }, index{ index }, inputs(inputs) {}
+
+		void update_with_network_output(const std::vector<double>& net_outs) override {
+			const uint8_t running = 1;
+			batch->update_with_network_output(index, index + 1, net_outs.data(), &running);
+		}
+
+		const std::vector<double>& get_inputs_to_network() override {
+			batch->get_inputs_to_network(index, index + 1, inputs.data());
+			return inputs;
+		}
+
+		void write_inputs_to_network(double* inputs, uint32_t count) override {
+			if (count != this->inputs.size()) throw std::runtime_error("Incorrect input array size from NEAT::BatchEnvironment");
+			batch->get_inputs_to_network(index, index + 1, inputs);
+		}
+
+		double get_fitness() override {
+			double fitness;
+			batch->get_fitness(index, index + 1, &fitness);
+			return fitness;
+		}
+
+		void reset() override { batch->reset(index, index + 1); }
+
+		bool is_terminal() override {
+			uint8_t terminal;
+			batch->is_terminal(index, index + 1, &terminal);
+			return terminal;
+		}
+
+	private:
+		std::shared_ptr<BatchSimulator> batch;
+		SharedCopies<1> shared_copies; // batch, for alloc_check
+		uint32_t index;
+		std::vector<double> inputs;
+	};
+
+	// A fitness function over a fixed set of independent cases, such as XOR's four: every case is an input row
+	// given to a network fresh from construction, and the fitness is a score of the output rows. System runs each
+	// genome on every row at once through a BatchEvaluator, in one timestep, rather than stepping a Simulator
+	class Dataset {
+	public:
+		virtual ~Dataset() = default;
+
+		virtual uint32_t rows() const = 0;
+		virtual const double* inputs() const = 0; // rows x (network inputs - 1) row-major, without the bias
+		virtual double score(const double* outputs) const = 0; // outputs: rows x network outputs row-major
 	};
-}
\ No newline at end of file
+}
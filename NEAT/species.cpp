@@ -0,0 +1,161 @@
+#include "species.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace NEAT {
+#if defined(__AVX2__)
+	namespace {
+		bool block_matches(const uint32_t* a, const uint32_t* b)
+		{
+			const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+			return _mm_movemask_epi8(eq) == 0xFFFF;
+		}
+	}
+#endif
+
+	GenomeKey::GenomeKey(const std::vector<Connection>& genome)
+	{
+		assign(genome);
+	}
+
+	void GenomeKey::assign(const std::vector<Connection>& genome)
+	{
+		innovations.resize(genome.size());
+		weights.resize(genome.size());
+		for (uint32_t i = 0; i < genome.size(); ++i) {
+			if (i > 0 && genome[i].innov_num <= genome[i - 1].innov_num) {
+				throw std::runtime_error("Genome not sorted by innovation number in NEAT::GenomeKey");
+			}
+			innovations[i] = genome[i].innov_num;
+			weights[i] = genome[i].weight;
+		}
+	}
+
+	GeneComparison compare_genes(const GenomeKey& a, const GenomeKey& b)
+	{
+		const uint32_t* ia = a.get_innovations();
+		const uint32_t* ib = b.get_innovations();
+		const double* wa = a.get_weights();
+		const double* wb = b.get_weights();
+		const uint32_t na = a.size();
+		const uint32_t nb = b.size();
+
+		GeneComparison g{};
+		double sum[4] = {}; // matching gene k is added to sum[k % 4]
+		uint32_t i = 0, j = 0;
+
+#if defined(__AVX2__)
+		const __m256d sign = _mm256_set1_pd(-0.0);
+#endif
+		while (i < na && j < nb) {
+#if defined(__AVX2__)
+			// genomes of one species mostly share runs of genes, take them four at a time
+			if (g.matching % 4 == 0 && i + 4 <= na && j + 4 <= nb && block_matches(ia + i, ib + j)) {
+				__m256d acc = _mm256_loadu_pd(sum);
+				do {
+					const __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(wa + i), _mm256_loadu_pd(wb + j));
+					acc = _mm256_add_pd(acc, _mm256_andnot_pd(sign, diff));
+					g.matching += 4;
+					i += 4;
+					j += 4;
+				} while (i + 4 <= na && j + 4 <= nb && block_matches(ia + i, ib + j));
+				_mm256_storeu_pd(sum, acc);
+				continue;
+			}
+#endif
+			if (ia[i] == ib[j]) {
+				sum[g.matching % 4] += std::abs(wa[i] - wb[j]);
+				g.matching++;
+				i++;
+				j++;
+			}
+			else if (ia[i] < ib[j]) {
+				g.disjoint++; // within range of b, since b has a later gene
+				i++;
+			}
+			else {
+				g.disjoint++;
+				j++;
+			}
+		}
+
+		// what is left of either genome lies beyond the other's last innovation
+		g.excess = (na - i) + (nb - j);
+
+		g.weight_difference = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+		return g;
+	}
+
+	double compatibility_distance(const GenomeKey& a, const GenomeKey& b, double c1, double c2, double c3)
+	{
+		const GeneComparison g = compare_genes(a, b);
+		const uint32_t max_size = std::max(a.size(), b.size());
+		return c1 * (g.disjoint / double(max_size)) + c2 * (g.excess / double(max_size)) + c3 * (g.weight_difference / g.matching);
+	}
+
+	void compatibility_distances(const GenomeKey& genome, const std::vector<GenomeKey>& reps, double c1, double c2, double c3,
+		std::vector<double>& distances)
+	{
+		distances.resize(reps.size());
+		for (uint32_t r = 0; r < reps.size(); ++r) {
+			distances[r] = compatibility_distance(genome, reps[r], c1, c2, c3);
+		}
+	}
+
+	uint32_t find_compatible(const GenomeKey& genome, const std::vector<GenomeKey>& reps, double c1, double c2, double c3, double thresh)
+	{
+		for (uint32_t r = 0; r < reps.size(); ++r) {
+			if (distance_lower_bound(genome, reps[r], c1, c2) > thresh) continue;
+			if (compatibility_distance(genome, reps[r], c1, c2, c3) <= thresh) return r;
+		}
+		return uint32_t(reps.size());
+	}
+
+	double distance_lower_bound(const GenomeKey& a, const GenomeKey& b, double c1, double c2)
+	{
+		const uint32_t na = a.size();
+		const uint32_t nb = b.size();
+		if (na == 0 || nb == 0) return 0;
+
+		const uint32_t* ia = a.get_innovations();
+		const uint32_t* ib = b.get_innovations();
+
+		// the merge in compare_genes leaves exactly the genes beyond the other genome's last innovation over as
+		// excess, and the genes before its first innovation are disjoint. only one genome can have either
+		uint32_t excess = 0, before = 0;
+		if (ia[na - 1] > ib[nb - 1]) excess = uint32_t((ia + na) - std::upper_bound(ia, ia + na, ib[nb - 1]));
+		else if (ib[nb - 1] > ia[na - 1]) excess = uint32_t((ib + nb) - std::upper_bound(ib, ib + nb, ia[na - 1]));
+		if (ia[0] < ib[0]) before = uint32_t(std::lower_bound(ia, ia + na, ib[0]) - ia);
+		else if (ib[0] < ia[0]) before = uint32_t(std::lower_bound(ib, ib + nb, ia[0]) - ib);
+
+		const uint32_t size_difference = na > nb ? na - nb : nb - na;
+		const uint32_t disjoint = std::max(before, size_difference > excess ? size_difference - excess : 0);
+
+		// the same expression as compatibility_distance with no weight term, so rounding can't push it above
+		const uint32_t max_size = std::max(na, nb);
+		return c1 * (disjoint / double(max_size)) + c2 * (excess / double(max_size));
+	}
+
+	std::pair<const DistanceCache::Distance*, const DistanceCache::Distance*> DistanceCache::find(uint64_t genome) const
+	{
+		if (records.empty() || genome > records.back().genome) return { nullptr, nullptr };
+
+		auto it = std::lower_bound(records.begin(), records.end(), genome, [](const Record& r, uint64_t g) { return r.genome < g; });
+		if (it == records.end() || it->genome != genome) return { nullptr, nullptr };
+		return { distances.data() + it->first, distances.data() + it->first + it->count };
+	}
+
+	void DistanceCache::replace(std::vector<Record>& new_records, std::vector<Distance>& new_distances)
+	{
+		records.swap(new_records);
+		distances.swap(new_distances);
+		std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.genome < b.genome; });
+	}
+}
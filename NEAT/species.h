@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+#include "connection.h"
+
+namespace NEAT {
+	// A genome's innovation numbers and weights in separate arrays, for the compatibility distance.
+	// The genome must be sorted by innovation number, which Network keeps it.
+	class GenomeKey {
+	public:
+		GenomeKey() = default;
+		explicit GenomeKey(const std::vector<Connection>& genome);
+
+		// rebuilds the key for genome, reusing the arrays
+		void assign(const std::vector<Connection>& genome);
+
+		uint32_t size() const { return uint32_t(innovations.size()); }
+		const uint32_t* get_innovations() const { return innovations.data(); }
+		const double* get_weights() const { return weights.data(); }
+
+	private:
+		std::vector<uint32_t> innovations;
+		std::vector<double> weights;
+	};
+
+	struct GeneComparison {
+		uint32_t matching;
+		uint32_t disjoint;
+		uint32_t excess;
+		double weight_difference; // the sum of |w_a - w_b| over the matching genes
+	};
+
+	// a single merge pass over both genomes. runs of four matching genes are compared and accumulated with
+	// AVX2 where available. the weight differences are summed in four interleaved partial sums either way,
+	// so every build gives the same result
+	GeneComparison compare_genes(const GenomeKey& a, const GenomeKey& b);
+
+	// delta in the 2002 paper.
+	// c1: coeficcient for disjoint genes
+	// c2: coeficcient for excess genes
+	// c3: coeficcient for weights
+	double compatibility_distance(const GenomeKey& a, const GenomeKey& b, double c1, double c2, double c3);
+
+	// the distance from genome to each of reps
+	void compatibility_distances(const GenomeKey& genome, const std::vector<GenomeKey>& reps, double c1, double c2, double c3,
+		std::vector<double>& distances);
+
+	// the index of the first of reps within thresh of genome, or reps.size() if there isn't one. reps ruled out by
+	// distance_lower_bound are skipped, so the coefficients must not be negative
+	uint32_t find_compatible(const GenomeKey& genome, const std::vector<GenomeKey>& reps, double c1, double c2, double c3, double thresh);
+
+	// a lower bound on compatibility_distance(a, b) from the sizes and innovation ranges alone, in O(log n).
+	// genes beyond the other genome's last innovation are excess, genes before its first are disjoint, and at
+	// least the difference in size go unmatched. the coefficients must not be negative
+	double distance_lower_bound(const GenomeKey& a, const GenomeKey& b, double c1, double c2);
+
+	// The compatibility distances each genome was found to have from representatives, by Network::get_genome_id,
+	// kept from one generation's speciation to the next. Only genomes passed on unchanged can be found again,
+	// and as ids only grow, any genome newer than the newest one held is skipped without a search.
+	// find is safe to call from several threads; replace is not.
+	class DistanceCache {
+	public:
+		struct Distance {
+			uint64_t rep;
+			double distance;
+		};
+
+		// distances[first, first + count) were found for genome
+		struct Record {
+			uint64_t genome;
+			uint32_t first, count;
+		};
+
+		// the distances held for genome, empty if there are none
+		std::pair<const Distance*, const Distance*> find(uint64_t genome) const;
+
+		// keeps only these, the distances found this generation. records can be in any order.
+		// the vectors are swapped with the ones held, so the caller gets the old ones back to reuse
+		void replace(std::vector<Record>& new_records, std::vector<Distance>& new_distances);
+
+		size_t size() const { return distances.size(); }
+
+	private:
+		std::vector<Record> records; // sorted by genome
+		std::vector<Distance> distances;
+	};
+}
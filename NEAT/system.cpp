@@ -1,11 +1,40 @@
 #include "system.h"
+#include "lockstep.h"
+#include "checkpoint.h"
+#include "process_pool.h"
+#include "precision.h"
+
+#include <chrono>
+#include <atomic>
+#include <mutex>
 
 namespace NEAT {
-	std::default_random_engine System::rand_gen((std::random_device())());
-	//std::default_random_engine System::rand_gen;
-	std::uniform_real_distribution<double> System::rand_dist(0, 1);
+	namespace {
+		// below this many genomes per thread, comparing them with a new representative isn't worth waking threads for
+		const uint32_t genomes_per_thread = 256;
+
+		// the fewest genomes evaluated in one chunk. the lockstep evaluator only groups genomes within a chunk,
+		// and below this its groups shrink enough to cost more sweep time than stealing wins back
+		const uint32_t genomes_per_chunk = 64;
+
+		// runs job(i, t) for every i below count on threads of pool's workers, t being the worker's index.
+		// the pool's work stealing keeps a few slow jobs from holding up a fixed share of the rest
+		template <typename Job>
+		void parallel_for(ThreadPool& pool, uint32_t count, uint32_t threads, Job job)
+		{
+			pool.run(count, 0, threads, [&](uint32_t first, uint32_t last, uint32_t t) {
+				for (uint32_t i = first; i < last; ++i) job(i, t);
+			});
+		}
+	}
+
+	thread_local RandomStream System::rand_gen((uint64_t((std::random_device())()) << 32) | (std::random_device())());
+	thread_local std::uniform_real_distribution<double> System::rand_dist(0, 1);
+	thread_local InnovationBatch* System::batch = nullptr;
 	double modified_sigmoid(double input) { return 1 / (1 + exp(-4.9 * input)); }
 	double act_func(double input) { return modified_sigmoid(input); }
+	float modified_sigmoid(float input) { return 1 / (1 + std::exp(-4.9f * input)); }
+	float act_func(float input) { return modified_sigmoid(input); }
 	double random(double thresh) { return (System::rand_dist(System::rand_gen) - 0.5) * 2 * thresh; }
 	uint32_t random_int(uint32_t ulim) { return uint32_t(System::rand_dist(System::rand_gen) * ulim); }
 
@@ -21,61 +50,244 @@ namespace NEAT {
 
 	void Species::set_rep(const Network& net)
 	{
-		rep = std::make_unique<Network>(Network{ net });
+		*rep = net; // shares net's genes rather than copying them
 	}
 
 	System::System(uint32_t size, uint32_t inputs, uint32_t outputs, double err)
-		:inputs{ inputs }, outputs{ outputs }, size{ size }, spec_thresh{ 3.0 },
-		spec_c1{ 2.0 }, spec_c2{ 2.0 }, spec_c3{ 1.0 }, keep{ .2 },
-		node_mut{ 0.03 }, conn_mut{ 0.05 }, weight_mut{ 0.8 }, mut_uniform{ 0.9 }, weight_err{ 2.0 },
-		generation{}, crossover_rate{ 0.8 }, disable_thresh{ 0.75 }, target_species{ 20 },
-		mean_fitness{}, mean_hidden_nodes{}, max_fitness{}, stagnation_gen{ 25 }, spec_penalty{ 0.4 }
+		:System{ size, inputs, outputs, err, std::make_shared<InnovationRegistry>() } {}
+
+	System::System(uint32_t size, uint32_t inputs, uint32_t outputs, double err, std::shared_ptr<InnovationRegistry> innovations)
+		:simulator_resets{}, innovations{ innovations }, shared_innovations{ false }, inputs{ inputs }, outputs{ outputs }, size{ size },
+		generation{}, spec_thresh{ 3.0 }, target_species{ 20 }, stagnation_gen{ 25 }, spec_c1{ 2.0 }, spec_c2{ 2.0 }, spec_c3{ 1.0 },
+		disable_thresh{ 0.75 }, keep{ .2 }, crossover_rate{ 0.8 }, spec_penalty{ 0.4 },
+		node_mut{ 0.03 }, conn_mut{ 0.05 }, weight_mut{ 0.8 }, mut_uniform{ 0.9 }, act_mut{ 0 }, weight_err{ 2.0 }, initial_err{ err },
+		jit_generations{ 3 }, fast_activation{ false }, precision{ Precision::double_precision }, pool{ std::make_unique<ThreadPool>() }, reproduction_threads{ 0 }, measure_serial_reproduction{ false }, steady_batch{ 8 },
+		reproduction_stats{}, speciation_stats{}, evaluation_stats{}, steady{}, steady_state_stats{}, seeded{ false }, seed{},
+		mean_fitness{}, mean_hidden_nodes{}, max_fitness{}
 	{
 		for (uint32_t i = 0; i < size; ++i) {
 			population.emplace_back(Network{ *this, inputs, outputs, err });
 		}
 	}
 
+	void System::set_seed(uint64_t new_seed)
+	{
+		seeded = true;
+		seed = new_seed;
+
+		if (generation == 0) {
+			for (uint32_t i = 0; i < size; ++i) {
+				seed_stream(Stream::initial, i);
+				population[i] = Network{ *this, inputs, outputs, initial_err };
+			}
+			steady.evaluated.clear();
+		}
+	}
+
+	void System::seed_stream(Stream op, uint32_t index) const
+	{
+		if (seeded) rand_gen.seed(RandomStream::key_for(seed, generation, index, op));
+	}
+
 	void System::init_simulators(const std::vector<std::shared_ptr<Simulator>>& sims)
 	{
 		if (sims.size() != size) throw std::runtime_error("Incorrect simulator length");
 		simulators = sims;
+		batch_simulator = nullptr;
+		dataset = nullptr;
+		simulator_resets = 0;
 	}
 
-	uint32_t System::get_innov_number(const Connection& gene)
+	void System::init_simulators(std::shared_ptr<BatchSimulator> sim)
 	{
-		auto c = std::find(genes.begin(), genes.end(), gene);
-		if (c != genes.end())
-		{
-			return c->innov_num;
+		if (!sim || sim->size() < size) throw std::runtime_error("Batch simulator too small for NEAT::System");
+		simulators.clear();
+		for (uint32_t i = 0; i < size; ++i) {
+			simulators.emplace_back(std::make_shared<BatchEnvironment>(sim, i, inputs - 1));
 		}
+		batch_simulator = sim;
+		dataset = nullptr;
+		simulator_resets = 0;
+	}
 
-		else {
-			genes.emplace_back(Connection{ gene.node1, gene.node2, true, genes.size(), false });
-			return genes.size() - 1;
-		}
+	void System::init_dataset(std::shared_ptr<Dataset> data)
+	{
+		if (!data || data->rows() == 0) throw std::runtime_error("Empty dataset for NEAT::System");
+		simulators.clear();
+		batch_simulator = nullptr;
+		dataset = data;
+		simulator_resets = 0;
+	}
+
+	void System::set_threads(uint32_t threads)
+	{
+		pool = std::make_unique<ThreadPool>(std::max(threads, reproduction_threads));
+	}
+
+	void System::set_reproduction_threads(uint32_t threads)
+	{
+		reproduction_threads = threads;
+		if (threads > pool->size()) pool = std::make_unique<ThreadPool>(threads);
+	}
+
+	uint32_t System::worker_threads(uint32_t jobs) const
+	{
+		const uint32_t threads = reproduction_threads ? reproduction_threads : pool->size();
+		return std::clamp(threads, 1u, std::max(jobs, 1u));
 	}
 
 	void System::speciate()
 	{
+		const auto start = std::chrono::steady_clock::now();
+
 		for (Species& s : species) s.count = 0;
 
-		for (Network& net : population) {
-			bool species_found = false;
-			for (Species& s : species) {
-				if (!species_found && s.get_rep().speciate(spec_c1, spec_c2, spec_c3, net.get_genome(), spec_thresh)) {
-					species_found = true;
-					net.set_species(s.get_rep().get_species());
-					s.count++;
+		std::vector<GenomeKey>& reps = speciation_buffers.reps;
+		reps.resize(species.size());
+		for (uint32_t s = 0; s < species.size(); ++s) reps[s].assign(species[s].get_rep().get_genome());
+		const uint32_t old_species = uint32_t(species.size());
+
+		// the first of the old representatives each genome is compatible with, or unplaced if none.
+		// distances are taken from the cache, ruled out by their lower bound or computed, in that order
+		const uint32_t threads = worker_threads(size);
+		const uint32_t unplaced = UINT32_MAX;
+		std::vector<uint32_t>& match = speciation_buffers.match;
+		std::vector<DistanceCache::Record>& records = speciation_buffers.records; // first is into found[owner[i]] until they are joined
+		std::vector<uint32_t>& owner = speciation_buffers.owner;
+		std::vector<std::vector<DistanceCache::Distance>>& found = speciation_buffers.found; // the distances to keep for next generation
+		match.resize(population.size());
+		records.resize(population.size());
+		owner.resize(population.size());
+		found.resize(threads);
+		for (auto& f : found) f.clear();
+		speciation_buffers.keys.resize(threads);
+		std::vector<SpeciationStats> counts(threads, SpeciationStats{});
+		std::vector<uint64_t> rep_ids;
+		for (const Species& s : species) rep_ids.push_back(s.get_rep().get_genome_id());
+		parallel_for(*pool, uint32_t(population.size()), threads, [&](uint32_t i, uint32_t t) {
+			const Network& net = population[i];
+			const auto cached = distance_cache.find(net.get_genome_id());
+			GenomeKey& key = speciation_buffers.keys[t];
+			bool keyed = false;
+			std::vector<DistanceCache::Distance>& out = found[t];
+			const uint32_t first = uint32_t(out.size());
+			SpeciationStats count{};
+
+			uint32_t s = unplaced;
+			for (uint32_t r = 0; r < old_species; ++r) {
+				auto hit = std::find_if(cached.first, cached.second, [&](const DistanceCache::Distance& d) { return d.rep == rep_ids[r]; });
+				double distance;
+				if (hit != cached.second) {
+					distance = hit->distance;
+					count.cached++;
+				}
+				else {
+					if (!keyed) {
+						key.assign(net.get_genome());
+						keyed = true;
+					}
+					if (distance_lower_bound(key, reps[r], spec_c1, spec_c2) > spec_thresh) {
+						count.pruned++;
+						continue;
+					}
+					distance = compatibility_distance(key, reps[r], spec_c1, spec_c2, spec_c3);
+					count.computed++;
+				}
+
+				out.push_back(DistanceCache::Distance{ rep_ids[r], distance });
+				if (distance <= spec_thresh) {
+					s = r;
+					break;
+				}
+			}
+
+			match[i] = s;
+			records[i] = DistanceCache::Record{ net.get_genome_id(), first, uint32_t(out.size()) - first };
+			owner[i] = t;
+			counts[t].computed += count.computed;
+			counts[t].cached += count.cached;
+			counts[t].pruned += count.pruned;
+		});
+
+		std::vector<DistanceCache::Distance>& distances = speciation_buffers.distances;
+		if (threads == 1) distances.swap(found[0]);
+		else {
+			std::vector<uint32_t> offset(threads);
+			distances.clear();
+			for (uint32_t t = 0; t < threads; ++t) {
+				offset[t] = uint32_t(distances.size());
+				distances.insert(distances.end(), found[t].begin(), found[t].end());
+			}
+			for (uint32_t i = 0; i < population.size(); ++i) records[i].first += offset[owner[i]];
+		}
+		distance_cache.replace(records, distances);
+
+		// the genomes that matched no old representative found new species. serially, each would be compared with
+		// the new representatives before it in population order. the same comes out of rounds: the first unmatched
+		// genome founds a species, the rest are compared with it in parallel, and those still unmatched go on.
+		// once too few are left to share out, the rest are placed serially
+		std::vector<uint32_t> unmatched;
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			if (match[i] == unplaced) unmatched.push_back(i);
+		}
+		std::vector<std::optional<GenomeKey>> keys(unmatched.size()); // alongside unmatched, built when first needed
+		auto compatible = [&](uint32_t k, uint32_t r, uint32_t t) {
+			std::optional<GenomeKey>& key = keys[k];
+			if (!key) key.emplace(population[unmatched[k]].get_genome());
+			if (distance_lower_bound(*key, reps[r], spec_c1, spec_c2) > spec_thresh) {
+				counts[t].pruned++;
+				return false;
+			}
+			counts[t].computed++;
+			return compatibility_distance(*key, reps[r], spec_c1, spec_c2, spec_c3) <= spec_thresh;
+		};
+		auto found_species = [&](uint32_t k) {
+			const uint32_t s = uint32_t(species.size());
+			Network& founder = population[unmatched[k]];
+			founder.set_species(s);
+			species.emplace_back(Species{ founder });
+			if (keys[k]) reps.emplace_back(std::move(*keys[k]));
+			else reps.emplace_back(founder.get_genome());
+			match[unmatched[k]] = s;
+			return s;
+		};
+
+		for (uint32_t first = 0; first < unmatched.size();) {
+			const uint32_t rest = uint32_t(unmatched.size()) - first - 1;
+			const uint32_t round_threads = std::min(threads, worker_threads(rest / genomes_per_thread));
+			if (round_threads == 1) {
+				for (uint32_t k = first; k < unmatched.size(); ++k) {
+					uint32_t r = old_species;
+					while (r < reps.size() && !compatible(k, r, 0)) ++r;
+					if (r < reps.size()) match[unmatched[k]] = r;
+					else found_species(k);
 				}
+				break;
 			}
-			
-			// no species found to match, create a new species with this genome as representative
-			if (!species_found) {
-				net.set_species(species.size());
-				species.emplace_back(Species{net});
-				species[species.size() - 1].count++;
+
+			const uint32_t s = found_species(first);
+			first++;
+			parallel_for(*pool, rest, round_threads, [&](uint32_t k, uint32_t t) {
+				if (compatible(first + k, s, t)) match[unmatched[first + k]] = s;
+			});
+
+			uint32_t kept = first;
+			for (uint32_t k = first; k < unmatched.size(); ++k) {
+				if (match[unmatched[k]] == s) continue;
+				if (kept != k) {
+					unmatched[kept] = unmatched[k];
+					keys[kept] = std::move(keys[k]);
+				}
+				kept++;
 			}
+			unmatched.resize(kept);
+			keys.resize(kept);
+		}
+
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			Network& net = population[i];
+			net.set_species(species[match[i]].get_rep().get_species());
+			species[match[i]].count++;
 		}
 
 		for (Species& s : species) {
@@ -85,6 +297,15 @@ namespace NEAT {
 		spec_thresh -= 0.1 * (int(target_species) - int(std::count_if(species.begin(), species.end(), [](const Species& s) { return s.count > 0; })));
 		spec_thresh = std::clamp(spec_thresh, 0.5, 100.0);
 		//if (generation > 10 && species_count.size() == 1) __debugbreak();
+
+		speciation_stats = SpeciationStats{};
+		speciation_stats.threads = threads;
+		for (const SpeciationStats& c : counts) {
+			speciation_stats.computed += c.computed;
+			speciation_stats.cached += c.cached;
+			speciation_stats.pruned += c.pruned;
+		}
+		speciation_stats.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 	}
 
 	void System::update_reps()
@@ -186,7 +407,8 @@ namespace NEAT {
 				else return a.get_shared_fitness() < b.get_shared_fitness();
 			});
 
-		std::vector<Network> culled_population;
+		// the survivors are moved down over the culled genomes, in place
+		uint32_t kept = 0;
 		uint32_t spec_index = 0;
 		for (uint32_t spec = 0; spec < species.size(); ++spec) {
 			if (species[spec].count > 0) {
@@ -195,25 +417,152 @@ namespace NEAT {
 				// number from this species to keep
 				uint32_t num = species[spec].count - to_cull[spec];
 				for (uint32_t i = 0; i < num; ++i) {
-					culled_population.push_back(population[i + lower_bound]);
+					if (kept != i + lower_bound) population[kept] = std::move(population[i + lower_bound]);
+					kept++;
 				}
 				spec_index += species[spec].count;
 			}
 		}
 
-		population = culled_population;
+		// the culled genomes' memory is kept for the next generation's children
+		std::move(population.begin() + kept, population.end(), std::back_inserter(spare_population));
+		population.erase(population.begin() + kept, population.end());
+	}
+
+	System::EvaluationStats System::simulate_subset(System* s, uint32_t first, uint32_t last, uint32_t steps)
+	{
+		if (s->precision != Precision::double_precision && !s->dataset) return simulate_precision(s, first, last, steps);
+		if (s->batch_simulator) return simulate_batch(s, first, last, steps);
+		if (s->dataset) return simulate_dataset(s, first, last);
+
+		// long-lived champions are worth compiling: the code is reused for as long as they survive
+		for (uint32_t i = first; i < last; ++i) {
+			if (s->population[i].get_unchanged_generations() >= s->jit_generations) s->population[i].compile_jit(s->fast_activation);
+		}
+
+		// the networks in the range are stepped together, one sweep per timestep
+		LockstepEvaluator evaluator{ s->population, first, last, s->fast_activation };
+
+		const uint32_t in_width = s->inputs - 1;
+		std::vector<double> input_data(size_t(last - first) * in_width);
+		std::vector<double> output_data(size_t(last - first) * s->outputs);
+		std::vector<double> net_outs(s->outputs);
+
+		// the genomes whose episodes are still going, in order
+		std::vector<uint32_t> running(last - first);
+		std::iota(running.begin(), running.end(), first);
+		EvaluationStats stats{};
+
+		for (uint32_t step = 0; step < steps; ++step) {
+			// a finished genome's state is kept as it stands, and its group is skipped once all its genomes are done
+			auto done = std::remove_if(running.begin(), running.end(), [&](uint32_t i) {
+				if (!s->simulators[i]->is_terminal()) return false;
+				evaluator.retire(s->population, i);
+				stats.saved += steps - step;
+				stats.ended_early++;
+				return true;
+			});
+			running.erase(done, running.end());
+			if (running.empty()) break;
+			stats.timesteps += running.size();
+
+			for (uint32_t i : running) {
+				s->simulators[i]->write_inputs_to_network(&input_data[size_t(i - first) * in_width], in_width);
+			}
+
+			evaluator.calculate(input_data.data(), output_data.data());
+
+			for (uint32_t i : running) {
+				auto out = output_data.begin() + size_t(i - first) * s->outputs;
+				std::copy(out, out + s->outputs, net_outs.begin());
+				s->simulators[i]->update_with_network_output(net_outs);
+			}
+		}
+
+		evaluator.store_state(s->population);
+		for (uint32_t i = first; i < last; ++i) {
+			s->population[i].set_fitness(s->simulators[i]->get_fitness());
+		}
+		return stats;
+	}
+
+	System::EvaluationStats System::simulate_batch(System* s, uint32_t first, uint32_t last, uint32_t steps)
+	{
+		for (uint32_t i = first; i < last; ++i) {
+			if (s->population[i].get_unchanged_generations() >= s->jit_generations) s->population[i].compile_jit(s->fast_activation);
+		}
+
+		LockstepEvaluator evaluator{ s->population, first, last, s->fast_activation };
+		BatchSimulator& sim = *s->batch_simulator;
+
+		const uint32_t count = last - first;
+		std::vector<double> input_data(size_t(count) * (s->inputs - 1));
+		std::vector<double> output_data(size_t(count) * s->outputs);
+		std::vector<uint8_t> running(count, 1), terminal(count);
+		uint32_t still_running = count;
+		EvaluationStats stats{};
+
+		for (uint32_t step = 0; step < steps; ++step) {
+			sim.is_terminal(first, last, terminal.data());
+			for (uint32_t k = 0; k < count; ++k) {
+				if (!running[k] || !terminal[k]) continue;
+				evaluator.retire(s->population, first + k);
+				running[k] = 0;
+				still_running--;
+				stats.saved += steps - step;
+				stats.ended_early++;
+			}
+			if (still_running == 0) break;
+			stats.timesteps += still_running;
+
+			sim.get_inputs_to_network(first, last, input_data.data());
+			evaluator.calculate(input_data.data(), output_data.data());
+			sim.update_with_network_output(first, last, output_data.data(), running.data());
+		}
+
+		evaluator.store_state(s->population);
+		std::vector<double> fitness(count);
+		sim.get_fitness(first, last, fitness.data());
+		for (uint32_t i = first; i < last; ++i) s->population[i].set_fitness(fitness[i - first]);
+		return stats;
 	}
 
-	void System::simulate_subset(System* s, uint32_t first, uint32_t last, uint32_t steps)
+	System::EvaluationStats System::simulate_precision(System* s, uint32_t first, uint32_t last, uint32_t steps)
 	{
+		EvaluationStats stats{};
 		for (uint32_t i = first; i < last; ++i) {
-			s->population[i].simulate(s->simulators[i], steps);
+			const uint32_t ran = NEAT::simulate(s->population[i], *s->simulators[i], steps, s->precision);
+			stats.timesteps += ran;
+			if (ran < steps) {
+				stats.saved += steps - ran;
+				stats.ended_early++;
+			}
 		}
+		return stats;
+	}
+
+	System::EvaluationStats System::simulate_dataset(System* s, uint32_t first, uint32_t last)
+	{
+		const Dataset& data = *s->dataset;
+		std::vector<double> output_data(size_t(data.rows()) * s->outputs);
+
+		// each case is one row of a single timestep, so a genome costs one dense pass over its connections
+		for (uint32_t i = first; i < last; ++i) {
+			const Phenotype phenotype{ s->population[i], s->fast_activation };
+			BatchEvaluator evaluator{ phenotype, data.rows() };
+			evaluator.calculate(data.inputs(), output_data.data());
+			s->population[i].set_fitness(data.score(output_data.data()));
+		}
+
+		EvaluationStats stats{};
+		stats.timesteps = uint64_t(last - first) * data.rows();
+		return stats;
 	}
 
 	void System::produce_next_generation()
 	{
 		//if (generation == 33) __debugbreak();
+		seed_stream(Stream::selection, 0);
 		speciate();
 		update_reps();
 		fitness_sharing();
@@ -221,57 +570,458 @@ namespace NEAT {
 		assign_offspring();
 		cull_population();
 
-		// now in a state to produce the next generation
-		std::vector<Network> new_population;
-		std::vector<Network> copy_unchanged; // the best nets from the species with 5 or more
+		// now in a state to produce the next generation.
+		// the parents of every child are chosen here, the children are then built in parallel
+		std::vector<Offspring> plan;
+		std::vector<uint32_t> copy_unchanged; // the best nets from the species with 5 or more
 
 		uint32_t spec_index = 0;
 		for (uint32_t spec = 0; spec < species.size(); ++spec) {
 			if (species[spec].count > 0) {
 				uint32_t spec_len = species[spec].count - uint32_t(species[spec].count * (1 - keep)); // before amount - amount culled
 				if (species[spec].count >= 5 && species[spec].offspring > 0) {
-					copy_unchanged.push_back(population[spec_index + spec_len - 1]);
+					copy_unchanged.push_back(spec_index + spec_len - 1);
 					species[spec].offspring--;
 				}
 
 				for (uint32_t i = 0; i < species[spec].offspring; ++i) {
 					if (System::rand_dist(System::rand_gen) > crossover_rate) // mutation without crossover: copy random one
-						new_population.push_back(population[spec_index + random_int(spec_len - 1)]);
+						plan.push_back(Offspring{ spec_index + random_int(spec_len - 1), 0, false });
 
 					else {
 						uint32_t lnet = spec_index + random_int(spec_len - 1);
 						uint32_t rnet = spec_index + random_int(spec_len - 1);
-						new_population.push_back(population[lnet].cross(population[rnet], disable_thresh));
+						plan.push_back(Offspring{ lnet, rnet, true });
 					}
 				}
 				spec_index += spec_len;
 			}
 		}
-		
-		for (Network& net : new_population) {
-			net.mutate(*this, node_mut, conn_mut, weight_mut, mut_uniform, weight_err);
+
+		// mutated children, then the unchanged copies, then new networks
+		// if there are species that were not allowed to reproduce.
+		// they are built over the networks of the spare buffer, reusing their memory, which then becomes the population
+		const uint32_t children = uint32_t(plan.size());
+		const uint32_t first_new = children + uint32_t(copy_unchanged.size());
+		std::vector<Network>& next = spare_population;
+		const uint32_t count = std::max(size, first_new);
+		if (next.size() > count) next.erase(next.begin() + count, next.end());
+		while (next.size() < count) next.push_back(population.front());
+
+		for (uint32_t i = 0; i < copy_unchanged.size(); ++i) {
+			next[children + i] = population[copy_unchanged[i]];
+			next[children + i].increment_unchanged_generations();
 		}
 
-		for (const Network& net : copy_unchanged) {
-			new_population.push_back(net);
+		produce_offspring(plan, next, first_new);
+
+		// the parents become the spare buffer for the next generation
+		population.swap(next);
+		if (!shared_innovations) innovations->next_generation(population);
+		steady.evaluated.clear();
+		generation++;
+	}
+
+	uint32_t System::immigrate(const std::vector<Network>& migrants)
+	{
+		if (migrants.size() >= size) throw std::runtime_error("More migrants than a NEAT::System can take");
+
+		// the least fit first, ties broken by index so that seeded runs replace the same genomes
+		std::vector<uint32_t> order(size);
+		std::iota(order.begin(), order.end(), 0);
+		std::partial_sort(order.begin(), order.begin() + migrants.size(), order.end(), [&](uint32_t a, uint32_t b) {
+			const double fa = population[a].get_raw_fitness(), fb = population[b].get_raw_fitness();
+			return fa < fb || (fa == fb && a < b);
+		});
+		uint32_t fitter = 0;
+		for (uint32_t i = 0; i < migrants.size(); ++i) {
+			if (migrants[i].get_raw_fitness() > population[order[i]].get_raw_fitness()) fitter++;
+			population[order[i]] = migrants[i];
+		}
+		steady.evaluated.clear();
+		return fitter;
+	}
+
+	void System::produce_offspring(const std::vector<Offspring>& plan, std::vector<Network>& slots, uint32_t first_new)
+	{
+		std::vector<uint32_t> jobs; // the slots to fill
+		for (uint32_t i = 0; i < plan.size(); ++i) jobs.push_back(i);
+		for (uint32_t i = first_new; i < slots.size(); ++i) jobs.push_back(i);
+
+		const uint32_t threads = worker_threads(uint32_t(jobs.size()));
+
+		// fills slot of the new generation in child, drawing from this thread's stream and adding to batch
+		auto build = [&](uint32_t slot, Network& child) {
+			if (slot < plan.size()) {
+				seed_stream(Stream::offspring, slot);
+				const Offspring& o = plan[slot];
+				if (o.cross) population[o.lhs].cross(population[o.rhs], disable_thresh, child);
+				else child = population[o.lhs];
+				child.mutate(*this, node_mut, conn_mut, weight_mut, mut_uniform, weight_err, act_mut);
+			}
+			else {
+				seed_stream(Stream::new_network, slot);
+				child = Network{ *this, inputs, outputs, weight_err };
+			}
+		};
+
+		// measuring, the same children on this thread alone first, into copies of the slots so that they start
+		// from the same memory, each with an innovation batch of its own so that the registry is left alone
+		double serial_build = 0;
+		if (measure_serial_reproduction) {
+			std::vector<Network> scratch{ slots };
+			const auto serial_start = std::chrono::steady_clock::now();
+			std::vector<InnovationBatch> scratch_batches(jobs.size(), InnovationBatch{ *innovations, innovations->get_count() });
+			for (uint32_t j = 0; j < jobs.size(); ++j) {
+				batch = &scratch_batches[j];
+				build(jobs[j], scratch[jobs[j]]);
+			}
+			batch = nullptr;
+			serial_build = std::chrono::duration<double>(std::chrono::steady_clock::now() - serial_start).count();
 		}
 
-		// if there are species that were not allowed to reproduce
-		while (new_population.size() < size) {
-			new_population.push_back(Network{ *this, inputs, outputs, weight_err });
+		const auto start = std::chrono::steady_clock::now();
+
+		// in a seeded run the registry is left alone while the children are built: each child's new
+		// innovations go into its own batch, and are numbered below in slot order
+		std::vector<InnovationBatch> batches;
+		if (seeded) batches.assign(jobs.size(), InnovationBatch{ *innovations, innovations->get_count() });
+
+		// System::rand_gen is thread_local, so every worker draws from its own stream. each child is timed
+		// for the estimate, unless the serial time was measured
+		std::vector<double> work(threads);
+		const bool estimate = !measure_serial_reproduction;
+		parallel_for(*pool, uint32_t(jobs.size()), threads, [&](uint32_t j, uint32_t t) {
+			const auto child_start = estimate ? std::chrono::steady_clock::now() : start;
+			if (seeded) batch = &batches[j];
+			build(jobs[j], slots[jobs[j]]);
+			batch = nullptr;
+			if (estimate) work[t] += std::chrono::duration<double>(std::chrono::steady_clock::now() - child_start).count();
+		});
+
+		// the numbering runs on one thread either way, so a measured serial time includes it
+		const auto numbering = std::chrono::steady_clock::now();
+		for (uint32_t j = 0; j < batches.size(); ++j) {
+			if (!batches[j].empty()) slots[jobs[j]].renumber_innovations(batches[j].get_first_provisional(), batches[j].resolve(*innovations));
 		}
+		const auto end = std::chrono::steady_clock::now();
 
-		population = new_population;
-		generation++;
+		reproduction_stats.threads = threads;
+		reproduction_stats.wall_time = std::chrono::duration<double>(end - start).count();
+		reproduction_stats.measured = measure_serial_reproduction;
+		reproduction_stats.serial_time = estimate ? std::accumulate(work.begin(), work.end(), 0.0)
+			: serial_build + std::chrono::duration<double>(end - numbering).count();
+	}
+
+	void System::steady_state(uint32_t timesteps, uint32_t replacements)
+	{
+		if (dataset) throw std::runtime_error("NEAT::System::steady_state needs simulators, not a dataset");
+		const auto start = std::chrono::steady_clock::now();
+
+		// the population may be new from produce_next_generation or a checkpoint, so every genome is placed again
+		speciate();
+		if (steady.evaluated.size() != population.size()) steady.evaluated.assign(population.size(), 0);
+		steady.busy.assign(population.size(), 0);
+		steady.raw.resize(population.size());
+		steady.species.resize(population.size());
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			steady.raw[i] = population[i].get_raw_fitness();
+			steady.species[i] = population[i].get_species();
+		}
+
+		// a random member of each species represents it from now on, as update_reps does, without reordering the slots
+		std::vector<uint32_t> seen(species.size(), 0);
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			const uint32_t s = steady.species[i];
+			if (random_int(++seen[s]) == 0) species[s].set_rep(population[i]);
+		}
+		steady.reps.resize(species.size());
+		for (uint32_t s = 0; s < species.size(); ++s) steady.reps[s].assign(species[s].get_rep().get_genome());
+		steady.fitness.assign(species.size(), 0);
+		steady.members.assign(species.size(), 0);
+
+		std::vector<uint32_t> queue; // the genomes to evaluate before any is replaced
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			if (steady.evaluated[i]) tally(i, 1);
+			else queue.push_back(i);
+		}
+
+		std::mutex lock; // guards everything but the networks held busy, and the simulators
+		uint32_t queued = 0, made = 0;
+		steady_state_stats = SteadyStateStats{};
+		evaluation_stats = EvaluationStats{};
+
+		pool->run(pool->size(), 1, 0, [&](uint32_t, uint32_t, uint32_t) {
+			std::vector<GenomeKey> keys; // of the batch's children
+			double waited = 0;
+			auto acquire = [&](std::unique_lock<std::mutex>& guard) {
+				const auto wait_start = std::chrono::steady_clock::now();
+				guard.lock();
+				waited += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+			};
+
+			std::vector<uint32_t> slots; // the batch
+			std::vector<Offspring> plan;
+
+			std::unique_lock<std::mutex> guard{ lock, std::defer_lock };
+			acquire(guard);
+			for (;;) {
+				slots.clear();
+				plan.clear();
+				if (queued < queue.size()) {
+					while (queued < queue.size() && slots.size() < steady_batch) {
+						slots.push_back(queue[queued++]);
+						steady.busy[slots.back()]++;
+					}
+				}
+				else if (made < replacements) {
+					// none taken if the rest are all held by other workers
+					if (steady_state_replacements(std::min(steady_batch, replacements - made), slots, plan) == 0) break;
+					made += uint32_t(slots.size());
+				}
+				else break;
+				guard.unlock();
+
+				if (!plan.empty()) {
+					// the parents are held busy, so nothing replaces them while they are read
+					for (uint32_t k = 0; k < slots.size(); ++k) {
+						const Offspring& o = plan[k];
+						Network& child = population[slots[k]];
+						if (o.cross) population[o.lhs].cross(population[o.rhs], disable_thresh, child);
+						else child = population[o.lhs];
+						child.mutate(*this, node_mut, conn_mut, weight_mut, mut_uniform, weight_err, act_mut);
+						if (keys.size() <= k) keys.emplace_back();
+						keys[k].assign(child.get_genome());
+					}
+
+					acquire(guard);
+					for (uint32_t k = 0; k < slots.size(); ++k) {
+						const Offspring& o = plan[k];
+						steady.busy[o.lhs]--;
+						if (o.cross) steady.busy[o.rhs]--;
+
+						const uint32_t i = slots[k];
+						const uint32_t s = find_compatible(keys[k], steady.reps, spec_c1, spec_c2, spec_c3, spec_thresh);
+						population[i].set_species(s);
+						steady.species[i] = s;
+						if (s == species.size()) {
+							species.emplace_back(Species{ population[i] });
+							steady.reps.push_back(keys[k]);
+							steady.fitness.push_back(0);
+							steady.members.push_back(0);
+						}
+						species[s].count++;
+						steady_state_stats.replacements++;
+
+						if (++steady.replacements == size) {
+							steady.replacements = 0;
+							generation++;
+						}
+					}
+					guard.unlock();
+				}
+
+				// one genome at a time: a batch is too small for the lockstep evaluator to find genomes to group
+				EvaluationStats ran{};
+				for (uint32_t i : slots) {
+					simulators[i]->reset();
+					const uint32_t steps = precision == Precision::double_precision ? population[i].simulate(*simulators[i], timesteps)
+						: NEAT::simulate(population[i], *simulators[i], timesteps, precision);
+					ran.timesteps += steps;
+					if (steps < timesteps) {
+						ran.saved += timesteps - steps;
+						ran.ended_early++;
+					}
+				}
+
+				acquire(guard);
+				evaluation_stats.timesteps += ran.timesteps;
+				evaluation_stats.saved += ran.saved;
+				evaluation_stats.ended_early += ran.ended_early;
+				for (uint32_t i : slots) {
+					steady.busy[i]--;
+					steady.evaluated[i] = 1;
+					steady.raw[i] = population[i].get_raw_fitness();
+					tally(i, 1);
+					population[i].adjust_fitness(*this); // while no other worker can read it
+					max_fitness = std::max(max_fitness, population[i].get_raw_fitness());
+					steady_state_stats.evaluations++;
+				}
+			}
+			steady_state_stats.lock_wait += waited;
+		});
+
+		if (!shared_innovations) innovations->next_generation(population);
+		steady_state_stats.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void System::tally(uint32_t i, int sign)
+	{
+		steady.fitness[steady.species[i]] += sign * steady.raw[i];
+		steady.members[steady.species[i]] += sign;
+	}
+
+	uint32_t System::steady_state_replacements(uint32_t count, std::vector<uint32_t>& victims, std::vector<Offspring>& plan)
+	{
+		// the evaluated genomes with the lowest shared fitness, shared among their species as the batch starts.
+		// genomes held busy are being read as parents. another free evaluated genome has to be left over, or there
+		// would be nothing to breed the replacements from
+		std::vector<std::pair<double, uint32_t>>& free = steady.free;
+		free.clear();
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			if (steady.evaluated[i] && !steady.busy[i]) free.emplace_back(steady.raw[i] / species[steady.species[i]].count, i);
+		}
+		if (free.size() < 2) return 0;
+		const uint32_t taken = std::min(count, uint32_t(free.size()) - 1);
+		std::partial_sort(free.begin(), free.begin() + taken, free.end());
+
+		for (uint32_t k = 0; k < taken; ++k) {
+			const uint32_t victim = free[k].second;
+			victims.push_back(victim);
+			tally(victim, -1);
+			steady.evaluated[victim] = 0;
+			steady.busy[victim]++;
+			Species& old = species[steady.species[victim]];
+			if (--old.count == 0) old.fitness_log.clear();
+		}
+
+		// each child's species in proportion to the average fitness of its evaluated members. the free genome left
+		// over belongs to one of them
+		double total = 0;
+		uint32_t reproducing = 0;
+		for (uint32_t s = 0; s < species.size(); ++s) {
+			if (steady.members[s] == 0) continue;
+			total += steady.fitness[s] / steady.members[s];
+			reproducing++;
+		}
+		if (reproducing == 0) throw std::runtime_error("No NEAT species left to reproduce in steady state");
+		std::vector<uint32_t>& chosen = steady.chosen;
+		std::vector<uint8_t>& choosing = steady.choosing;
+		chosen.clear();
+		choosing.assign(species.size(), 0);
+		for (uint32_t k = 0; k < taken; ++k) {
+			double pick = total > 0 ? System::rand_dist(System::rand_gen) * total : double(random_int(reproducing - 1));
+			uint32_t spec = 0;
+			for (uint32_t s = 0; s < species.size(); ++s) {
+				if (steady.members[s] == 0) continue;
+				spec = s;
+				if ((pick -= total > 0 ? steady.fitness[s] / steady.members[s] : 1) < 0) break;
+			}
+			chosen.push_back(spec);
+			choosing[spec] = 1;
+		}
+
+		// the parents come from the fittest of each species' evaluated members, as many as the generational mode
+		// keeps. the candidates are grouped by species, and each chosen species' fittest moved to the front of its group
+		std::vector<uint32_t>& candidates = steady.candidates;
+		std::vector<uint32_t>& group = steady.group;
+		group.assign(species.size() + 1, 0);
+		for (uint32_t s = 0; s < species.size(); ++s) group[s + 1] = group[s] + (choosing[s] ? steady.members[s] : 0);
+		candidates.resize(group.back());
+		for (uint32_t i = 0; i < population.size(); ++i) {
+			if (steady.evaluated[i] && choosing[steady.species[i]]) candidates[group[steady.species[i]]++] = i;
+		}
+		// each start has moved on to the next one's
+		std::copy_backward(group.begin(), group.end() - 1, group.end());
+		group[0] = 0;
+		for (uint32_t s = 0; s < species.size(); ++s) {
+			if (!choosing[s]) continue;
+			const auto first = candidates.begin() + group[s], last = candidates.begin() + group[s + 1];
+			const uint32_t kept = std::max(uint32_t((last - first) * keep), 1u);
+			std::nth_element(first, first + (kept - 1), last, [&](uint32_t a, uint32_t b) { return steady.raw[a] > steady.raw[b]; });
+		}
+
+		for (uint32_t spec : chosen) {
+			const uint32_t* first = candidates.data() + group[spec];
+			const uint32_t kept = std::max(uint32_t((group[spec + 1] - group[spec]) * keep), 1u);
+
+			Offspring o{ first[random_int(kept - 1)], 0, false };
+			if (System::rand_dist(System::rand_gen) <= crossover_rate) {
+				o.rhs = first[random_int(kept - 1)];
+				o.cross = true;
+				steady.busy[o.rhs]++;
+			}
+			steady.busy[o.lhs]++;
+			plan.push_back(o);
+		}
+		return taken;
+	}
+
+	void System::save_checkpoint(std::ostream& os) const
+	{
+		os << "checkpoint " << inputs << ' ' << outputs << ' ' << size << ' ' << generation << ' '
+			<< seeded << ' ' << seed << ' ';
+		checkpoint::write_double(os, spec_thresh);
+		os << '\n';
+
+		os << "species " << species.size() << '\n';
+		for (const Species& s : species) {
+			os << s.count << ' ' << s.offspring << ' ' << s.fitness_log.size();
+			for (double f : s.fitness_log) {
+				os << ' ';
+				checkpoint::write_double(os, f);
+			}
+			os << '\n';
+			s.get_rep().save(os);
+		}
+
+		os << "population\n";
+		for (const Network& net : population) net.save(os);
+
+		innovations->save(os);
+	}
+
+	void System::load_checkpoint(std::istream& is)
+	{
+		checkpoint::expect(is, "checkpoint");
+		if (checkpoint::read<uint32_t>(is) != inputs || checkpoint::read<uint32_t>(is) != outputs || checkpoint::read<uint32_t>(is) != size) {
+			throw std::runtime_error("Checkpoint from a differently sized NEAT::System");
+		}
+		const uint32_t new_generation = checkpoint::read<uint32_t>(is);
+		const bool new_seeded = checkpoint::read<bool>(is);
+		const uint64_t new_seed = checkpoint::read<uint64_t>(is);
+		const double new_spec_thresh = checkpoint::read_double(is);
+
+		std::vector<Species> new_species;
+		checkpoint::expect(is, "species");
+		const size_t species_count = checkpoint::read<size_t>(is);
+		for (size_t i = 0; i < species_count; ++i) {
+			const uint32_t count = checkpoint::read<uint32_t>(is);
+			const uint32_t offspring = checkpoint::read<uint32_t>(is);
+			std::vector<double> fitness_log(checkpoint::read<size_t>(is));
+			for (double& f : fitness_log) f = checkpoint::read_double(is);
+
+			new_species.emplace_back(Species{ Network::load(is) });
+			new_species.back().count = count;
+			new_species.back().offspring = offspring;
+			new_species.back().fitness_log = std::move(fitness_log);
+		}
+
+		std::vector<Network> new_population;
+		checkpoint::expect(is, "population");
+		for (uint32_t i = 0; i < size; ++i) new_population.push_back(Network::load(is));
+
+		innovations->load(is);
+
+		generation = new_generation;
+		seeded = new_seeded;
+		seed = new_seed;
+		spec_thresh = new_spec_thresh;
+		species = std::move(new_species);
+		population = std::move(new_population);
+		steady.evaluated.clear();
 	}
 
 	std::ostream& System::log(std::ostream& os)
 	{
 		mean_fitness = 0;
 		mean_hidden_nodes = 0;
+		double mean_memory = 0, mean_genes = 0;
 		for (const Network& net : population) {
 			mean_fitness += net.get_raw_fitness() / size;
 			mean_hidden_nodes += double(net.get_hidden_nodes()) / size;
+			mean_memory += double(net.memory_footprint()) / size;
+			mean_genes += double(net.get_genome().size()) / size;
 		}
 
 		max_fitness = std::max_element(population.begin(), population.end(), [](const Network& a, const Network& b)
@@ -283,7 +1033,38 @@ namespace NEAT {
 		os << "Species:           " << std::count_if(species.begin(), species.end(), [](const Species& s) { return s.count > 0; }) << '\n';
 		os << "Spec. Threshold:   " << spec_thresh << '\n';
 		os << "Max fitness:       " << max_fitness << "\n";
-		os << "Genes:             " << genes.size() << "\n\n";
+		os << "Genes:             " << innovations->size() << "\n";
+		os << "Network memory:    " << mean_memory << " bytes on average, for " << mean_genes << " genes of "
+			<< sizeof(Connection) << " bytes\n";
+		os << "Reproduction:      " << reproduction_stats.wall_time * 1000 << " ms on " << reproduction_stats.threads << " threads, "
+			<< (reproduction_stats.measured ? "a measured " : "an estimated ") << reproduction_stats.speedup()
+			<< "x building the children on one thread\n";
+		os << "Speciation:        " << speciation_stats.wall_time * 1000 << " ms on " << speciation_stats.threads << " threads, "
+			<< speciation_stats.computed << " distances computed, " << speciation_stats.cached << " cached, "
+			<< speciation_stats.pruned << " pruned\n";
+		os << "Evaluation:        " << evaluation_stats.timesteps << " timesteps run, " << evaluation_stats.saved << " ("
+			<< 100 * evaluation_stats.saved_fraction() << "%) saved by " << evaluation_stats.ended_early << " episodes ending early\n";
+		if (steady_state_stats.evaluations > 0) {
+			os << "Steady state:      " << steady_state_stats.evaluations << " evaluations, " << steady_state_stats.replacements
+				<< " replacements in " << steady_state_stats.wall_time * 1000 << " ms, " << steady_state_stats.lock_wait * 1000
+				<< " ms waiting for the bookkeeping\n";
+		}
+
+		// the pool's stats cover everything it ran since the last log
+		const std::vector<ThreadPool::WorkerStats>& workers = pool->get_stats();
+		double busy = 0, idle = 0, least = 1;
+		uint64_t chunks = 0, stolen = 0;
+		for (const ThreadPool::WorkerStats& w : workers) {
+			busy += w.busy;
+			idle += w.idle;
+			least = std::min(least, w.utilisation());
+			chunks += w.chunks;
+			stolen += w.stolen;
+		}
+		os << "Thread pool:       " << workers.size() << " workers, " << (busy + idle > 0 ? 100 * busy / (busy + idle) : 100)
+			<< "% busy (least " << 100 * least << "%), " << idle * 1000 << " ms idle, " << stolen << " of " << chunks << " chunks stolen\n";
+		pool->reset_stats();
+		os << "Compiled networks: " << std::count_if(population.begin(), population.end(), [](const Network& n) { return n.is_jit_compiled(); }) << "\n\n";
 
 		if (&os != &std::cout) {
 			std::cout << generation << '\r';
@@ -301,32 +1082,52 @@ namespace NEAT {
 
 	void System::simulate_population(uint32_t timesteps)
 	{
-		for (uint32_t i = 0; i < size; ++i) {
-			population[i].simulate(simulators[i], timesteps);
-		}
+		evaluation_stats = simulate_subset(this, 0, size, timesteps);
 	}
 
 	void System::simulate_multithread(uint32_t timesteps)
 	{
-		uint32_t cores = std::thread::hardware_concurrency();
-		if (cores == 0) cores = 8;
-		const uint32_t num = size / cores; // # of population to run on each core
-
-		std::vector<std::thread> threads;
-		for (uint32_t i = 0; i < cores; ++i) {
-			uint32_t first = i * num;
-			uint32_t last = (i + 1) * num;
-			if ((i + 1) == cores) last = size;
-			threads.emplace_back(std::thread(&System::simulate_subset, this, first,
-				last, timesteps));
+		if (process_pool && !dataset && precision == Precision::double_precision) {
+			const std::vector<uint32_t>& ran = process_pool->evaluate(population, timesteps,
+				ProcessPool::Settings{ simulator_resets, jit_generations, fast_activation });
+			evaluation_stats = EvaluationStats{};
+			for (uint32_t steps : ran) {
+				evaluation_stats.timesteps += steps;
+				if (steps < timesteps) {
+					evaluation_stats.saved += timesteps - steps;
+					evaluation_stats.ended_early++;
+				}
+			}
+			return;
 		}
 
-		for (std::thread& t : threads) t.join();
+		// evaluation times vary with the topology and the length of each episode, so each worker's share of the
+		// population is split in two, and the halves can be stolen
+		const uint32_t chunk = std::max(size / (pool->size() * 2), genomes_per_chunk);
+		std::vector<EvaluationStats> counts(pool->size(), EvaluationStats{});
+		pool->run(size, chunk, 0, [&](uint32_t first, uint32_t last, uint32_t worker) {
+			const EvaluationStats c = simulate_subset(this, first, last, timesteps);
+			counts[worker].timesteps += c.timesteps;
+			counts[worker].saved += c.saved;
+			counts[worker].ended_early += c.ended_early;
+		});
+
+		evaluation_stats = EvaluationStats{};
+		for (const EvaluationStats& c : counts) {
+			evaluation_stats.timesteps += c.timesteps;
+			evaluation_stats.saved += c.saved;
+			evaluation_stats.ended_early += c.ended_early;
+		}
 	}
 
 
 	void System::reset_simulators()
 	{
+		simulator_resets++;
+		if (batch_simulator) {
+			batch_simulator->reset(0, size);
+			return;
+		}
 		for (auto& sim : simulators) {
 			sim->reset();
 		}
@@ -5,16 +5,23 @@
 #include <algorithm>
 #include <numeric>
 #include <thread>
+#include <optional>
 
 #include "network.h"
 #include "connection.h"
 #include "simulator.h"
+#include "innovation.h"
+#include "random_stream.h"
+#include "species.h"
+#include "thread_pool.h"
 
 namespace NEAT {
 	double modified_sigmoid(double input);
 	double act_func(double input);
+	float modified_sigmoid(float input);
+	float act_func(float input);
 	double random(double thresh);
-	uint32_t random_int(uint32_t ulim); // inclusive
+	uint32_t random_int(uint32_t ulim); // 0 to ulim - 1
 
 	// checks if v2 is a subset of v1
 	template <typename T>
@@ -27,6 +34,10 @@ namespace NEAT {
 
 	class Network;
 	class Simulator;
+	class BatchSimulator;
+	class Dataset;
+	class ProcessPool;
+	enum class Precision;
 
 	struct Species {
 		Species(const Network& net);
@@ -45,13 +56,33 @@ namespace NEAT {
 
 	class System {
 	public:
-		static std::default_random_engine rand_gen;
-		static std::uniform_real_distribution<double> rand_dist;
+		// one stream per thread, so that offspring can be produced in parallel.
+		// seeded runs restart it at a known key before every operation that draws from it
+		static thread_local RandomStream rand_gen;
+		static thread_local std::uniform_real_distribution<double> rand_dist;
 
 		System(uint32_t size, uint32_t inputs, uint32_t outputs, double err);
+
+		// systems can share one registry, so that their genomes number innovations the same way
+		System(uint32_t size, uint32_t inputs, uint32_t outputs, double err, std::shared_ptr<InnovationRegistry> innovations);
 		void init_simulators(const std::vector<std::shared_ptr<Simulator>>& sims);
 
-		uint32_t get_innov_number(const Connection& gene);
+		// steps the population's environments a block at a time through sim, which needs at least size of them.
+		// replaces the simulators given to init_simulators, and is replaced by them in turn
+		void init_simulators(std::shared_ptr<BatchSimulator> sim);
+
+		// scores every genome on data's cases instead (see Dataset), whatever the timesteps simulated, and replaces
+		// the simulators in turn. the genomes' states are left as they were. steady_state needs simulators
+		void init_dataset(std::shared_ptr<Dataset> data);
+
+		// safe to call from several threads at once
+		uint32_t get_innov_number(const Connection& gene) { return batch ? batch->get(gene) : innovations->get(gene); }
+		const InnovationRegistry& get_innovations() const { return *innovations; }
+
+		// for systems evolving at the same time on one registry (see island.h): none of them rebuilds a
+		// per-generation table from its own population, as the others still need their pairs. whoever runs
+		// them rebuilds it from all of their populations between generations instead
+		void set_shared_innovations(bool shared) { shared_innovations = shared; }
 
 		std::vector<Network>& get_population() { return population; }
 		const std::vector<Network>& get_population() const { return population; }
@@ -62,8 +93,50 @@ namespace NEAT {
 		void simulate_multithread(uint32_t timesteps);
 		void reset_simulators();
 
+		// the timesteps run by the last simulation of the population (or call to steady_state), and those
+		// skipped because a simulator reported a terminal state (see Simulator::is_terminal)
+		struct EvaluationStats {
+			uint64_t timesteps;
+			uint64_t saved;
+			uint32_t ended_early; // episodes that ended before the last timestep
+
+			double saved_fraction() const { return timesteps + saved > 0 ? double(saved) / (timesteps + saved) : 0; }
+		};
+		const EvaluationStats& get_evaluation_stats() const { return evaluation_stats; }
+
 		void produce_next_generation();
 
+		// replaces the genomes with the lowest raw fitness with migrants, fitness and all, for a simulated
+		// population that has yet to produce its next generation. they are speciated with the rest.
+		// returns how many of them were fitter than the genome they replaced
+		uint32_t immigrate(const std::vector<Network>& migrants);
+
+		// Real-time NEAT (Stanley et al. 2005): evolution with no generation barrier, in place of simulating
+		// the population and producing the next generation. Each of the pool's workers takes a batch of
+		// genomes at a time (see set_steady_state_batch), and evaluates each for timesteps steps from a reset
+		// simulator. Genomes not yet evaluated go first. After that, each time a worker finishes a batch, the
+		// evaluated genomes with the lowest shared fitness are replaced by offspring of species chosen in
+		// proportion to their average fitness, and the same worker evaluates them. Species counts and fitness
+		// totals are kept up to date as genomes come and go.
+		// each call starts by speciating the whole population and picking new representatives, as a generation
+		// does, which is also the only time the compatibility threshold moves, so call it with size replacements
+		// for it to move once a generation. it returns once replacements offspring have been made and evaluated.
+		// every size replacements count as a generation. results depend on thread timing, so this mode can't be
+		// replayed
+		void steady_state(uint32_t timesteps, uint32_t replacements);
+
+		// the genomes a steady_state worker replaces and evaluates at a time, 8 by default. larger batches share
+		// out the bookkeeping, but breed from rankings that are older
+		void set_steady_state_batch(uint32_t genomes) { steady_batch = std::max(genomes, 1u); }
+
+		struct SteadyStateStats {
+			uint64_t evaluations;
+			uint64_t replacements;
+			double wall_time; // seconds spent in the last call to steady_state
+			double lock_wait; // seconds the workers spent waiting for the bookkeeping, summed
+		};
+		const SteadyStateStats& get_steady_state_stats() const { return steady_state_stats; }
+
 		std::ostream& log(std::ostream&);
 		double get_max_fitness() const { return max_fitness; }
 		double get_mean_fitness() const { return mean_fitness; }
@@ -71,17 +144,91 @@ namespace NEAT {
 
 		std::ostream& dump_fittest(std::ostream&);
 
+		// the probability that an offspring has one node's activation function changed (0 keeps every node sigmoid)
+		void set_activation_mutation(double probability) { act_mut = probability; }
+		// evaluate with the polynomial activation kernels (see activation.h) rather than the standard library
+		void set_fast_activation(bool fast) { fast_activation = fast; }
+		// evaluate each genome on its own with its weights and activations in precision (see precision.h), rather
+		// than double. a dataset is still scored in double, and simulate_multithread keeps to the thread pool
+		void set_precision(Precision p) { precision = p; }
+
+		// the number of threads in the pool, counting the caller, that evaluate, speciate and reproduce.
+		// 0 for one per core, the default. replaces the pool, so its stats start again
+		void set_threads(uint32_t threads);
+		const ThreadPool& get_thread_pool() const { return *pool; }
+
+		// simulate_multithread sends the genomes to worker processes instead of the thread pool (see
+		// process_pool.h), which run them on simulators of their own, made by the pool's factory and reset as
+		// often as this System's have been. nullptr goes back to the thread pool. a dataset, or a precision
+		// below double, is evaluated here regardless. steady_state and simulate_population still evaluate in
+		// this process
+		void set_process_pool(std::shared_ptr<ProcessPool> processes) { process_pool = processes; }
+
+		// the number of threads speciating and producing offspring, 0 for every thread in the pool.
+		// the pool grows if it has fewer
+		void set_reproduction_threads(uint32_t threads);
+
+		// after building each generation's children, build them again on this thread alone into scratch networks,
+		// timing the same work for ReproductionStats::serial_time. it doubles the cost of reproduction, and leaves
+		// the children, the innovations and a seeded run's random numbers as they would have been
+		void set_measure_serial_reproduction(bool measure) { measure_serial_reproduction = measure; }
+
+		struct SpeciationStats {
+			uint32_t threads;
+			double wall_time; // seconds spent speciating the last generation
+			uint64_t computed; // compatibility distances computed in full
+			uint64_t cached; // distances found in the cache from the generation before
+			uint64_t pruned; // representatives ruled out by distance_lower_bound
+		};
+		const SpeciationStats& get_speciation_stats() const { return speciation_stats; }
+
+		struct ReproductionStats {
+			uint32_t threads;
+			double wall_time; // seconds spent producing the last generation's offspring
+			double serial_time; // measured, the seconds the same children took on one thread. otherwise the sum of
+			                    // the time spent on each child, as long as every thread has a core to itself
+			bool measured; // whether serial_time was measured, by set_measure_serial_reproduction
+
+			// it covers building the children only: choosing the parents and numbering a seeded run's innovations
+			// run on one thread and are left out, so produce_next_generation as a whole gains less
+			double speedup() const { return wall_time > 0 ? serial_time / wall_time : 1; }
+		};
+		const ReproductionStats& get_reproduction_stats() const { return reproduction_stats; }
+
+		// A seeded run draws each operation's random numbers from its own stream, keyed by (seed, generation,
+		// genome index, operation), and numbers each generation's new innovations child by child in population
+		// order. Its results are the same for any number of reproduction threads, and can be replayed.
+		// set before the first generation, the seed also redraws the initial population
+		void set_seed(uint64_t new_seed);
+		bool is_seeded() const { return seeded; }
+		uint64_t get_seed() const { return seed; }
+
+		// the state at the start of a generation: the population, species, innovations and seed.
+		// the configuration (constructor arguments and setters) is not saved, so load into a System set up
+		// the same way. neither may run while a generation is being simulated or produced
+		void save_checkpoint(std::ostream& os) const;
+		void load_checkpoint(std::istream& is);
+
 	private:
 
 		std::vector<std::shared_ptr<Simulator>> simulators; // the data passed to the population for simulation
+		std::shared_ptr<BatchSimulator> batch_simulator; // if set, simulators are views of its environments
+		uint64_t simulator_resets; // by reset_simulators since init_simulators, for the process pool's workers
+		std::shared_ptr<Dataset> dataset; // if set, evaluates in place of the simulators
 		std::vector<Network> population;
 
+		// the other half of a double buffer with population: the last generation's parents and the genomes
+		// culled since. the next generation is built over these networks, reusing their memory, then swapped in
+		std::vector<Network> spare_population;
+		std::vector<Network> serial_population; // the scratch networks of set_measure_serial_reproduction
+
 		//std::vector<Network> species_reps; // the species representatives for each species
 		//std::vector<uint32_t> species_count; // the overall number of organisms in each species
 		//std::vector<std::vector<double>> fitness_trends; // uesd to decide whether to eliminate a species
 		std::vector<Species> species; // to replace the preceding 3 lines
 
-		std::vector<Connection> genes; // the current innovations of the population as a whole
+		std::shared_ptr<InnovationRegistry> innovations; // the current innovations of the population as a whole
+		bool shared_innovations;
 
 		uint32_t inputs, outputs; // number of input nodes and output nodes including bias
 		uint32_t size; // the overall population === population.size()
@@ -109,12 +256,72 @@ namespace NEAT {
 		double conn_mut;
 		double weight_mut;
 		double mut_uniform;
+		double act_mut;
 
 		double weight_err; // the error to mutate (+-weight_err)
+		double initial_err; // the range of the initial population's random weights
+
+		// species champions passed on unchanged for this many generations are compiled to native code
+		uint32_t jit_generations;
+		bool fast_activation;
+		Precision precision;
+
+		std::unique_ptr<ThreadPool> pool; // kept for the life of the system
+		std::shared_ptr<ProcessPool> process_pool;
+		uint32_t reproduction_threads;
+		bool measure_serial_reproduction;
+		uint32_t steady_batch;
+		ReproductionStats reproduction_stats;
+		SpeciationStats speciation_stats;
+		EvaluationStats evaluation_stats;
+		DistanceCache distance_cache; // from genomes to the representatives they were compared with
+
+		// kept between generations, so speciation reuses its memory rather than faulting in fresh pages each time
+		struct SpeciationBuffers {
+			std::vector<uint32_t> match, owner;
+			std::vector<DistanceCache::Record> records;
+			std::vector<std::vector<DistanceCache::Distance>> found; // one per thread
+			std::vector<DistanceCache::Distance> distances;
+			std::vector<GenomeKey> reps;
+			std::vector<GenomeKey> keys; // one per thread
+		};
+		SpeciationBuffers speciation_buffers;
+
+		// the bookkeeping of steady-state evolution. the evaluations carry over from one call of steady_state
+		// to the next, until produce_next_generation or a checkpoint replaces the population
+		struct SteadyState {
+			std::vector<uint8_t> evaluated; // by slot: whether population[i] has been evaluated since it was made
+			std::vector<uint32_t> busy; // by slot: being evaluated, replaced or read as a parent
+			std::vector<double> raw; // by slot: the raw fitness of population[i], once evaluated
+			std::vector<uint32_t> species; // by slot: the species of population[i]
+			std::vector<double> fitness; // by species: the raw fitness of its evaluated members, summed
+			std::vector<uint32_t> members; // by species: its evaluated members
+			std::vector<GenomeKey> reps;
+			std::vector<std::pair<double, uint32_t>> free; // (shared fitness, slot) of the genomes that may be replaced
+			std::vector<uint32_t> chosen; // the species of each child of a batch
+			std::vector<uint8_t> choosing; // by species: whether a child of the batch comes from it
+			std::vector<uint32_t> candidates; // parents to choose from, grouped by species
+			std::vector<uint32_t> group; // by species: where its candidates start, and one past the last
+			uint32_t replacements; // since the last generation was counted
+		};
+		SteadyState steady;
+		SteadyStateStats steady_state_stats;
+
+		bool seeded;
+		uint64_t seed;
+
+		// where the innovations of the child being built on this thread go, in a seeded run
+		static thread_local InnovationBatch* batch;
+
+		// restarts this thread's stream for op on population[index] this generation, in a seeded run
+		void seed_stream(Stream op, uint32_t index) const;
 
 		double mean_fitness, mean_hidden_nodes, max_fitness;
 
+		// genomes are compared with the representatives from the last generation in parallel, then the ones
+		// that matched none of them are placed one after another, as they may found new species
 		void speciate();
+		uint32_t worker_threads(uint32_t jobs) const; // how many threads to split jobs across
 		void update_reps(); // assumes speciated population
 		void fitness_sharing(); // carry out the fitness sharing algorithm (pg. 110)
 		void update_fitness_log(); // assumes freshly speciated population
@@ -124,7 +331,28 @@ namespace NEAT {
 
 		// assumes speciated population
 		void cull_population(); // removes the unfit genomes from the population
-		static void simulate_subset(System* s, uint32_t first, uint32_t last, uint32_t steps); // for multithreading
+
+		// a child of population[lhs], crossed with population[rhs] if cross is set
+		struct Offspring {
+			uint32_t lhs, rhs;
+			bool cross;
+		};
+
+		// fills the slots for plan, and the slots from first_new on with new networks, using several threads.
+		// each child is assigned or crossed into the network already in its slot
+		void produce_offspring(const std::vector<Offspring>& plan, std::vector<Network>& slots, uint32_t first_new);
+		static EvaluationStats simulate_subset(System* s, uint32_t first, uint32_t last, uint32_t steps); // for multithreading
+		static EvaluationStats simulate_batch(System* s, uint32_t first, uint32_t last, uint32_t steps); // simulate_subset with batch_simulator
+		static EvaluationStats simulate_dataset(System* s, uint32_t first, uint32_t last); // simulate_subset with dataset
+		static EvaluationStats simulate_precision(System* s, uint32_t first, uint32_t last, uint32_t steps); // simulate_subset below double
+
+		// steady state: adds or removes population[i]'s fitness to its species' totals
+		void tally(uint32_t i, int sign);
+
+		// steady state: takes up to count genomes to replace out of their species, appending them to victims, and
+		// picks the parents of their replacements, appending them to plan and holding them all busy. returns how
+		// many it took, 0 if every evaluated genome but one is already held
+		uint32_t steady_state_replacements(uint32_t count, std::vector<uint32_t>& victims, std::vector<Offspring>& plan);
 	};
 
 	template<typename Sim>
@@ -0,0 +1,144 @@
+#include "thread_pool.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace NEAT {
+	ThreadPool::ThreadPool(uint32_t workers)
+		:workers{ workers ? workers : std::max(std::thread::hardware_concurrency(), 1u) }, stats(this->workers, WorkerStats{}),
+		run_busy(this->workers), epoch{}, stopping{ false }, job{ nullptr }, taking_part{}, working{},
+		failed{ false }
+	{
+		queues = std::make_unique<Queue[]>(this->workers);
+		for (uint32_t w = 1; w < this->workers; ++w) threads.emplace_back(&ThreadPool::worker_loop, this, w);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard{ lock };
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : threads) t.join();
+	}
+
+	void ThreadPool::run(uint32_t count, uint32_t chunk, uint32_t workers, const Job& job)
+	{
+		if (count == 0) return;
+		const auto start = std::chrono::steady_clock::now();
+
+		const uint32_t taking = std::clamp(workers ? workers : this->workers, 1u, this->workers);
+		if (chunk == 0) chunk = std::max(count / (taking * 8), 1u);
+		const uint32_t chunk_count = (count - 1) / chunk + 1;
+
+		// worker w's block of chunks is the w-th of taking near equal blocks, in index order
+		for (uint32_t w = 0; w < taking; ++w) {
+			const uint32_t first = uint32_t(uint64_t(chunk_count) * w / taking);
+			const uint32_t last = uint32_t(uint64_t(chunk_count) * (w + 1) / taking);
+			std::lock_guard<std::mutex> guard{ queues[w].lock };
+			for (uint32_t c = first; c < last; ++c) {
+				queues[w].chunks.push_back(Range{ c * chunk, std::min(count, (c + 1) * chunk) });
+			}
+		}
+		std::fill(run_busy.begin(), run_busy.end(), 0.0);
+
+		{
+			std::lock_guard<std::mutex> guard{ lock };
+			this->job = &job;
+			taking_part = taking;
+			working = taking - 1;
+			error = nullptr;
+			failed = false;
+			epoch++;
+		}
+		if (taking > 1) wake.notify_all();
+
+		work(0);
+
+		std::unique_lock<std::mutex> guard{ lock };
+		done.wait(guard, [&] { return working == 0; });
+		this->job = nullptr;
+
+		const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (uint32_t w = 0; w < taking; ++w) {
+			stats[w].busy += run_busy[w];
+			stats[w].idle += std::max(wall - run_busy[w], 0.0);
+		}
+
+		if (error) {
+			for (uint32_t w = 0; w < taking; ++w) queues[w].chunks.clear();
+			std::rethrow_exception(error);
+		}
+	}
+
+	void ThreadPool::reset_stats()
+	{
+		std::fill(stats.begin(), stats.end(), WorkerStats{});
+	}
+
+	void ThreadPool::worker_loop(uint32_t worker)
+	{
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> guard{ lock };
+				wake.wait(guard, [&] { return stopping || epoch != seen; });
+				if (stopping) return;
+				seen = epoch;
+				if (worker >= taking_part) continue;
+			}
+
+			work(worker);
+
+			std::lock_guard<std::mutex> guard{ lock };
+			if (--working == 0) done.notify_one();
+		}
+	}
+
+	void ThreadPool::work(uint32_t worker)
+	{
+		Range range;
+		while (take(worker, range)) {
+			const auto start = std::chrono::steady_clock::now();
+			try {
+				(*job)(range.first, range.last, worker);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> guard{ lock };
+				if (!error) error = std::current_exception();
+				failed = true;
+			}
+			run_busy[worker] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			stats[worker].chunks++;
+		}
+	}
+
+	bool ThreadPool::take(uint32_t worker, Range& range)
+	{
+		if (failed) return false; // drop the rest after a failure
+
+		{
+			Queue& own = queues[worker];
+			std::lock_guard<std::mutex> guard{ own.lock };
+			if (!own.chunks.empty()) {
+				range = own.chunks.front();
+				own.chunks.pop_front();
+				return true;
+			}
+		}
+
+		// the chunks were all dealt out before the run started, so once every queue is empty there is no more work
+		for (uint32_t i = 1; i < taking_part; ++i) {
+			Queue& victim = queues[(worker + i) % taking_part];
+			std::lock_guard<std::mutex> guard{ victim.lock };
+			if (!victim.chunks.empty()) {
+				range = victim.chunks.back();
+				victim.chunks.pop_back();
+				stats[worker].stolen++;
+				return true;
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+
+namespace NEAT {
+	// A fixed set of threads kept for the life of a System, so that each generation's evaluation, speciation
+	// and reproduction don't start threads of their own.
+	// run splits an index range into chunks and deals them out in contiguous blocks, one queue per worker.
+	// A worker takes chunks from the front of its own queue. Once that is empty it steals from the back of
+	// the others, so workers that drew cheap genomes take over the chunks of those that drew expensive ones.
+	// The thread calling run works as worker 0 alongside the pool.
+	class ThreadPool {
+	public:
+		// workers threads in all, counting the caller of run, so workers - 1 are started. 0 for one per core
+		explicit ThreadPool(uint32_t workers = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		uint32_t size() const { return workers; }
+
+		// the job for indices first up to last, on worker (below the number of workers taking part)
+		using Job = std::function<void(uint32_t first, uint32_t last, uint32_t worker)>;
+
+		// calls job on chunks of at most chunk indices covering 0 up to count, on the first workers
+		// workers (every worker for 0, and never more than size()). a chunk of 0 gives each worker several
+		// chunks to trade. returns once every chunk has run; if a job throws, the chunks not yet started
+		// are dropped and the first exception is rethrown here. not reentrant
+		void run(uint32_t count, uint32_t chunk, uint32_t workers, const Job& job);
+
+		// what each worker has done since the stats were last reset. idle is the time it spent in a run
+		// without a chunk to work on: waiting for the others to finish, or to be woken up
+		struct WorkerStats {
+			double busy; // seconds
+			double idle;
+			uint64_t chunks;
+			uint64_t stolen; // chunks taken from another worker's queue
+
+			double utilisation() const { return busy + idle > 0 ? busy / (busy + idle) : 1; }
+		};
+		const std::vector<WorkerStats>& get_stats() const { return stats; }
+		void reset_stats();
+
+	private:
+		struct Range {
+			uint32_t first, last;
+		};
+
+		struct alignas(64) Queue {
+			std::mutex lock;
+			std::deque<Range> chunks;
+		};
+
+		uint32_t workers;
+		std::unique_ptr<Queue[]> queues;
+		std::vector<std::thread> threads;
+		std::vector<WorkerStats> stats;
+		std::vector<double> run_busy; // this run's busy time of each worker
+
+		std::mutex lock; // guards everything below
+		std::condition_variable wake, done;
+		uint64_t epoch; // counts runs, so a woken worker can tell a new run from a spurious wakeup
+		bool stopping;
+		const Job* job;
+		uint32_t taking_part;
+		uint32_t working; // the pool threads still working on the current run
+		std::exception_ptr error;
+		std::atomic<bool> failed; // whether error is set, read without the lock
+
+		void worker_loop(uint32_t worker);
+
+		// runs chunks until none are left to take
+		void work(uint32_t worker);
+		bool take(uint32_t worker, Range& range);
+	};
+}
@@ -0,0 +1,135 @@
+// Checks the fast activation kernels against the reference ones within activation_error_bound, through the
+// batch, scalar and sine and cosine entry points, and that an activation mutation can give every non-input node
+// every other activation. Exits with 1 on any failure.
+#include "../activation.h"
+#include "../system.h"
+#include "../network.h"
+
+#include <cmath>
+#include <random>
+#include <set>
+#include <vector>
+#include <iostream>
+
+namespace {
+	// inputs over the ranges the bound covers: a fine grid near 0, where the kernels change the most, wider
+	// steps out to where they saturate, random inputs, and the edges of the range reductions
+	std::vector<double> inputs_for(NEAT::Activation a)
+	{
+		std::vector<double> x;
+		for (int i = -20000; i <= 20000; ++i) x.push_back(i * 0.001);
+		for (int i = -10000; i <= 10000; ++i) x.push_back(i * 0.1);
+
+		std::mt19937_64 gen{ 1 };
+		const double range = a == NEAT::Activation::sine ? 1 << 20 : 1e3;
+		std::uniform_real_distribution<double> dist{ -range, range };
+		for (int i = 0; i < 100000; ++i) x.push_back(dist(gen));
+
+		const double pi = 3.14159265358979323846;
+		for (int k = -64; k <= 64; ++k) {
+			for (double edge : { k * std::log(2.0) / 2, k * pi / 4 }) {
+				x.push_back(edge);
+				x.push_back(std::nextafter(edge, -1e300));
+				x.push_back(std::nextafter(edge, 1e300));
+			}
+		}
+		if (a != NEAT::Activation::sine) {
+			for (double big : { 1e10, -1e10, 1e300, -1e300 }) x.push_back(big);
+		}
+		x.push_back(0.0);
+		x.push_back(-0.0);
+		return x;
+	}
+
+	bool check_kernel(NEAT::Activation a)
+	{
+		const std::vector<double> x = inputs_for(a);
+		std::vector<double> batch(x.size());
+		NEAT::activate_fast(a, x.data(), batch.data(), uint32_t(x.size()));
+
+		const double bound = NEAT::activation_error_bound(a);
+		double worst = 0, worst_x = 0;
+		for (size_t i = 0; i < x.size(); ++i) {
+			const double exact = NEAT::activate(a, x[i]);
+			for (double fast : { batch[i], NEAT::activate_fast(a, x[i]) }) {
+				const double err = std::abs(fast - exact);
+				if (!(err <= worst)) {
+					worst = err;
+					worst_x = x[i];
+				}
+			}
+		}
+
+		const bool ok = worst <= bound;
+		std::cout << NEAT::activation_name(a) << ": worst error " << worst << " at " << worst_x << ", bound " << bound
+			<< (ok ? "\n" : " EXCEEDED\n");
+		return ok;
+	}
+
+	bool check_sin_cos()
+	{
+		const std::vector<double> x = inputs_for(NEAT::Activation::sine);
+		std::vector<double> s(x.size()), c(x.size());
+		NEAT::sin_cos_fast(x.data(), s.data(), c.data(), uint32_t(x.size()));
+
+		const double bound = NEAT::activation_error_bound(NEAT::Activation::sine);
+		double worst = 0;
+		for (size_t i = 0; i < x.size(); ++i) {
+			const double err = std::max(std::abs(s[i] - std::sin(x[i])), std::abs(c[i] - std::cos(x[i])));
+			if (!(err <= worst)) worst = err;
+		}
+
+		const bool ok = worst <= bound;
+		std::cout << "sin_cos_fast: worst error " << worst << ", bound " << bound << (ok ? "\n" : " EXCEEDED\n");
+		return ok;
+	}
+
+	// mutates copies of a genome with several non-input nodes, and checks that every (node, new activation)
+	// pair comes up
+	bool check_mutation()
+	{
+		NEAT::System sys{ 10, 3, 3, 1 };
+		sys.set_seed(1);
+		const NEAT::Network& net = sys.get_population()[0];
+		const std::vector<NEAT::Network::Node>& nodes = net.get_nodes();
+
+		std::set<std::pair<uint32_t, uint32_t>> seen;
+		uint32_t non_input = 0, unchanged = 0;
+		for (const NEAT::Network::Node& n : nodes) non_input += n.get_layer() > 0;
+		for (uint32_t i = 0; i < 20000; ++i) {
+			NEAT::Network child = net;
+			child.mutate(sys, 0, 0, 0, 0, 0, 1);
+
+			uint32_t changed = 0;
+			for (size_t n = 0; n < nodes.size(); ++n) {
+				const NEAT::Activation before = nodes[n].get_activation(), after = child.get_nodes()[n].get_activation();
+				if (after == before) continue;
+				seen.insert({ uint32_t(n), uint32_t(after) });
+				changed++;
+			}
+			unchanged += changed == 0;
+		}
+
+		const size_t expected = size_t(non_input) * (NEAT::activation_count - 1);
+		const bool ok = unchanged == 0 && seen.size() == expected;
+		std::cout << "mutate_activation: " << seen.size() << " of " << expected << " node and activation pairs reached, "
+			<< unchanged << " mutations changed nothing" << (ok ? "\n" : " FAILED\n");
+		return ok;
+	}
+}
+
+int main()
+{
+	try {
+		bool ok = true;
+		for (NEAT::Activation a : { NEAT::Activation::sigmoid, NEAT::Activation::tanh, NEAT::Activation::gaussian,
+			NEAT::Activation::sine }) ok &= check_kernel(a);
+		ok &= check_sin_cos();
+		ok &= check_mutation();
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
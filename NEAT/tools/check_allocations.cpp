@@ -0,0 +1,56 @@
+// Checks that evaluation makes no heap allocations and no counted atomic operations (see alloc_check.h) per
+// timestep, on both the single-network and the lockstep path, for a population evolved on XOR for a few
+// generations so that it has hidden nodes and several topologies. Needs no window or platform headers.
+// Exits with 1 if anything is counted, or if counting wasn't compiled in. tools/run_checks.sh builds it with:
+// flags: -DNEAT_COUNT_ALLOCATIONS
+#include "../system.h"
+#include "../network.h"
+#include "../xor_test.h"
+#include "../alloc_check.h"
+
+#include <iostream>
+
+int main()
+{
+	try {
+		if (!NEAT::counting_allocations()) {
+			std::cerr << "Build with NEAT_COUNT_ALLOCATIONS defined\n";
+			return 1;
+		}
+
+		XOR test;
+		NEAT::System sys{ 150, 3, 1, 1 };
+		sys.set_seed(1);
+		NEAT::initialise_system<XOR>(sys, test);
+		for (uint32_t g = 0; g < 20; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+
+		// XOR episodes never end, so any number of steps will do
+		bool clean = true;
+		for (uint32_t i = 0; i < 10; ++i) {
+			NEAT::Network net = sys.get_population()[i];
+			const NEAT::TimestepCounts single = NEAT::count_per_timestep(net, test, 50);
+			if (single.allocations != 0 || single.atomic_operations != 0) {
+				std::cout << "Genome " << i << ": " << single.allocations << " allocations and " << single.atomic_operations
+					<< " atomic operations per timestep through Network::simulate\n";
+				clean = false;
+			}
+		}
+		const NEAT::TimestepCounts lockstep = NEAT::count_per_timestep(sys, 50);
+		if (lockstep.allocations != 0 || lockstep.atomic_operations != 0) {
+			std::cout << lockstep.allocations << " allocations and " << lockstep.atomic_operations
+				<< " atomic operations per timestep through System::simulate_population\n";
+			clean = false;
+		}
+
+		std::cout << (clean ? "No allocations or atomic operations per timestep\n" : "Evaluation allocates or counts references\n");
+		return clean ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,87 @@
+// Checks that BatchEvaluator gives every row exactly what Network::calculate gives a copy of the network fed
+// only that row, over several timesteps, for genomes evolved on XOR (some of them recurrent), and that XOR
+// scored as a Dataset (System::init_dataset) matches XOR stepped as a Simulator for every genome without
+// recurrent connections.
+// Exits with 1 on any difference.
+#include "../system.h"
+#include "../network.h"
+#include "../phenotype.h"
+#include "../xor_test.h"
+
+#include <random>
+#include <iostream>
+
+int main()
+{
+	try {
+		XOR test;
+		NEAT::System sys{ 150, 3, 1, 1 };
+		sys.set_seed(5);
+		NEAT::initialise_system<XOR>(sys, test);
+		for (uint32_t g = 0; g < 150; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+
+		const uint32_t rows = 7, timesteps = 5;
+		std::mt19937_64 gen{ 1 };
+		std::uniform_real_distribution<double> dist{ -2, 2 };
+		std::vector<double> in(rows * 2), out(rows), row(2);
+		uint32_t differ = 0, recurrent = 0, feed_forward = 0, scores_differ = 0;
+
+		for (const NEAT::Network& net : sys.get_population()) {
+			const NEAT::Phenotype phenotype{ net };
+			NEAT::BatchEvaluator batch{ phenotype, rows, net };
+			std::vector<NEAT::Network> singles(rows, net);
+			for (uint32_t t = 0; t < timesteps; ++t) {
+				for (double& x : in) x = dist(gen);
+				batch.calculate(in.data(), out.data());
+				for (uint32_t r = 0; r < rows; ++r) {
+					row.assign(in.begin() + r * 2, in.begin() + r * 2 + 2);
+					differ += singles[r].calculate(row)[0] != out[r];
+				}
+			}
+
+			// the dataset starts every case from a fresh network, so compare with a fresh evaluator stepped through XOR
+			if (phenotype.get_activation_count() > phenotype.get_node_count()) {
+				recurrent++;
+				continue;
+			}
+			feed_forward++;
+			NEAT::BatchEvaluator cases{ phenotype, test.rows() };
+			double outputs[4];
+			cases.calculate(test.inputs(), outputs);
+			NEAT::Evaluator fresh{ phenotype };
+			XOR stepped;
+			for (uint32_t t = 0; t < 4; ++t) {
+				stepped.write_inputs_to_network(fresh.input_buffer(), 2);
+				stepped.update_with_network_output(fresh.calculate());
+			}
+			scores_differ += test.score(outputs) != stepped.get_fitness();
+		}
+
+		// a System scoring XOR as a dataset agrees with one stepping it, for a first generation with no recurrence
+		NEAT::System stepping{ 150, 3, 1, 1 }, scoring{ 150, 3, 1, 1 };
+		stepping.set_seed(9);
+		scoring.set_seed(9);
+		NEAT::initialise_system<XOR>(stepping, test);
+		scoring.init_dataset(std::make_shared<XOR>());
+		stepping.simulate_population(4);
+		scoring.simulate_population(4);
+		uint32_t systems_differ = 0;
+		for (uint32_t i = 0; i < stepping.get_size(); ++i) {
+			systems_differ += stepping.get_population()[i].get_raw_fitness() != scoring.get_population()[i].get_raw_fitness();
+		}
+
+		std::cout << differ << " of " << sys.get_size() * rows * timesteps << " batch outputs differ from Network::calculate ("
+			<< recurrent << " recurrent genomes), " << scores_differ << " of " << feed_forward
+			<< " feed-forward dataset scores differ from the simulator's, " << systems_differ
+			<< " fitnesses differ between a System scoring the dataset and one stepping the simulators\n";
+		return differ == 0 && scores_differ == 0 && systems_differ == 0 && recurrent > 0 && feed_forward > 0 ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,72 @@
+// Checks Cart_beam_batch against Cart_beam_system within the tolerances cart_beam_batch.h documents, under
+// open-loop controls different for every cart: one step from the same state within step_tolerance, the first
+// trajectory_steps steps within trajectory_tolerance, the inputs given to the networks likewise, and a whole
+// episode's fitness to within a fraction of a percent. A second episode after a reset, with the target moving,
+// is held to the same. Exits with 1 if any tolerance is exceeded.
+#include "../cart_beam.h"
+#include "../cart_beam_batch.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace {
+	double relative(double a, double b) { return std::abs(a - b) / std::max(1.0, std::abs(a)); }
+}
+
+int main()
+{
+	try {
+		const uint32_t carts = 64, steps = 5000;
+		std::vector<Cart_beam_system> scalar(carts);
+		Cart_beam_batch batch{ carts };
+		std::vector<double> inputs(size_t(carts) * 3), controls(carts), fitness(carts), out(1);
+		std::vector<uint8_t> running(carts, 1);
+		bool ok = true;
+
+		for (uint32_t episode = 0; episode < 2; ++episode) {
+			double first_step = 0, trajectory = 0, input = 0, final_fitness = 0;
+			for (uint32_t s = 0; s < steps; ++s) {
+				batch.get_inputs_to_network(0, carts, inputs.data());
+				for (uint32_t c = 0; c < carts; ++c) {
+					const std::vector<double>& in = scalar[c].get_inputs_to_network();
+					if (s < Cart_beam_batch::trajectory_steps) {
+						for (uint32_t k = 0; k < 3; ++k) input = std::max(input, relative(in[k], inputs[size_t(c) * 3 + k]));
+					}
+					controls[c] = 0.5 + 0.4 * std::sin(0.05 * s + 0.7 * c) + 0.1 * std::sin(0.31 * s * (c % 7 + 1));
+					out[0] = controls[c];
+					scalar[c].update_with_network_output(out);
+				}
+				batch.update_with_network_output(0, carts, controls.data(), running.data());
+
+				double worst = 0;
+				for (uint32_t c = 0; c < carts; ++c) {
+					worst = std::max({ worst, relative(scalar[c].get_x(), batch.get_x(c)), relative(scalar[c].get_phi(), batch.get_phi(c)) });
+				}
+				if (s == 0) {
+					batch.get_fitness(0, carts, fitness.data());
+					for (uint32_t c = 0; c < carts; ++c) worst = std::max(worst, relative(scalar[c].get_fitness(), fitness[c]));
+					first_step = worst;
+				}
+				if (s < Cart_beam_batch::trajectory_steps) trajectory = std::max(trajectory, worst);
+			}
+			batch.get_fitness(0, carts, fitness.data());
+			for (uint32_t c = 0; c < carts; ++c) final_fitness = std::max(final_fitness, relative(scalar[c].get_fitness(), fitness[c]));
+
+			const bool within = first_step <= Cart_beam_batch::step_tolerance && trajectory <= Cart_beam_batch::trajectory_tolerance
+				&& input <= Cart_beam_batch::trajectory_tolerance && final_fitness < 1e-3;
+			std::cout << "Episode " << episode << ": first step " << first_step << " (tolerance " << Cart_beam_batch::step_tolerance
+				<< "), first " << Cart_beam_batch::trajectory_steps << " steps " << trajectory << ", inputs " << input << " (tolerance "
+				<< Cart_beam_batch::trajectory_tolerance << "), fitness after " << steps << " steps " << final_fitness
+				<< (within ? "\n" : " EXCEEDED\n");
+			ok &= within;
+
+			for (Cart_beam_system& c : scalar) c.reset();
+			batch.reset(0, carts);
+		}
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,54 @@
+// Checks that the cart and beam evolves the same through a ProcessPool as through the thread pool. Its target
+// moves further every time a simulator is reset, so this fails unless each worker's simulator has been reset
+// as often as the System's own. Exits with 1 on any difference in fitness or in the final checkpoint. POSIX only.
+#include "../cart_beam.h"
+#include "../system.h"
+#include "../network.h"
+#include "../process_pool.h"
+
+#include <iostream>
+#include <sstream>
+
+namespace {
+	std::string run(std::shared_ptr<NEAT::ProcessPool> processes, std::vector<std::vector<double>>& fitness)
+	{
+		Cart_beam_system test;
+		NEAT::System sys{ 60, 4, 1, 1 };
+		sys.set_seed(3);
+		NEAT::initialise_system<Cart_beam_system>(sys, test);
+		if (processes) sys.set_process_pool(processes);
+
+		for (uint32_t g = 0; g < 8; ++g) {
+			sys.simulate_multithread(500);
+			fitness.emplace_back();
+			for (const NEAT::Network& net : sys.get_population()) fitness.back().push_back(net.get_raw_fitness());
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+		std::ostringstream os;
+		sys.save_checkpoint(os);
+		return os.str();
+	}
+}
+
+int main()
+{
+	try {
+		std::vector<std::vector<double>> threaded, pooled;
+		const std::string threads = run(nullptr, threaded);
+		auto processes = std::make_shared<NEAT::ProcessPool>(3, [] { return std::unique_ptr<NEAT::Simulator>(new Cart_beam_system); });
+		const std::string pool = run(processes, pooled);
+
+		uint32_t differ = 0;
+		for (size_t g = 0; g < threaded.size(); ++g) {
+			for (size_t i = 0; i < threaded[g].size(); ++i) differ += threaded[g][i] != pooled[g][i];
+		}
+		const bool ok = differ == 0 && pool == threads;
+		std::cout << differ << " fitnesses differ, checkpoints " << (pool == threads ? "match" : "differ") << "\n";
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
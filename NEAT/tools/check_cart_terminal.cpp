@@ -0,0 +1,88 @@
+// Checks that a cart pushed off the end of the rails stops scoring where it leaves them, through
+// Network::simulate and through Cart_beam_batch, while the same cart left to run on keeps scoring.
+// Exits with 1 on any failure.
+#include "../cart_beam.h"
+#include "../cart_beam_batch.h"
+#include "../system.h"
+#include "../network.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace {
+	// a cart given full acceleration every step, whatever the network outputs
+	class Pushed : public NEAT::Simulator {
+	public:
+		Pushed() :push{ 1.0 } {}
+
+		void update_with_network_output(const std::vector<double>&) override { cart.update_with_network_output(push); }
+		const std::vector<double>& get_inputs_to_network() override { return cart.get_inputs_to_network(); }
+		void write_inputs_to_network(double* in, uint32_t count) override { cart.write_inputs_to_network(in, count); }
+		double get_fitness() override { return cart.get_fitness(); }
+		void reset() override { cart.reset(); }
+		bool is_terminal() override { return cart.is_terminal(); }
+
+	private:
+		Cart_beam_system cart;
+		std::vector<double> push;
+	};
+}
+
+int main()
+{
+	try {
+		const uint32_t steps = 1000;
+		const std::vector<double> push{ 1.0 };
+
+		// the cart left to run: it leaves the rails at step left, then keeps scoring
+		Cart_beam_system free;
+		free.reset();
+		uint32_t left = 0;
+		double fitness_at_edge = 0;
+		for (uint32_t s = 0; s < steps; ++s) {
+			if (!left && free.is_terminal()) {
+				left = s;
+				fitness_at_edge = free.get_fitness();
+			}
+			free.update_with_network_output(push);
+		}
+		const bool left_rails = left > 0 && free.get_fitness() > fitness_at_edge;
+		std::cout << "Pushed cart leaves the rails after " << left << " steps with fitness " << fitness_at_edge
+			<< ", and would reach " << free.get_fitness() << " by step " << steps << "\n";
+
+		// through a network: the episode ends at the edge
+		NEAT::System sys{ 1, 4, 1, 1 };
+		sys.set_seed(1);
+		NEAT::Network net = sys.get_population()[0];
+		Pushed pushed;
+		pushed.reset();
+		const uint32_t ran = net.simulate(pushed, steps);
+		const bool single = ran == left && net.get_raw_fitness() == fitness_at_edge;
+		std::cout << "Network::simulate: " << ran << " steps, fitness " << net.get_raw_fitness() << "\n";
+
+		// through the batch physics: running carts stop at the edge, and a cart marked as not running doesn't move
+		Cart_beam_batch batch{ 2 };
+		batch.reset(0, 2);
+		const double outputs[2] = { 1.0, 1.0 };
+		uint8_t terminal[2] = {}, running[2] = { 1, 0 };
+		uint32_t batch_ran = 0;
+		for (; batch_ran < steps; ++batch_ran) {
+			batch.is_terminal(0, 2, terminal);
+			if (terminal[0]) break;
+			batch.update_with_network_output(0, 2, outputs, running);
+		}
+		double batch_fitness[2];
+		batch.get_fitness(0, 2, batch_fitness);
+		const bool batched = batch_ran == left && !terminal[1] && batch_fitness[1] == 0 &&
+			std::abs(batch_fitness[0] - fitness_at_edge) <= 1e-9 * fitness_at_edge;
+		std::cout << "Cart_beam_batch: " << batch_ran << " steps, fitness " << batch_fitness[0] << "\n";
+
+		const bool ok = left_rails && single && batched;
+		std::cout << (ok ? "Reward stops at the rails\n" : "FAILED\n");
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
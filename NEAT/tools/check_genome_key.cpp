@@ -0,0 +1,146 @@
+// Checks the linear-merge compatibility distance: compare_genes against the 2002 paper's definitions applied
+// gene by gene, with the weight differences summed in the documented order so that the AVX2 path must agree
+// exactly; compatibility_distances and find_compatible against compatibility_distance; GenomeKey refusing
+// genomes out of innovation order; and every genome of an evolved population staying in that order.
+// Exits with 1 on any failure.
+#include "../species.h"
+#include "../system.h"
+#include "../network.h"
+#include "../xor_test.h"
+
+#include <cmath>
+#include <random>
+#include <iostream>
+
+namespace {
+	// a gene is matching if the other genome has its innovation, excess if its innovation is beyond the other
+	// genome's last, and disjoint otherwise. the k-th matching gene's weight difference goes to sum[k % 4]
+	NEAT::GeneComparison reference(const std::vector<NEAT::Connection>& a, const std::vector<NEAT::Connection>& b)
+	{
+		NEAT::GeneComparison g{};
+		double sum[4] = {};
+		auto classify = [&](const std::vector<NEAT::Connection>& genome, const std::vector<NEAT::Connection>& other, bool count_matches) {
+			for (const NEAT::Connection& c : genome) {
+				auto it = std::find_if(other.begin(), other.end(), [&](const NEAT::Connection& o) { return o.innov_num == c.innov_num; });
+				if (it != other.end()) {
+					if (!count_matches) continue;
+					sum[g.matching % 4] += std::abs(c.weight - it->weight);
+					g.matching++;
+				}
+				else if (other.empty() || c.innov_num > other.back().innov_num) g.excess++;
+				else g.disjoint++;
+			}
+		};
+		classify(a, b, true);
+		classify(b, a, false);
+		g.weight_difference = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+		return g;
+	}
+
+	// a genome over innovations [0, range), each present with probability density
+	std::vector<NEAT::Connection> random_genome(std::mt19937_64& gen, uint32_t first, uint32_t range, double density)
+	{
+		std::uniform_real_distribution<double> dist{ 0, 1 };
+		std::vector<NEAT::Connection> genome;
+		for (uint32_t i = first; i < range; ++i) {
+			if (dist(gen) < density) genome.emplace_back(0, 0, true, 4 * dist(gen) - 2, i, false);
+		}
+		return genome;
+	}
+
+	// mostly the same genes as base, so that long runs match, with a few dropped, added and reweighted
+	std::vector<NEAT::Connection> relative_of(std::mt19937_64& gen, const std::vector<NEAT::Connection>& base, uint32_t range)
+	{
+		std::uniform_real_distribution<double> dist{ 0, 1 };
+		std::vector<NEAT::Connection> genome;
+		uint32_t next = 0;
+		for (const NEAT::Connection& c : base) {
+			for (; next < c.innov_num; ++next) {
+				if (dist(gen) < 0.05) genome.emplace_back(0, 0, true, dist(gen), next, false);
+			}
+			next = c.innov_num + 1;
+			if (dist(gen) < 0.1) continue;
+			genome.push_back(c);
+			if (dist(gen) < 0.5) genome.back().weight += dist(gen) - 0.5;
+		}
+		for (; next < range; ++next) {
+			if (dist(gen) < 0.05) genome.emplace_back(0, 0, true, dist(gen), next, false);
+		}
+		return genome;
+	}
+
+	bool same(const NEAT::GeneComparison& a, const NEAT::GeneComparison& b)
+	{
+		return a.matching == b.matching && a.disjoint == b.disjoint && a.excess == b.excess && a.weight_difference == b.weight_difference;
+	}
+}
+
+int main()
+{
+	try {
+		std::mt19937_64 gen{ 3 };
+		std::uniform_int_distribution<uint32_t> range{ 1, 300 }, first{ 0, 50 };
+		std::uniform_real_distribution<double> density{ 0.05, 1 };
+		uint32_t pairs = 0, differ = 0, inconsistent = 0;
+
+		for (uint32_t p = 0; p < 5000; ++p) {
+			const uint32_t r = range(gen);
+			const std::vector<NEAT::Connection> a = random_genome(gen, first(gen) % r, r, density(gen));
+			const std::vector<NEAT::Connection> b = p % 2 ? relative_of(gen, a, r + first(gen)) : random_genome(gen, first(gen) % r, range(gen), density(gen));
+			const NEAT::GenomeKey ka{ a }, kb{ b };
+			differ += !same(NEAT::compare_genes(ka, kb), reference(a, b));
+			differ += !same(NEAT::compare_genes(kb, ka), reference(b, a));
+			pairs += 2;
+
+			// the batch entry points agree with the distance they are built on
+			const std::vector<NEAT::GenomeKey> reps{ kb, ka, kb };
+			std::vector<double> distances;
+			NEAT::compatibility_distances(ka, reps, 2, 2, 1, distances);
+			for (uint32_t k = 0; k < reps.size(); ++k) {
+				const double d = NEAT::compatibility_distance(ka, reps[k], 2, 2, 1);
+				inconsistent += !(distances[k] == d || (std::isnan(d) && std::isnan(distances[k])));
+			}
+			const double thresh = distances[0] > 0 ? distances[0] : 0;
+			const uint32_t found = NEAT::find_compatible(ka, reps, 2, 2, 1, thresh);
+			uint32_t expected = 0;
+			while (expected < reps.size() && !(distances[expected] <= thresh)) expected++;
+			inconsistent += found != expected;
+		}
+
+		// genomes out of innovation order are refused
+		uint32_t accepted = 0;
+		for (const std::vector<NEAT::Connection>& bad : { std::vector<NEAT::Connection>{ { 0, 0, true, 1.0, 5, false }, { 0, 0, true, 1.0, 3, false } },
+			std::vector<NEAT::Connection>{ { 0, 0, true, 1.0, 4, false }, { 0, 0, true, 1.0, 4, false } } }) {
+			try {
+				NEAT::GenomeKey key{ bad };
+				accepted++;
+			}
+			catch (std::runtime_error&) {}
+		}
+
+		// and evolution keeps them in order, through mutation and crossover
+		XOR test;
+		NEAT::System sys{ 150, 3, 1, 1 };
+		sys.set_seed(11);
+		NEAT::initialise_system<XOR>(sys, test);
+		uint32_t unsorted = 0;
+		for (uint32_t g = 0; g < 60; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+			for (const NEAT::Network& net : sys.get_population()) {
+				const std::vector<NEAT::Connection>& genome = net.get_genome();
+				for (size_t i = 1; i < genome.size(); ++i) unsorted += genome[i].innov_num <= genome[i - 1].innov_num;
+			}
+		}
+
+		std::cout << differ << " of " << pairs << " comparisons differ from the reference, " << inconsistent
+			<< " batch distances inconsistent, " << accepted << " unsorted genomes accepted, " << unsorted
+			<< " genes out of order after evolving\n";
+		return differ == 0 && inconsistent == 0 && accepted == 0 && unsorted == 0 ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,116 @@
+// Checks the JIT: for networks grown by mutation with every activation function, some of them recurrent, the
+// native code gives exactly what the interpreter does with the standard and the polynomial activations, and the
+// lockstep evaluator runs each compiled genome on its own, with the same outputs, whatever shares its shape.
+// Prints the time per step of a large network interpreted and compiled. Exits with 1 on any failure.
+#include "../system.h"
+#include "../network.h"
+#include "../jit.h"
+#include "../lockstep.h"
+
+#include <chrono>
+#include <random>
+#include <iostream>
+
+namespace {
+	std::vector<double> random_inputs(std::mt19937_64& gen, size_t n)
+	{
+		std::uniform_real_distribution<double> dist{ -3, 3 };
+		std::vector<double> in(n);
+		for (double& x : in) x = dist(gen);
+		return in;
+	}
+
+	// the least of several runs of a step, in ns
+	double time_step(NEAT::Evaluator& eval, const std::vector<double>& in)
+	{
+		double best = 1e300, sink = 0;
+		for (uint32_t run = 0; run < 9; ++run) {
+			const auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < 5000; ++i) sink += eval.calculate(in)[0];
+			best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 5000);
+		}
+		return sink == sink ? best : 0;
+	}
+}
+
+int main()
+{
+	try {
+		if (!NEAT::JitPhenotype::supported()) {
+			std::cout << "no native code on this platform\n";
+			return 0;
+		}
+
+		NEAT::System sys{ 60, 4, 2, 1.0 };
+		sys.set_seed(11);
+		std::vector<NEAT::Network> population = sys.get_population();
+		std::mt19937_64 gen{ 2 };
+		uint64_t outputs = 0, differ = 0, lockstep_differ = 0, native_groups = 0;
+
+		for (uint32_t round = 0; round < 40; ++round) {
+			for (NEAT::Network& net : population) net.mutate(sys, 0.3, 0.5, 0.8, 0.9, 2.0, 0.4);
+
+			for (bool fast_activation : { false, true }) {
+				for (const NEAT::Network& net : population) {
+					NEAT::Network compiled = net;
+					compiled.compile_jit(fast_activation);
+					const NEAT::Phenotype phenotype{ net, fast_activation };
+					NEAT::Evaluator interpreted{ phenotype, net }, native{ *compiled.get_jit(), compiled };
+					for (uint32_t t = 0; t < 5; ++t) {
+						const std::vector<double> in = random_inputs(gen, 3);
+						const std::vector<double> a = interpreted.calculate(in);
+						const std::vector<double>& b = native.calculate(in);
+						for (uint32_t o = 0; o < a.size(); ++o) differ += a[o] != b[o];
+						outputs += a.size();
+					}
+				}
+
+				// every third genome compiled
+				std::vector<NEAT::Network> mixed = population;
+				for (uint32_t i = 0; i < mixed.size(); i += 3) mixed[i].compile_jit(fast_activation);
+				NEAT::LockstepEvaluator lockstep{ mixed, 0, uint32_t(mixed.size()), fast_activation };
+				const NEAT::LockstepEvaluator plain{ population, 0, uint32_t(population.size()), fast_activation };
+				native_groups += lockstep.get_groups() - plain.get_groups();
+				std::vector<NEAT::Phenotype> phenotypes;
+				std::vector<NEAT::Evaluator> alone;
+				phenotypes.reserve(population.size());
+				alone.reserve(population.size());
+				for (const NEAT::Network& net : population) {
+					phenotypes.emplace_back(net, fast_activation);
+					alone.emplace_back(phenotypes.back(), net);
+				}
+				std::vector<double> out(mixed.size() * 2);
+				for (uint32_t t = 0; t < 5; ++t) {
+					const std::vector<double> in = random_inputs(gen, mixed.size() * 3);
+					lockstep.calculate(in.data(), out.data());
+					for (uint32_t i = 0; i < mixed.size(); ++i) {
+						const std::vector<double>& expected = alone[i].calculate({ in.begin() + 3 * i, in.begin() + 3 * i + 3 });
+						for (uint32_t o = 0; o < 2; ++o) lockstep_differ += out[2 * i + o] != expected[o];
+					}
+				}
+			}
+		}
+		std::cout << outputs << " outputs: " << differ << " differ from the interpreter, " << lockstep_differ
+			<< " differ in lockstep, " << native_groups << " groups added by compiled genomes\n";
+		bool ok = differ == 0 && lockstep_differ == 0 && native_groups > 0;
+
+		// a large network of sigmoids
+		NEAT::Network big = population[0];
+		for (uint32_t i = 0; i < 400; ++i) big.mutate(sys, 0.5, 0.9, 0.0, 0.9, 2.0);
+		for (bool fast_activation : { false, true }) {
+			NEAT::Network compiled = big;
+			compiled.compile_jit(fast_activation);
+			const NEAT::Phenotype phenotype{ big, fast_activation };
+			NEAT::Evaluator interpreted{ phenotype, big }, native{ *compiled.get_jit(), compiled };
+			const std::vector<double> in = random_inputs(gen, 3);
+			std::cout << (fast_activation ? "polynomial" : "standard") << " activations, " << phenotype.get_connection_count()
+				<< " connections: interpreted " << time_step(interpreted, in) << " ns a step, compiled " << time_step(native, in)
+				<< " ns (" << compiled.get_jit()->get_code_size() << " bytes)\n";
+		}
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,92 @@
+// Checks the shape-grouped lockstep evaluator: for genomes evolved on XOR (some of them recurrent, and of several
+// different topologies in most groups), every genome's outputs and stored state are bit-identical to running it
+// alone through an Evaluator, with the standard and the polynomial activations, while lanes retire one by one.
+// Prints the lanes per group against the number of distinct topologies. Exits with 1 on any failure.
+#include "../system.h"
+#include "../network.h"
+#include "../lockstep.h"
+#include "../xor_test.h"
+
+#include <set>
+#include <random>
+#include <iostream>
+
+namespace {
+	bool check(const std::vector<NEAT::Network>& population, bool fast_activation)
+	{
+		const uint32_t count = uint32_t(population.size()), steps = 12;
+		NEAT::LockstepEvaluator lockstep{ population, 0, count, fast_activation };
+		std::vector<NEAT::Phenotype> phenotypes;
+		std::vector<NEAT::Evaluator> evaluators;
+		phenotypes.reserve(count);
+		evaluators.reserve(count);
+		for (const NEAT::Network& net : population) {
+			phenotypes.emplace_back(net, fast_activation);
+			evaluators.emplace_back(phenotypes.back(), net);
+		}
+
+		std::mt19937_64 gen{ 3 };
+		std::uniform_real_distribution<double> dist{ -2, 2 };
+		std::vector<double> inputs(size_t(count) * 2), outputs(count), in(2);
+		std::vector<NEAT::Network> grouped = population, alone = population;
+		uint32_t differ = 0;
+		for (uint32_t t = 0; t < steps; ++t) {
+			for (double& x : inputs) x = dist(gen);
+			lockstep.calculate(inputs.data(), outputs.data());
+			for (uint32_t i = 0; i < count; ++i) {
+				in.assign(inputs.begin() + 2 * i, inputs.begin() + 2 * i + 2);
+				const double expected = evaluators[i].calculate(in)[0];
+				// genome i leaves after step i % steps, and its outputs stop counting
+				if (i % steps >= t) differ += outputs[i] != expected;
+				if (i % steps == t) {
+					lockstep.retire(grouped, i);
+					evaluators[i].store_state(alone[i]);
+				}
+			}
+		}
+		lockstep.store_state(grouped);
+
+		// the stored states give the same next step
+		for (uint32_t i = 0; i < count; ++i) {
+			for (double& x : in) x = dist(gen);
+			differ += grouped[i].calculate(in)[0] != alone[i].calculate(in)[0];
+		}
+
+		std::set<std::vector<uint32_t>> topologies;
+		for (const NEAT::Network& net : population) {
+			std::vector<uint32_t> topology{ uint32_t(net.get_nodes().size()) };
+			for (const auto& c : net.get_genome()) {
+				if (c.enabled) topology.insert(topology.end(), { c.node1, c.node2 });
+			}
+			topologies.insert(topology);
+		}
+
+		std::cout << (fast_activation ? "polynomial" : "standard") << " activations: " << differ << " outputs differ, "
+			<< lockstep.get_groups() << " groups of " << double(count) / lockstep.get_groups() << " lanes for "
+			<< topologies.size() << " topologies\n";
+		return differ == 0 && lockstep.get_groups() < topologies.size();
+	}
+}
+
+int main()
+{
+	try {
+		XOR test;
+		NEAT::System sys{ 150, 3, 1, 1 };
+		sys.set_seed(5);
+		NEAT::initialise_system<XOR>(sys, test);
+		for (uint32_t g = 0; g < 150; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+
+		bool ok = true;
+		for (bool fast_activation : { false, true }) ok &= check(sys.get_population(), fast_activation);
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,93 @@
+// Checks the reduced precision evaluation: PrecisionEvaluator<double> gives exactly what Network::calculate does,
+// state included, for genomes evolved on XOR (some of them recurrent); a System set to double precision scores
+// every genome as the default evaluation does, and one set to float32 within 1e-4; the narrower precisions stay
+// within loose bounds. Prints the PrecisionReport of the fittest genome on XOR. Exits with 1 on any failure.
+#include "../system.h"
+#include "../network.h"
+#include "../precision.h"
+#include "../xor_test.h"
+
+#include <random>
+#include <iostream>
+
+namespace {
+	// genomes evolved on XOR, the same ones every time
+	void evolve(NEAT::System& sys, XOR& test)
+	{
+		sys.set_seed(5);
+		NEAT::initialise_system<XOR>(sys, test);
+		for (uint32_t g = 0; g < 150; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+	}
+}
+
+int main()
+{
+	try {
+		XOR test;
+		NEAT::System sys{ 150, 3, 1, 1 };
+		evolve(sys, test);
+		const std::vector<NEAT::Network> population = sys.get_population();
+
+		// open loop against the reference, state carried over from one step to the next and written back
+		std::mt19937_64 gen{ 1 };
+		std::uniform_real_distribution<double> dist{ -2, 2 };
+		std::vector<double> in(2);
+		uint32_t differ = 0, recurrent = 0;
+		for (const NEAT::Network& net : population) {
+			const NEAT::Phenotype phenotype{ net };
+			recurrent += phenotype.get_activation_count() > phenotype.get_node_count();
+			NEAT::PrecisionEvaluator<double> eval{ phenotype, net };
+			NEAT::Network reference = net, stored = net;
+			for (uint32_t t = 0; t < 6; ++t) {
+				for (double& x : in) x = dist(gen);
+				differ += eval.calculate(in)[0] != reference.calculate(in)[0];
+			}
+			eval.store_state(stored);
+			for (double& x : in) x = dist(gen);
+			differ += stored.calculate(in)[0] != reference.calculate(in)[0];
+		}
+		std::cout << "double: " << differ << " of " << population.size() * 7 << " outputs differ, " << recurrent
+			<< " genomes recurrent\n";
+		bool ok = differ == 0 && recurrent > 0;
+
+		// a System set to a precision scores each genome as NEAT::simulate does in it
+		for (NEAT::Precision p : { NEAT::Precision::double_precision, NEAT::Precision::single, NEAT::Precision::half,
+			NEAT::Precision::int8 }) {
+			XOR routed_test;
+			NEAT::System routed{ 150, 3, 1, 1 };
+			evolve(routed, routed_test);
+			routed.set_precision(p);
+			routed.simulate_population(4);
+
+			double worst = 0;
+			uint32_t not_routed = 0;
+			for (uint32_t i = 0; i < population.size(); ++i) {
+				NEAT::Network reference = population[i], precise = population[i];
+				XOR reference_sim, precise_sim;
+				reference.simulate(reference_sim, 4);
+				NEAT::simulate(precise, precise_sim, 4, p);
+				const double score = routed.get_population()[i].get_raw_fitness();
+				not_routed += score != precise.get_raw_fitness();
+				worst = std::max(worst, std::abs(score - reference.get_raw_fitness()));
+			}
+			const double bound = p == NEAT::Precision::double_precision ? 0 : p == NEAT::Precision::single ? 1e-4 : 0.5;
+			const bool passed = not_routed == 0 && worst <= bound;
+			ok &= passed;
+			std::cout << NEAT::precision_name(p) << ": " << not_routed << " scores not from the precision, worst difference from double "
+				<< worst << ", bound " << bound << (passed ? "\n" : " FAILED\n");
+		}
+
+		const auto fittest = std::max_element(population.begin(), population.end(),
+			[](const NEAT::Network& a, const NEAT::Network& b) { return a.get_raw_fitness() < b.get_raw_fitness(); });
+		std::cout << NEAT::compare_precision(*fittest, XOR{}, 4);
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
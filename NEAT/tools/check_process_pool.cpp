@@ -0,0 +1,69 @@
+// Checks that evaluating through a ProcessPool gives the same run as the thread pool: XOR evolved for 25 seeded
+// generations with the standard and the polynomial activation kernels, with species champions compiled after
+// the default number of generations, and with workers that crash now and then. Exits with 1 if any run's
+// checkpoint differs from the threaded run's. POSIX only.
+#include "../system.h"
+#include "../network.h"
+#include "../process_pool.h"
+#include "../xor_test.h"
+
+#include <signal.h>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	// kills its worker process every 97th reset
+	struct Crashing : XOR {
+		static int resets;
+		void reset() override {
+			XOR::reset();
+			if (++resets % 97 == 0) raise(SIGKILL);
+		}
+	};
+	int Crashing::resets = 0;
+
+	std::string run(std::shared_ptr<NEAT::ProcessPool> processes, bool fast_activation)
+	{
+		XOR test;
+		NEAT::System sys{ 300, 3, 1, 1 };
+		sys.set_seed(42);
+		sys.set_fast_activation(fast_activation);
+		NEAT::initialise_system<XOR>(sys, test);
+		if (processes) sys.set_process_pool(processes);
+
+		for (uint32_t g = 0; g < 25; ++g) {
+			sys.simulate_multithread(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+		std::ostringstream os;
+		sys.save_checkpoint(os);
+		return os.str();
+	}
+}
+
+int main()
+{
+	try {
+		bool ok = true;
+		for (bool fast : { false, true }) {
+			const std::string threads = run(nullptr, fast);
+			auto processes = std::make_shared<NEAT::ProcessPool>(3, [] { return std::unique_ptr<NEAT::Simulator>(new XOR); });
+			const bool same = run(processes, fast) == threads;
+			std::cout << (fast ? "Polynomial" : "Standard") << " activation: process pool " << (same ? "matches" : "DIFFERS FROM")
+				<< " the thread pool over " << processes->get_stats().tasks << " tasks\n";
+			ok &= same;
+		}
+
+		auto crashing = std::make_shared<NEAT::ProcessPool>(3, [] { return std::unique_ptr<NEAT::Simulator>(new Crashing); });
+		const bool same = run(crashing, false) == run(nullptr, false);
+		std::cout << "Crashing workers: " << (same ? "matches" : "DIFFERS FROM") << " the thread pool after "
+			<< crashing->get_stats().restarts << " restarts\n";
+		ok &= same && crashing->get_stats().restarts > 0;
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,62 @@
+// Checks set_measure_serial_reproduction: a seeded run measuring its serial reproduction time ends with the same
+// checkpoint as one that doesn't, on one thread and on four, and reports a measured serial time. Prints the
+// measured speedup of building the children on four threads. Exits with 1 on any failure.
+#include "../system.h"
+#include "../network.h"
+#include "../xor_test.h"
+
+#include <sstream>
+#include <iostream>
+
+namespace {
+	struct Run {
+		std::string checkpoint;
+		double wall_time = 0, serial_time = 0;
+		bool measured = true;
+	};
+
+	Run run(uint32_t threads, bool measure)
+	{
+		XOR test;
+		NEAT::System sys{ 300, 3, 1, 1 };
+		sys.set_seed(7);
+		sys.set_reproduction_threads(threads);
+		sys.set_measure_serial_reproduction(measure);
+		NEAT::initialise_system<XOR>(sys, test);
+
+		Run r;
+		for (uint32_t g = 0; g < 40; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+			const NEAT::System::ReproductionStats& stats = sys.get_reproduction_stats();
+			r.wall_time += stats.wall_time;
+			r.serial_time += stats.serial_time;
+			r.measured &= stats.measured == measure && stats.serial_time > 0;
+		}
+		std::ostringstream os;
+		sys.save_checkpoint(os);
+		r.checkpoint = os.str();
+		return r;
+	}
+}
+
+int main()
+{
+	try {
+		bool ok = true;
+		for (uint32_t threads : { 1u, 4u }) {
+			const Run plain = run(threads, false), measured = run(threads, true);
+			const bool same = plain.checkpoint == measured.checkpoint;
+			ok &= same && measured.measured;
+			std::cout << threads << " threads: same checkpoint " << same << ", serial time measured " << measured.measured
+				<< ", " << measured.serial_time * 1000 << " ms on one thread against " << measured.wall_time * 1000
+				<< " ms, a measured " << measured.serial_time / measured.wall_time << "x\n";
+		}
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,117 @@
+// Checks what parallel speciation relies on: distance_lower_bound never exceeds compatibility_distance, for
+// random genomes and for every pair in an evolved population; DistanceCache finds exactly the distances it was
+// given; and a seeded run speciates the same on one thread as on four, with representatives both pruned and
+// found in the cache along the way. Exits with 1 on any failure.
+#include "../species.h"
+#include "../system.h"
+#include "../network.h"
+#include "../xor_test.h"
+
+#include <random>
+#include <sstream>
+#include <iostream>
+
+namespace {
+	std::vector<NEAT::Connection> random_genome(std::mt19937_64& gen)
+	{
+		std::uniform_int_distribution<uint32_t> bounds{ 0, 200 };
+		std::uniform_real_distribution<double> dist{ 0, 1 };
+		uint32_t first = bounds(gen), last = bounds(gen);
+		if (first > last) std::swap(first, last);
+		const double density = dist(gen);
+		std::vector<NEAT::Connection> genome;
+		for (uint32_t i = first; i <= last; ++i) {
+			if (dist(gen) < density) genome.emplace_back(0, 0, true, 4 * dist(gen) - 2, i, false);
+		}
+		return genome;
+	}
+
+	// the bound must hold for any coefficients that aren't negative
+	uint32_t bound_violations(const NEAT::GenomeKey& a, const NEAT::GenomeKey& b)
+	{
+		uint32_t violations = 0;
+		for (double c1 : { 0.0, 1.0, 2.0, 7.5 }) {
+			for (double c2 : { 0.0, 2.0, 0.3 }) {
+				const double distance = NEAT::compatibility_distance(a, b, c1, c2, 1.0);
+				// no matching genes gives a distance of NaN, which the threshold comparison treats as too far anyway
+				if (distance != distance) continue;
+				violations += NEAT::distance_lower_bound(a, b, c1, c2) > distance;
+			}
+		}
+		return violations;
+	}
+
+	std::string run(uint32_t threads, NEAT::System::SpeciationStats& totals)
+	{
+		XOR test;
+		NEAT::System sys{ 300, 3, 1, 1 };
+		sys.set_seed(21);
+		sys.set_threads(threads);
+		NEAT::initialise_system<XOR>(sys, test);
+		totals = NEAT::System::SpeciationStats{};
+		for (uint32_t g = 0; g < 40; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+			totals.computed += sys.get_speciation_stats().computed;
+			totals.cached += sys.get_speciation_stats().cached;
+			totals.pruned += sys.get_speciation_stats().pruned;
+		}
+		std::ostringstream os;
+		sys.save_checkpoint(os);
+		return os.str();
+	}
+}
+
+int main()
+{
+	try {
+		uint32_t violations = 0, pairs = 0;
+		std::mt19937_64 gen{ 4 };
+		for (uint32_t p = 0; p < 20000; ++p) {
+			const NEAT::GenomeKey a{ random_genome(gen) }, b{ random_genome(gen) };
+			violations += bound_violations(a, b);
+			pairs++;
+		}
+
+		NEAT::System::SpeciationStats one{}, four{};
+		const bool same = run(1, one) == run(4, four);
+
+		XOR test;
+		NEAT::System sys{ 150, 3, 1, 1 };
+		sys.set_seed(8);
+		NEAT::initialise_system<XOR>(sys, test);
+		for (uint32_t g = 0; g < 80; ++g) {
+			sys.simulate_population(4);
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+		std::vector<NEAT::GenomeKey> keys;
+		for (const NEAT::Network& net : sys.get_population()) keys.emplace_back(net.get_genome());
+		for (const NEAT::GenomeKey& a : keys) {
+			for (const NEAT::GenomeKey& b : keys) {
+				violations += bound_violations(a, b);
+				pairs++;
+			}
+		}
+
+		// records in any order, and genomes that were never held or are newer than any held
+		NEAT::DistanceCache cache;
+		std::vector<NEAT::DistanceCache::Record> records{ { 40, 0, 2 }, { 7, 2, 1 }, { 12, 3, 0 } };
+		std::vector<NEAT::DistanceCache::Distance> distances{ { 1, 0.5 }, { 2, 1.5 }, { 3, 2.5 } };
+		cache.replace(records, distances);
+		auto found = [&](uint64_t genome) { auto d = cache.find(genome); return std::vector<NEAT::DistanceCache::Distance>(d.first, d.second); };
+		const bool cached = found(40).size() == 2 && found(40)[1].rep == 2 && found(40)[1].distance == 1.5 &&
+			found(7).size() == 1 && found(7)[0].rep == 3 && found(12).empty() && found(8).empty() && found(41).empty() &&
+			cache.size() == 3 && records.empty() && distances.empty();
+
+		std::cout << violations << " lower bounds above the distance over " << pairs << " pairs, cache "
+			<< (cached ? "correct" : "WRONG") << ", one and four threads " << (same ? "agree" : "DIFFER") << " ("
+			<< one.computed << " distances computed, " << one.cached << " cached, " << one.pruned << " pruned)\n";
+		return violations == 0 && cached && same && one.cached > 0 && one.pruned > 0 ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
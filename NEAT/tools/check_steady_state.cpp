@@ -0,0 +1,81 @@
+// Checks steady_state's bookkeeping with batches of one genome and more, on one thread and four: every call
+// makes the replacements asked for, evaluates the genomes left unevaluated, counts a generation per size
+// replacements and keeps the species counts summing to the population. Prints the time per generation's worth
+// of replacements against a generation of the generational mode. Exits with 1 on any failure.
+#include "../system.h"
+#include "../network.h"
+#include "../xor_test.h"
+
+#include <chrono>
+#include <numeric>
+#include <iostream>
+
+namespace {
+	const uint32_t size = 300, generations = 30, timesteps = 20;
+
+	bool check(uint32_t batch, uint32_t threads)
+	{
+		XOR test;
+		NEAT::System sys{ size, 3, 1, 1 };
+		sys.set_threads(threads);
+		sys.set_steady_state_batch(batch);
+		NEAT::initialise_system<XOR>(sys, test);
+
+		uint32_t failures = 0;
+		for (uint32_t g = 0; g < generations; ++g) {
+			// the first call evaluates the whole population before replacing any of it
+			const uint32_t replacements = g % 3 == 0 ? size / 2 : size;
+			const uint32_t generation = sys.get_generation();
+			sys.steady_state(timesteps, replacements);
+
+			const NEAT::System::SteadyStateStats& stats = sys.get_steady_state_stats();
+			const uint32_t counted = std::accumulate(sys.get_species().begin(), sys.get_species().end(), 0u,
+				[](uint32_t sum, const NEAT::Species& s) { return sum + s.count; });
+			failures += stats.replacements != replacements;
+			failures += stats.evaluations != replacements + (g == 0 ? size : 0);
+			failures += counted != size;
+			failures += sys.get_generation() < generation || sys.get_generation() > generation + 1;
+		}
+		failures += sys.get_max_fitness() <= 0;
+
+		std::cout << "batch " << batch << ", " << threads << " threads: " << failures << " failures\n";
+		return failures == 0;
+	}
+
+	double ms_per_generation(bool steady)
+	{
+		XOR test;
+		NEAT::System sys{ size, 3, 1, 1 };
+		sys.set_seed(3);
+		NEAT::initialise_system<XOR>(sys, test);
+		const auto start = std::chrono::steady_clock::now();
+		for (uint32_t g = 0; g < generations; ++g) {
+			if (steady) sys.steady_state(timesteps, size);
+			else {
+				sys.simulate_multithread(timesteps);
+				sys.produce_next_generation();
+				sys.reset_simulators();
+			}
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000 / generations;
+	}
+}
+
+int main()
+{
+	try {
+		bool ok = true;
+		for (uint32_t batch : { 1u, 8u, 64u }) {
+			for (uint32_t threads : { 1u, 4u }) ok &= check(batch, threads);
+		}
+
+		const double generational = ms_per_generation(false), steady = ms_per_generation(true);
+		std::cout << "generational " << generational << " ms a generation, steady state " << steady << " ms, "
+			<< steady / generational << "x\n";
+		return ok ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,85 @@
+// Checks that evaluation stops at a terminal state: each genome runs until its simulator's episode ends and no
+// further, and the lockstep path (System::simulate_multithread) agrees with Network::simulate on every genome's
+// fitness, state and steps run. The episodes end at different steps and on their own scores, so lanes of one
+// lockstep group retire at different times. Exits with 1 on any mismatch.
+#include "../system.h"
+#include "../network.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace {
+	// scores the network's output each step, and ends after limit steps or once the score passes 20
+	class Episode : public NEAT::Simulator {
+	public:
+		explicit Episode(uint32_t limit) :inputs(2), fitness{}, steps{}, stepped_after_end{}, limit{ limit } {}
+
+		void update_with_network_output(const std::vector<double>& net_outs) override {
+			if (is_terminal()) stepped_after_end = true;
+			fitness += net_outs[0];
+			steps++;
+		}
+
+		const std::vector<double>& get_inputs_to_network() override {
+			inputs[0] = std::sin(0.1 * steps);
+			inputs[1] = fitness * 0.01;
+			return inputs;
+		}
+
+		double get_fitness() override { return fitness; }
+		void reset() override { fitness = 0; steps = 0; stepped_after_end = false; }
+		bool is_terminal() override { return steps >= limit || fitness > 20; }
+
+		std::vector<double> inputs;
+		double fitness;
+		uint32_t steps;
+		bool stepped_after_end;
+
+	private:
+		uint32_t limit;
+	};
+}
+
+int main()
+{
+	try {
+		const uint32_t size = 200, timesteps = 400;
+		NEAT::System sys{ size, 3, 1, 1 };
+		sys.set_seed(7);
+		std::vector<std::shared_ptr<NEAT::Simulator>> sims;
+		for (uint32_t i = 0; i < size; ++i) sims.push_back(std::make_shared<Episode>(i * 3));
+		sys.init_simulators(sims);
+
+		uint32_t mismatches = 0, ended = 0;
+		for (uint32_t generation = 0; generation < 15; ++generation) {
+			std::vector<NEAT::Network> copies = sys.get_population();
+			sys.simulate_multithread(timesteps);
+
+			for (uint32_t i = 0; i < size; ++i) {
+				const Episode& lockstep = static_cast<const Episode&>(*sims[i]);
+				Episode single{ i * 3 };
+				const uint32_t ran = copies[i].simulate(single, timesteps);
+				const NEAT::Network& net = sys.get_population()[i];
+
+				bool same = ran == single.steps && lockstep.steps == single.steps && !lockstep.stepped_after_end
+					&& !single.stepped_after_end && net.get_raw_fitness() == copies[i].get_raw_fitness();
+				for (size_t n = 0; same && n < net.get_nodes().size(); ++n) {
+					same = net.get_state().node(n) == copies[i].get_state().node(n);
+				}
+				mismatches += !same;
+				ended += single.steps < timesteps;
+			}
+
+			sys.produce_next_generation();
+			sys.reset_simulators();
+		}
+
+		std::cout << ended << " episodes ended early, " << mismatches << " mismatches\n";
+		return mismatches == 0 && ended > 0 ? 0 : 1;
+	}
+	catch (std::exception& e) {
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,30 @@
+// A stand-in evaluation worker for NEAT::ProcessPool: runs genomes on the library's own simulators, in a
+// process of its own. Started by the pool as
+//   neat_worker <simulator> <socket>
+// with <simulator> one of xor or cart-beam, and <socket> the number of the socket it inherits.
+// For example: NEAT::ProcessPool pool{ 4, { "./neat_worker", "xor" } };
+#include "../process_pool.h"
+#include "../xor_test.h"
+#include "../cart_beam.h"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " xor|cart-beam <socket>\n";
+		return 2;
+	}
+
+	const std::string simulator = argv[1];
+	NEAT::ProcessPool::SimulatorFactory make_simulator;
+	if (simulator == "xor") make_simulator = [] { return std::make_unique<XOR>(); };
+	else if (simulator == "cart-beam") make_simulator = [] { return std::make_unique<Cart_beam_system>(); };
+	else {
+		std::cerr << "Unknown simulator " << simulator << '\n';
+		return 2;
+	}
+
+	return NEAT::ProcessPool::run_worker(std::stoi(argv[2]), make_simulator);
+}
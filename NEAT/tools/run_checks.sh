@@ -0,0 +1,70 @@
+#!/bin/sh
+# Builds and runs the regression checks, tools/check_*.cpp, each linked with the library sources, and fails if
+# any check fails to build or exits non-zero. Run it from anywhere:
+#   tools/run_checks.sh [check names...]
+# CXX and CXXFLAGS pick the compiler (g++, -O2 -mavx2 by default). A check names any extra flags it needs on a
+# line starting "// flags:", and the library is built once for each set of flags. Checks that use the cart and
+# beam need SDL 2, from SDL_CFLAGS and SDL_LIBS or else sdl2-config; without it they are reported as skipped.
+set -u
+
+here=$(cd "$(dirname "$0")" && pwd)
+src=$(dirname "$here")
+build=${BUILD:-"$src/_checks"}
+cxx=${CXX:-g++}
+cxxflags=${CXXFLAGS:--O2 -mavx2}
+cxxflags="$cxxflags -D__debugbreak=__builtin_trap" # the MSVC intrinsic in Network::byte_genome_read
+
+if [ -z "${SDL_CFLAGS+x}" ] && command -v sdl2-config >/dev/null 2>&1; then
+	SDL_CFLAGS=$(sdl2-config --cflags)
+	SDL_LIBS=$(sdl2-config --libs)
+fi
+
+# the library without main.cpp and the rendering
+library="activation alloc_check checkpoint innovation island jit lockstep network phenotype precision process_pool simd species system thread_pool"
+cart="cart_beam cart_beam_batch"
+
+# objects <flags> <names...>: builds the named sources with flags into a directory of their own, and prints the objects
+objects() {
+	flags=$1
+	shift
+	dir="$build/obj$(printf '%s' "$flags" | tr -c 'A-Za-z0-9_\n' '_')"
+	mkdir -p "$dir" || return 1
+	for name in "$@"; do
+		if [ ! -f "$dir/$name.o" ] || [ "$src/$name.cpp" -nt "$dir/$name.o" ] || [ -n "$(find "$src" -maxdepth 1 -name '*.h' -newer "$dir/$name.o")" ]; then
+			$cxx -std=c++17 $cxxflags $flags -c "$src/$name.cpp" -o "$dir/$name.o" >&2 || return 1
+		fi
+		printf '%s ' "$dir/$name.o"
+	done
+}
+
+if [ $# -gt 0 ]; then checks=$*
+else checks=$(cd "$here" && ls check_*.cpp | sed 's/\.cpp$//')
+fi
+
+failed=0
+for check in $checks; do
+	file="$here/$check.cpp"
+	flags=$(sed -n 's|^// flags:||p' "$file")
+	names=$library
+	libs=-lpthread
+	if grep -q 'cart_beam' "$file"; then
+		if [ -z "${SDL_CFLAGS+x}" ]; then
+			echo "SKIP $check (needs SDL 2)"
+			continue
+		fi
+		flags="$flags $SDL_CFLAGS"
+		names="$names $cart"
+		libs="$libs ${SDL_LIBS:-}"
+	fi
+
+	if objs=$(objects "$flags" $names) &&
+		$cxx -std=c++17 $cxxflags $flags -I"$src" "$file" $objs $libs -o "$build/$check"; then
+		if (cd "$build" && "./$check"); then echo "PASS $check"
+		else echo "FAIL $check"; failed=1
+		fi
+	else
+		echo "FAIL $check (build)"
+		failed=1
+	fi
+done
+exit $failed
@@ -3,7 +3,9 @@
 
 #include "simulator.h"
 
-class XOR : public NEAT::Simulator {
+// the four cases one timestep at a time as a Simulator, or all four at once as a Dataset (System::init_dataset).
+// the two agree for networks without recurrent connections
+class XOR : public NEAT::Simulator, public NEAT::Dataset {
 public:
 	XOR() :xor_input(2), expected_output{ 0 }, fitness{ 0 }, test_count{ 0 } {}
 
@@ -13,24 +15,34 @@ public:
 	}
 
 	const std::vector<double>& get_inputs_to_network() override {
+		write_inputs_to_network(xor_input.data(), 2);
+		return xor_input;
+	}
+
+	void write_inputs_to_network(double* inputs, uint32_t count) override {
+		if (count != 2) throw std::runtime_error("XOR takes two inputs");
 		switch (test_count) {
 		case 0:
-			xor_input = { 0, 0 };
+			inputs[0] = 0;
+			inputs[1] = 0;
 			expected_output = 0;
 			break;
 
 		case 1:
-			xor_input = { 0, 1 };
+			inputs[0] = 0;
+			inputs[1] = 1;
 			expected_output = 1;
 			break;
 
 		case 2:
-			xor_input = { 1, 0 };
+			inputs[0] = 1;
+			inputs[1] = 0;
 			expected_output = 1;
 			break;
 
 		case 3:
-			xor_input = { 1, 1 };
+			inputs[0] = 1;
+			inputs[1] = 1;
 			expected_output = 0;
 			break;
 
@@ -40,8 +52,6 @@ public:
 
 		if (test_count < 3) test_count++;
 		else test_count = 0;
-
-		return xor_input;
 	}
 
 	double get_fitness() override { 
@@ -50,9 +60,21 @@ public:
 	}
 	void reset() override { test_count = 0; fitness = 0; }
 
+	uint32_t rows() const override { return 4; }
+	const double* inputs() const override { return cases; }
+
+	double score(const double* outputs) const override {
+		double score = 0;
+		for (uint32_t r = 0; r < 4; ++r) score += 1 - pow((expected[r] - outputs[r]), 2);
+		return score;
+	}
+
 private:
 	std::vector<double> xor_input;
 	uint8_t test_count;
 	double expected_output;
 	double fitness;
+
+	static constexpr double cases[8] = { 0, 0, 0, 1, 1, 0, 1, 1 };
+	static constexpr double expected[4] = { 0, 1, 1, 0 };
 };
\ No newline at end of file